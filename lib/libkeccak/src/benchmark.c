@@ -43,6 +43,10 @@
 # define OUTPUT             512
 #endif
 
+#ifndef KERNEL
+# define KERNEL  LIBKECCAK_KERNEL_AUTO
+#endif
+
 #ifndef UPDATE_RUNS
 # define UPDATE_RUNS        100
 #endif
@@ -97,6 +101,8 @@ int main(void)
   spec.output = OUTPUT;
   if (libkeccak_state_initialise(&state, &spec))
     return perror("libkeccak_state_initialise"), 1;
+  if (libkeccak_state_set_kernel(&state, KERNEL))
+    return perror("libkeccak_state_set_kernel"), 1;
   
   /* Get start-time. */
   if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start) < 0)
@@ -24,9 +24,14 @@
 #include "libkeccak/generalised-spec.h"
 #include "libkeccak/state.h"
 #include "libkeccak/digest.h"
+#include "libkeccak/checkpoint.h"
+#include "libkeccak/cshake.h"
 #include "libkeccak/hex.h"
 #include "libkeccak/files.h"
+#include "libkeccak/k12.h"
+#include "libkeccak/parallelhash.h"
 #include "libkeccak/mac/hmac.h"
+#include "libkeccak/mac/kmac.h"
 
 
 #endif
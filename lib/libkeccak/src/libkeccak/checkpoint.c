@@ -0,0 +1,252 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "checkpoint.h"
+
+#include "digest.h"
+#include "private.h"
+
+#include <errno.h>
+#include <string.h>
+
+
+
+/**
+ * The magic number at the beginning of a checkpoint
+ */
+#define MAGIC  "KECCAKCP"
+
+/**
+ * The offsets of the fields in a checkpoint
+ */
+#define OFF_VERSION    8
+#define OFF_RESERVED1  12
+#define OFF_BITRATE    16
+#define OFF_CAPACITY   20
+#define OFF_OUTPUT     24
+#define OFF_ROUNDS     28
+#define OFF_MPTR       32
+#define OFF_RESERVED2  36
+#define OFF_POSITION   40
+#define OFF_LANES      48
+#define OFF_MESSAGE    248
+#define OFF_CHECKSUM   448
+
+
+
+/**
+ * Store a 32-bit integer in little-endian
+ * 
+ * @param  data   The output buffer
+ * @param  value  The integer
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_checkpoint_store32(char* restrict data, uint32_t value)
+{
+  size_t i;
+  for (i = 0; i < 4; i++, value >>= 8)
+    data[i] = (char)(value & 255);
+}
+
+
+/**
+ * Store a 64-bit integer in little-endian
+ * 
+ * @param  data   The output buffer
+ * @param  value  The integer
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_checkpoint_store64(char* restrict data, uint64_t value)
+{
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  __builtin_memcpy(data, &value, sizeof(value));
+#else
+  size_t i;
+  for (i = 0; i < 8; i++, value >>= 8)
+    data[i] = (char)(value & 255);
+#endif
+}
+
+
+/**
+ * Load a 32-bit integer stored in little-endian
+ * 
+ * @param   data  The input buffer
+ * @return        The integer
+ */
+static __attribute__((nonnull, nothrow, pure, warn_unused_result))
+uint32_t libkeccak_checkpoint_load32(const char* restrict data)
+{
+  uint32_t value = 0;
+  size_t i;
+  for (i = 4; i--;)
+    value = (value << 8) | (uint32_t)(unsigned char)data[i];
+  return value;
+}
+
+
+/**
+ * Load a 64-bit integer stored in little-endian
+ * 
+ * @param   data  The input buffer
+ * @return        The integer
+ */
+static __attribute__((nonnull, nothrow, pure, warn_unused_result))
+uint64_t libkeccak_checkpoint_load64(const char* restrict data)
+{
+  uint64_t value = 0;
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  __builtin_memcpy(&value, data, sizeof(value));
+#else
+  size_t i;
+  for (i = 8; i--;)
+    value = (value << 8) | (uint64_t)(unsigned char)data[i];
+#endif
+  return value;
+}
+
+
+/**
+ * Store a checkpoint of a hashing process
+ * 
+ * @param   state     The hashing state, the state size must be at most 1600 bits
+ *                    and it may only have been updated, not digested
+ * @param   position  Any value the application wants to store with
+ *                    the state, for example the number of bytes hashed
+ * @param   data      Output buffer of `LIBKECCAK_CHECKPOINT_SIZE` bytes
+ * @return            Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                    if the state cannot be stored as a checkpoint
+ */
+int libkeccak_checkpoint_save(const libkeccak_state_t* restrict state, uint64_t position, char* restrict data)
+{
+  size_t i;
+  
+  if ((state->b > 1600) || (state->n > (long)INT32_MAX) || (state->mptr >= (size_t)(state->r >> 3)))
+    return errno = EINVAL, -1;
+  
+  memcpy(data, MAGIC, 8);
+  libkeccak_checkpoint_store32(data + OFF_VERSION, LIBKECCAK_CHECKPOINT_VERSION);
+  libkeccak_checkpoint_store32(data + OFF_RESERVED1, 0);
+  libkeccak_checkpoint_store32(data + OFF_BITRATE, (uint32_t)(state->r));
+  libkeccak_checkpoint_store32(data + OFF_CAPACITY, (uint32_t)(state->c));
+  libkeccak_checkpoint_store32(data + OFF_OUTPUT, (uint32_t)(state->n));
+  libkeccak_checkpoint_store32(data + OFF_ROUNDS, (uint32_t)(state->nr));
+  libkeccak_checkpoint_store32(data + OFF_MPTR, (uint32_t)(state->mptr));
+  libkeccak_checkpoint_store32(data + OFF_RESERVED2, 0);
+  libkeccak_checkpoint_store64(data + OFF_POSITION, position);
+  for (i = 0; i < 25; i++)
+    libkeccak_checkpoint_store64(data + OFF_LANES + 8 * i, (uint64_t)(state->S[i]));
+  memcpy(data + OFF_MESSAGE, state->M, state->mptr * sizeof(char));
+  memset(data + OFF_MESSAGE + state->mptr, 0, 1600 / 8 - state->mptr);
+  
+  libkeccak_sha3_256(data + OFF_CHECKSUM, data, OFF_CHECKSUM);
+  return 0;
+}
+
+
+/**
+ * Validate a checkpoint in place, it is not copied
+ * 
+ * @param   data  The checkpoint, for example mapped from a file
+ * @param   size  The number of bytes available in `data`
+ * @param   spec  Output parameter for the hashing specifications
+ *                of the checkpoint, may be `NULL`
+ * @return        Zero if the checkpoint is valid, -1 otherwise; `errno` is set to
+ *                `EINVAL` if it is truncated or malformed, `ENOTSUP` if it has a
+ *                newer format version, and `EBADMSG` if it has been corrupted
+ */
+int libkeccak_checkpoint_verify(const char* restrict data, size_t size, libkeccak_spec_t* restrict spec)
+{
+  libkeccak_spec_t s;
+  char checksum[256 / 8];
+  uint32_t version, r, c, n, mptr;
+  long w, l, nr;
+  
+  if ((size < LIBKECCAK_CHECKPOINT_SIZE) || memcmp(data, MAGIC, 8))
+    return errno = EINVAL, -1;
+  version = libkeccak_checkpoint_load32(data + OFF_VERSION);
+  if (version != LIBKECCAK_CHECKPOINT_VERSION)
+    return errno = (version > LIBKECCAK_CHECKPOINT_VERSION ? ENOTSUP : EINVAL), -1;
+  
+  libkeccak_sha3_256(checksum, data, OFF_CHECKSUM);
+  if (memcmp(checksum, data + OFF_CHECKSUM, sizeof(checksum)))
+    return errno = EBADMSG, -1;
+  
+  if (libkeccak_checkpoint_load32(data + OFF_RESERVED1) || libkeccak_checkpoint_load32(data + OFF_RESERVED2))
+    return errno = EINVAL, -1;
+  r = libkeccak_checkpoint_load32(data + OFF_BITRATE);
+  c = libkeccak_checkpoint_load32(data + OFF_CAPACITY);
+  n = libkeccak_checkpoint_load32(data + OFF_OUTPUT);
+  if ((r > 1600) || (c > 1600) || (n > (uint32_t)INT32_MAX))
+    return errno = EINVAL, -1;
+  s.bitrate = (long)r, s.capacity = (long)c, s.output = (long)n;
+  if (libkeccak_spec_check(&s))
+    return errno = EINVAL, -1;
+  
+  w = (s.bitrate + s.capacity) / 25;
+  for (l = 0; (1L << l) < w; l++);
+  nr = (long)libkeccak_checkpoint_load32(data + OFF_ROUNDS);
+  mptr = libkeccak_checkpoint_load32(data + OFF_MPTR);
+  if ((nr < 1) || (nr > 12 + (l << 1)) || ((w == 64) && (nr & 1)))
+    return errno = EINVAL, -1;
+  if (mptr >= (r >> 3))
+    return errno = EINVAL, -1;
+  
+  if (spec != NULL)
+    *spec = s;
+  return 0;
+}
+
+
+/**
+ * Validate a checkpoint and resume the hashing process it stores
+ * 
+ * @param   state     The hashing state, it must have been initialised with the
+ *                    specifications of the checkpoint, and have the same number
+ *                    of rounds, nothing is allocated
+ * @param   data      The checkpoint, for example mapped from a file
+ * @param   size      The number of bytes available in `data`
+ * @param   position  Output parameter for the position stored with the state, may be `NULL`
+ * @return            Zero on success, -1 on error; `errno` is set as by
+ *                    `libkeccak_checkpoint_verify`, or to `EINVAL` if the
+ *                    specifications or number of rounds of `state` differ
+ *                    from the checkpoint's
+ */
+int libkeccak_checkpoint_resume(libkeccak_state_t* restrict state, const char* restrict data,
+				size_t size, uint64_t* restrict position)
+{
+  libkeccak_spec_t spec;
+  size_t i;
+  
+  if (libkeccak_checkpoint_verify(data, size, &spec))
+    return -1;
+  if ((spec.bitrate != state->r) || (spec.capacity != state->c) || (spec.output != state->n))
+    return errno = EINVAL, -1;
+  if ((long)libkeccak_checkpoint_load32(data + OFF_ROUNDS) != state->nr)
+    return errno = EINVAL, -1;
+  
+  for (i = 0; i < 25; i++)
+    state->S[i] = (int64_t)libkeccak_checkpoint_load64(data + OFF_LANES + 8 * i);
+  state->mptr = (size_t)libkeccak_checkpoint_load32(data + OFF_MPTR);
+  memcpy(state->M, data + OFF_MESSAGE, state->mptr * sizeof(char));
+  
+  if (position != NULL)
+    *position = libkeccak_checkpoint_load64(data + OFF_POSITION);
+  return 0;
+}
+
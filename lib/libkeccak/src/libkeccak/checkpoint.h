@@ -0,0 +1,116 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_CHECKPOINT_H
+#define LIBKECCAK_CHECKPOINT_H  1
+
+
+/* Unlike `libkeccak_state_marshal`, which stores the state as it is laid
+ * out in memory, checkpoints have a fixed layout that does not depend on
+ * the host, so that a hashing process can be resumed on another machine.
+ * All integers are stored in little-endian:
+ * 
+ *   Offset  Size  Contents
+ *        0     8  "KECCAKCP"
+ *        8     4  Format version, `LIBKECCAK_CHECKPOINT_VERSION`
+ *       12     4  Reserved, zero
+ *       16     4  Bitrate, in bits
+ *       20     4  Capacity, in bits
+ *       24     4  Output size, in bits
+ *       28     4  Number of rounds
+ *       32     4  Number of bytes in the message buffer, less than the bitrate in bytes
+ *       36     4  Reserved, zero
+ *       40     8  Position, chosen by the application
+ *       48   200  The 25 lanes of the sponge, 8 bytes each
+ *      248   200  The message buffer, padded with zeroes
+ *      448    32  SHA3-256 of bytes 0 to 447
+ */
+
+
+#include "spec.h"
+#include "state.h"
+#include "internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/**
+ * The version of the checkpoint format that is written
+ */
+#define LIBKECCAK_CHECKPOINT_VERSION  1
+
+/**
+ * The size of a checkpoint, in bytes
+ */
+#define LIBKECCAK_CHECKPOINT_SIZE  480
+
+
+
+/**
+ * Store a checkpoint of a hashing process
+ * 
+ * @param   state     The hashing state, the state size must be at most 1600 bits
+ *                    and it may only have been updated, not digested
+ * @param   position  Any value the application wants to store with
+ *                    the state, for example the number of bytes hashed
+ * @param   data      Output buffer of `LIBKECCAK_CHECKPOINT_SIZE` bytes
+ * @return            Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                    if the state cannot be stored as a checkpoint
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow)))
+int libkeccak_checkpoint_save(const libkeccak_state_t* restrict state, uint64_t position, char* restrict data);
+
+
+/**
+ * Validate a checkpoint in place, it is not copied
+ * 
+ * @param   data  The checkpoint, for example mapped from a file
+ * @param   size  The number of bytes available in `data`
+ * @param   spec  Output parameter for the hashing specifications
+ *                of the checkpoint, may be `NULL`
+ * @return        Zero if the checkpoint is valid, -1 otherwise; `errno` is set to
+ *                `EINVAL` if it is truncated or malformed, `ENOTSUP` if it has a
+ *                newer format version, and `EBADMSG` if it has been corrupted
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow)))
+int libkeccak_checkpoint_verify(const char* restrict data, size_t size, libkeccak_spec_t* restrict spec);
+
+
+/**
+ * Validate a checkpoint and resume the hashing process it stores
+ * 
+ * @param   state     The hashing state, it must have been initialised with the
+ *                    specifications of the checkpoint, and have the same number
+ *                    of rounds, nothing is allocated
+ * @param   data      The checkpoint, for example mapped from a file
+ * @param   size      The number of bytes available in `data`
+ * @param   position  Output parameter for the position stored with the state, may be `NULL`
+ * @return            Zero on success, -1 on error; `errno` is set as by
+ *                    `libkeccak_checkpoint_verify`, or to `EINVAL` if the
+ *                    specifications or number of rounds of `state` differ
+ *                    from the checkpoint's
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 2), nothrow)))
+int libkeccak_checkpoint_resume(libkeccak_state_t* restrict state, const char* restrict data,
+				size_t size, uint64_t* restrict position);
+
+
+#endif
+
@@ -0,0 +1,140 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cshake.h"
+
+#include "digest.h"
+#include "private.h"
+
+
+
+/**
+ * Encode an integer as done by `left_encode` in NIST SP 800-185:
+ * the number of bytes used, followed by the integer in big-endian
+ * without leading zeroes, but at least one byte
+ * 
+ * @param   buf  Output parameter for the encoding, `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The length of the encoding
+ */
+size_t libkeccak_left_encode(char* restrict buf, size_t x)
+{
+  size_t n = 1, v;
+  for (v = x >> 8; v; v >>= 8)
+    n++;
+  buf[0] = (char)n;
+  for (v = n; v; v--, x >>= 8)
+    buf[v] = (char)x;
+  return n + 1;
+}
+
+
+/**
+ * Encode an integer as done by `right_encode` in NIST SP 800-185:
+ * the integer in big-endian without leading zeroes, but at least
+ * one byte, followed by the number of bytes used
+ * 
+ * @param   buf  Output parameter for the encoding, `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The length of the encoding
+ */
+size_t libkeccak_right_encode(char* restrict buf, size_t x)
+{
+  size_t n = 1, v;
+  for (v = x >> 8; v; v >>= 8)
+    n++;
+  buf[n] = (char)n;
+  for (v = n; v--; x >>= 8)
+    buf[v] = (char)x;
+  return n + 1;
+}
+
+
+/**
+ * Absorb a string as encoded by `encode_string` in NIST SP 800-185
+ * 
+ * @param   state  The hashing state
+ * @param   str    The string, may be `NULL` if `len` is zero
+ * @param   len    The length of the string, in bytes
+ * @return         The number of absorbed bytes
+ */
+size_t libkeccak_encode_string(libkeccak_state_t* restrict state, const char* restrict str, size_t len)
+{
+  char encoding[sizeof(size_t) + 1];
+  size_t n = libkeccak_left_encode(encoding, len * 8);
+  libkeccak_fast_update(state, encoding, n);
+  if (len)
+    libkeccak_fast_update(state, str, len);
+  return n + len;
+}
+
+
+/**
+ * Absorb the beginning of `bytepad` in NIST SP 800-185,
+ * the encoding of the rate
+ * 
+ * @param   state  The hashing state
+ * @return         The number of absorbed bytes
+ */
+size_t libkeccak_bytepad_begin(libkeccak_state_t* restrict state)
+{
+  char encoding[sizeof(size_t) + 1];
+  size_t n = libkeccak_left_encode(encoding, (size_t)(state->r >> 3));
+  libkeccak_fast_update(state, encoding, n);
+  return n;
+}
+
+
+/**
+ * Absorb the end of `bytepad` in NIST SP 800-185,
+ * the zeroes up to the next multiple of the rate
+ * 
+ * @param  state  The hashing state
+ * @param  n      The number of bytes absorbed since `libkeccak_bytepad_begin`
+ *                was called, including the bytes it absorbed
+ */
+void libkeccak_bytepad_end(libkeccak_state_t* restrict state, size_t n)
+{
+  static const char zeroes[1600 / 8] = { 0 };
+  size_t rr = (size_t)(state->r >> 3);
+  libkeccak_fast_update(state, zeroes, (rr - n % rr) % rr);
+}
+
+
+/**
+ * Absorb the function name and customisation string of cSHAKE
+ * 
+ * @param  state      The hashing state
+ * @param  name       The function name, `N`, may be `NULL` if `namelen` is zero
+ * @param  namelen    The length of the function name, in bytes
+ * @param  custom     The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param  customlen  The length of the customisation string, in bytes
+ */
+void libkeccak_cshake_initialise(libkeccak_state_t* restrict state, const char* restrict name, size_t namelen,
+				 const char* restrict custom, size_t customlen)
+{
+  size_t n;
+  
+  if (!namelen && !customlen)
+    return;
+  
+  n  = libkeccak_bytepad_begin(state);
+  n += libkeccak_encode_string(state, name, namelen);
+  n += libkeccak_encode_string(state, custom, customlen);
+  libkeccak_bytepad_end(state, n);
+}
@@ -0,0 +1,71 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_CSHAKE_H
+#define LIBKECCAK_CSHAKE_H  1
+
+
+#include "spec.h"
+#include "state.h"
+#include "internal.h"
+
+#include <stddef.h>
+
+
+
+/**
+ * Absorb the function name and customisation string of cSHAKE,
+ * as `bytepad(encode_string(N) || encode_string(S), rate)` in
+ * NIST SP 800-185, into a state that has just been initialised
+ * with `libkeccak_spec_cshake`, nothing is absorbed if both
+ * strings are empty, in which case cSHAKE is SHAKE
+ * 
+ * The message is then hashed with `libkeccak_update` and
+ * `libkeccak_digest`, or their faster versions, using the
+ * suffix returned by `libkeccak_cshake_suffix`
+ * 
+ * @param  state      The hashing state
+ * @param  name       The function name, `N`, may be `NULL` if `namelen` is zero
+ * @param  namelen    The length of the function name, in bytes
+ * @param  custom     The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param  customlen  The length of the customisation string, in bytes
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow)))
+void libkeccak_cshake_initialise(libkeccak_state_t* restrict state, const char* restrict name, size_t namelen,
+				 const char* restrict custom, size_t customlen);
+
+
+/**
+ * Get the message suffix for cSHAKE
+ * 
+ * @param   namelen    The length of the function name
+ * @param   customlen  The length of the customisation string
+ * @return             `LIBKECCAK_CSHAKE_SUFFIX`, or `LIBKECCAK_SHAKE_SUFFIX`
+ *                     if both the function name and the customisation
+ *                     string are empty
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nothrow, const, unused, warn_unused_result)))
+static inline
+const char* libkeccak_cshake_suffix(size_t namelen, size_t customlen)
+{
+  return (namelen || customlen) ? LIBKECCAK_CSHAKE_SUFFIX : LIBKECCAK_SHAKE_SUFFIX;
+}
+
+
+#endif
+
@@ -19,6 +19,13 @@
 #include "digest.h"
 
 #include "state.h"
+#include "private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define LIBKECCAK_HAVE_AVX2  1
+# define LIBKECCAK_HAVE_X86_KERNELS  1
+# include <immintrin.h>
+#endif
 
 
 
@@ -85,10 +92,10 @@ static const uint_fast64_t RC[] =
  * Rotate a 64-bit word
  * 
  * @param   x:int_fast64_t  The value to rotate
- * @param   n:long          Rotation steps, may not be zero
+ * @param   n:long          Rotation steps, may be zero
  * @return   :int_fast64_t  The value rotated
  */
-#define rotate64(x, n)  ((int_fast64_t)(((uint64_t)(x) >> (64L - (n))) | ((uint64_t)(x) << (n))))
+#define rotate64(x, n)  ((int_fast64_t)(((uint64_t)(x) >> ((64L - (n)) & 63L)) | ((uint64_t)(x) << (n))))
 
 
 /**
@@ -139,34 +146,196 @@ void libkeccak_f_round(register libkeccak_state_t* restrict state, register int_
 
 
 /**
- * 64-bit word version of `libkeccak_f_round`
+ * θ step for Keccak-f[1600] on lanes stored in local variables
+ * 
+ * @param  A  The prefix of the names of the 25 lanes,
+ *            lane `N` is stored in `A##N`
+ */
+#define LIBKECCAK_THETA64(A)							\
+  c0 = A##0  ^ A##1  ^ A##2  ^ A##3  ^ A##4;					\
+  c1 = A##5  ^ A##6  ^ A##7  ^ A##8  ^ A##9;					\
+  c2 = A##10 ^ A##11 ^ A##12 ^ A##13 ^ A##14;					\
+  c3 = A##15 ^ A##16 ^ A##17 ^ A##18 ^ A##19;					\
+  c4 = A##20 ^ A##21 ^ A##22 ^ A##23 ^ A##24;					\
+  da = c4 ^ rotate64(c1, 1);							\
+  db = c0 ^ rotate64(c2, 1);							\
+  dc = c1 ^ rotate64(c3, 1);							\
+  dd = c2 ^ rotate64(c4, 1);							\
+  de = c3 ^ rotate64(c0, 1)
+
+/**
+ * ρ and π steps, with the last part of θ, for one row
+ * of the χ step, the result is stored in `b0`–`b4`
+ * 
+ * @param  A0..A4  The lanes that are moved into the row
+ * @param  D0..D4  The θ value for each lane
+ * @param  R0..R4  The rotation of each lane
+ */
+#define LIBKECCAK_RHO_PI64(A0, D0, R0, A1, D1, R1, A2, D2, R2, A3, D3, R3, A4, D4, R4)	\
+  b0 = rotate64(A0 ^ D0, R0);							\
+  b1 = rotate64(A1 ^ D1, R1);							\
+  b2 = rotate64(A2 ^ D2, R2);							\
+  b3 = rotate64(A3 ^ D3, R3);							\
+  b4 = rotate64(A4 ^ D4, R4)
+
+/**
+ * χ step for one row
+ * 
+ * @param  E0..E4  The output lanes
+ */
+#define LIBKECCAK_CHI64(E0, E1, E2, E3, E4)					\
+  E0 = b0 ^ (~b1 & b2);								\
+  E1 = b1 ^ (~b2 & b3);								\
+  E2 = b2 ^ (~b3 & b4);								\
+  E3 = b3 ^ (~b4 & b0);								\
+  E4 = b4 ^ (~b0 & b1)
+
+/**
+ * Lane-complementing version of `LIBKECCAK_CHI64`, for each row
+ * 
+ * The lanes 4, 5, 10, 12, 13 and 16 (be, bi, go, ki, mi and sa
+ * in the Keccak team's notation) are stored complemented before
+ * and after each round. This reduces the number of NOT operations
+ * in the χ step from 25 to 5 per round, which matters on CPUs
+ * without ANDN.
+ * 
+ * @param  E0..E4  The output lanes
+ */
+#define LIBKECCAK_CHI64_LC0(E0, E1, E2, E3, E4)					\
+  E0 = b0 ^ ( b1 |  b2);							\
+  E1 = b1 ^ (~b2 |  b3);							\
+  E2 = b2 ^ ( b3 &  b4);							\
+  E3 = b3 ^ ( b4 |  b0);							\
+  E4 = b4 ^ ( b0 &  b1)
+#define LIBKECCAK_CHI64_LC1(E0, E1, E2, E3, E4)					\
+  E0 = b0 ^ ( b1 |  b2);							\
+  E1 = b1 ^ ( b2 &  b3);							\
+  E2 = b2 ^ ( b3 | ~b4);							\
+  E3 = b3 ^ ( b4 |  b0);							\
+  E4 = b4 ^ ( b0 &  b1)
+#define LIBKECCAK_CHI64_LC2(E0, E1, E2, E3, E4)					\
+  nb = ~b3;									\
+  E0 = b0 ^ ( b1 |  b2);							\
+  E1 = b1 ^ ( b2 &  b3);							\
+  E2 = b2 ^ ( nb &  b4);							\
+  E3 = nb ^ ( b4 |  b0);							\
+  E4 = b4 ^ ( b0 &  b1)
+#define LIBKECCAK_CHI64_LC3(E0, E1, E2, E3, E4)					\
+  nb = ~b3;									\
+  E0 = b0 ^ ( b1 &  b2);							\
+  E1 = b1 ^ ( b2 |  b3);							\
+  E2 = b2 ^ ( nb |  b4);							\
+  E3 = nb ^ ( b4 &  b0);							\
+  E4 = b4 ^ ( b0 |  b1)
+#define LIBKECCAK_CHI64_LC4(E0, E1, E2, E3, E4)					\
+  nb = ~b1;									\
+  E0 = b0 ^ ( nb &  b2);							\
+  E1 = nb ^ ( b2 |  b3);							\
+  E2 = b2 ^ ( b3 &  b4);							\
+  E3 = b3 ^ ( b4 |  b0);							\
+  E4 = b4 ^ ( b0 &  b1)
+
+/**
+ * One χ row, selecting the lane-complementing version
+ * if the variable `complement` is non-zero
+ * 
+ * @param  Y       The index of the row
+ * @param  E0..E4  The output lanes
+ */
+#define LIBKECCAK_CHI64_ROW(Y, E0, E1, E2, E3, E4)				\
+  if (complement)								\
+    {										\
+      LIBKECCAK_CHI64_LC##Y(E0, E1, E2, E3, E4);				\
+    }										\
+  else										\
+    {										\
+      LIBKECCAK_CHI64(E0, E1, E2, E3, E4);					\
+    }
+
+/**
+ * One round of Keccak-f[1600] on lanes stored in local variables
+ * 
+ * The π step is done by reading the lanes from `A` in the
+ * permuted order and writing them to `E`, so no copying is
+ * needed; the next round reads from `E` and writes to `A`
+ * 
+ * @param  A   The prefix of the names of the input lanes
+ * @param  E   The prefix of the names of the output lanes
+ * @param  RC  The round constant
+ */
+#define LIBKECCAK_ROUND64(A, E, RC)						\
+  LIBKECCAK_THETA64(A);								\
+  LIBKECCAK_RHO_PI64(A##0,  da,  0, A##6,  db, 44, A##12, dc, 43, A##18, dd, 21, A##24, de, 14);	\
+  LIBKECCAK_CHI64_ROW(0, E##0, E##5, E##10, E##15, E##20);			\
+  E##0 ^= (int_fast64_t)(RC);							\
+  LIBKECCAK_RHO_PI64(A##15, dd, 28, A##21, de, 20, A##2,  da,  3, A##8,  db, 45, A##14, dc, 61);	\
+  LIBKECCAK_CHI64_ROW(1, E##1, E##6, E##11, E##16, E##21);			\
+  LIBKECCAK_RHO_PI64(A##5,  db,  1, A##11, dc,  6, A##17, dd, 25, A##23, de,  8, A##4,  da, 18);	\
+  LIBKECCAK_CHI64_ROW(2, E##2, E##7, E##12, E##17, E##22);			\
+  LIBKECCAK_RHO_PI64(A##20, de, 27, A##1,  da, 36, A##7,  db, 10, A##13, dc, 15, A##19, dd, 56);	\
+  LIBKECCAK_CHI64_ROW(3, E##3, E##8, E##13, E##18, E##23);			\
+  LIBKECCAK_RHO_PI64(A##10, dc, 62, A##16, dd, 55, A##22, de, 39, A##3,  da, 41, A##9,  db,  2);	\
+  LIBKECCAK_CHI64_ROW(4, E##4, E##9, E##14, E##19, E##24)
+
+
+/**
+ * Perform the Keccak-f permutation using the
+ * kernel selected for the state
  * 
  * @param  state  The hashing state
- * @param  rc     The round contant for this round
  */
-static __attribute__((nonnull, nothrow, hot))
-void libkeccak_f_round64(register libkeccak_state_t* restrict state, register int_fast64_t rc)
+static inline __attribute__((nonnull, nothrow, gnu_inline))
+void libkeccak_f(register libkeccak_state_t* restrict state)
 {
-  int_fast64_t* restrict A = state->S;
-  int_fast64_t B[25];
-  int_fast64_t C[5];
-  int_fast64_t da, db, dc, dd, de;
+  state->permute(state);
+}
+
+
+#ifdef LIBKECCAK_HAVE_AVX2
+
+/**
+ * Rotate four 64-bit words
+ * 
+ * @param   x:__m256i  The values to rotate
+ * @param   n:int      Rotation steps, may not be zero
+ * @return   :__m256i  The values rotated
+ */
+# define rotate64x4(x, n)  _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+
+
+/**
+ * Four-way version of `LIBKECCAK_ROUND64`, performs one
+ * round of computation on four independent sponges, lane
+ * `i` of each sponge is stored in `A[i]`
+ * 
+ * @param  A   The lanes of the four sponges, interleaved
+ * @param  rc  The round contant for this round
+ */
+static __attribute__((nonnull, nothrow, hot, target("avx2")))
+void libkeccak_f_round64_x4(register __m256i* restrict A, uint_fast64_t rc)
+{
+  __m256i B[25];
+  __m256i C[5];
+  __m256i da, db, dc, dd, de;
   
   /* θ step (step 1 of 3). */
-#define X(N)  C[N] = A[N * 5] ^ A[N * 5 + 1] ^ A[N * 5 + 2] ^ A[N * 5 + 3] ^ A[N * 5 + 4];
+#define X(N)  C[N] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[N * 5], A[N * 5 + 1]),  \
+							     _mm256_xor_si256(A[N * 5 + 2], A[N * 5 + 3])), \
+				      A[N * 5 + 4]);
   LIST_5
 #undef X
   
   /* θ step (step 2 of 3). */
-  da = C[4] ^ rotate64(C[1], 1);
-  dd = C[2] ^ rotate64(C[4], 1);
-  db = C[0] ^ rotate64(C[2], 1);
-  de = C[3] ^ rotate64(C[0], 1);
-  dc = C[1] ^ rotate64(C[3], 1);
+  da = _mm256_xor_si256(C[4], rotate64x4(C[1], 1));
+  dd = _mm256_xor_si256(C[2], rotate64x4(C[4], 1));
+  db = _mm256_xor_si256(C[0], rotate64x4(C[2], 1));
+  de = _mm256_xor_si256(C[3], rotate64x4(C[0], 1));
+  dc = _mm256_xor_si256(C[1], rotate64x4(C[3], 1));
   
   /* ρ and π steps, with last two part of θ. */
-#define X(bi, ai, dv, r)  B[bi] = rotate64(A[ai] ^ dv, r)
-  B[0] = A[0] ^ da;   X( 1, 15, dd, 28);  X( 2,  5, db,  1);  X( 3, 20, de, 27);  X( 4, 10, dc, 62);
+#define X(bi, ai, dv, r)  B[bi] = rotate64x4(_mm256_xor_si256(A[ai], dv), r)
+  B[0] = _mm256_xor_si256(A[0], da);
+                      X( 1, 15, dd, 28);  X( 2,  5, db,  1);  X( 3, 20, de, 27);  X( 4, 10, dc, 62);
   X( 5,  6, db, 44);  X( 6, 21, de, 20);  X( 7, 11, dc,  6);  X( 8,  1, da, 36);  X( 9, 16, dd, 55);
   X(10, 12, dc, 43);  X(11,  2, da,  3);  X(12, 17, dd, 25);  X(13,  7, db, 10);  X(14, 22, de, 39);
   X(15, 18, dd, 21);  X(16,  8, db, 45);  X(17, 23, de,  8);  X(18, 13, dc, 15);  X(19,  3, da, 41);
@@ -174,35 +343,65 @@ void libkeccak_f_round64(register libkeccak_state_t* restrict state, register in
 #undef X
   
   /* ξ step. */
-#define X(N)  A[N] = B[N] ^ ((~(B[(N + 5) % 25])) & B[(N + 10) % 25]);
+#define X(N)  A[N] = _mm256_xor_si256(B[N], _mm256_andnot_si256(B[(N + 5) % 25], B[(N + 10) % 25]));
   LIST_25
 #undef X
   
   /* ι step. */
-  A[0] ^= rc;
+  A[0] = _mm256_xor_si256(A[0], _mm256_set1_epi64x((long long)rc));
 }
 
 
 /**
- * Convert a chunk of bytes to a lane
+ * Four-way version of `libkeccak_f` for Keccak-p[1600, nr]
  * 
- * @param  state  The hashing state
+ * @param  A   The lanes of the four sponges, interleaved
+ * @param  nr  The number of rounds, at most 24
  */
-static inline __attribute__((nonnull, nothrow, gnu_inline))
-void libkeccak_f(register libkeccak_state_t* restrict state)
+static __attribute__((nonnull, nothrow, target("avx2")))
+void libkeccak_f_x4(register __m256i* restrict A, long nr)
 {
-  register long i = 0;
-  register long nr = state->nr;
-  register long wmod = state->wmod;
-  if (nr == 24)
-    for (; i < nr; i++)
-      libkeccak_f_round64(state, (int_fast64_t)(RC[i]));
-  else
-    for (; i < nr; i++)
-      libkeccak_f_round(state, (int_fast64_t)(RC[i] & wmod));
+  register long i;
+  for (i = 24 - nr; i < 24; i++)
+    libkeccak_f_round64_x4(A, RC[i]);
 }
 
 
+/**
+ * Load the lanes of four sponges into interleaved form
+ * 
+ * @param  A       Output parameter for the interleaved lanes
+ * @param  states  The four hashing states
+ */
+static inline __attribute__((nonnull, nothrow, target("avx2")))
+void libkeccak_load_x4(register __m256i* restrict A, libkeccak_state_t* restrict const* states)
+{
+#define X(N)  A[N] = _mm256_set_epi64x(states[3]->S[N], states[2]->S[N], states[1]->S[N], states[0]->S[N]);
+  LIST_25
+#undef X
+}
+
+
+/**
+ * Store the lanes of four sponges from interleaved form
+ * 
+ * @param  states  The four hashing states
+ * @param  A       The interleaved lanes
+ */
+static inline __attribute__((nonnull, nothrow, target("avx2")))
+void libkeccak_store_x4(libkeccak_state_t* restrict const* states, register const __m256i* restrict A)
+{
+  long long lanes[4];
+#define X(N)  _mm256_storeu_si256((__m256i*)(void*)lanes, A[N]);  \
+              states[0]->S[N] = lanes[0], states[1]->S[N] = lanes[1];  \
+              states[2]->S[N] = lanes[2], states[3]->S[N] = lanes[3];
+  LIST_25
+#undef X
+}
+
+#endif
+
+
 /**
  * Convert a chunk of bytes to a lane
  * 
@@ -253,6 +452,26 @@ int_fast64_t libkeccak_to_lane64(register const char* restrict message, register
 }
 
 
+/**
+ * Convert a chunk of bytes from a whole block to a 64-bit lane
+ * 
+ * @param   message  The block
+ * @param   rr       Bitrate in bytes
+ * @param   off      The offset of the lane in the block, less than `rr`
+ * @return           The lane
+ */
+static inline __attribute__((nonnull, nothrow, pure, hot, warn_unused_result, gnu_inline))
+int_fast64_t libkeccak_block_lane64(register const char* restrict message, register long rr, size_t off)
+{
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  uint64_t v;
+  if (!(rr & 7))
+    return __builtin_memcpy(&v, message + off, sizeof(v)), (int_fast64_t)v;
+#endif
+  return libkeccak_to_lane64(message, (size_t)rr, rr, off);
+}
+
+
 /**
  * pad 10*1
  * 
@@ -288,38 +507,289 @@ void libkeccak_pad10star1(register libkeccak_state_t* restrict state, register s
 
 
 /**
- * Perform the absorption phase
+ * Perform the Keccak-f permutation, for any word size,
+ * if the state has fewer rounds than Keccak-f, the last
+ * rounds are performed, as in Keccak-p
  * 
  * @param  state  The hashing state
- * @param  len    The number of bytes from `state->M` to absorb
+ */
+static __attribute__((nonnull, nothrow, hot))
+void libkeccak_f_generic(register libkeccak_state_t* restrict state)
+{
+  register long n = 12 + (state->l << 1);
+  register long i = n - state->nr;
+  register int_fast64_t wmod = state->wmod;
+  for (; i < n; i++)
+    libkeccak_f_round(state, (int_fast64_t)(RC[i] & wmod));
+}
+
+
+/**
+ * Perform the absorption phase, for any word size
+ * 
+ * @param  state    The hashing state
+ * @param  message  The message to absorb, normally `state->M`
+ * @param  len      The number of bytes from `message` to absorb
  */
 static __attribute__((nonnull, nothrow))
-void libkeccak_absorption_phase(register libkeccak_state_t* restrict state, register size_t len)
+void libkeccak_absorb_generic(register libkeccak_state_t* restrict state,
+			      register const char* restrict message, register size_t len)
 {
   register long rr = state->r >> 3;
   register long ww = state->w >> 3;
   register long n = (long)len / rr;
-  register const char* restrict message = state->M;
-  if (__builtin_expect(ww >= 8, 1)) /* ww > 8 is impossible, it is just for optimisation possibilities. */
-    while (n--)
-      {
-#define X(N)  state->S[N] ^= libkeccak_to_lane64(message, len, rr, (size_t)(LANE_TRANSPOSE_MAP[N] * 8));
-	LIST_25
-#undef X
-	libkeccak_f(state);
-	message += (size_t)rr;
-	len -= (size_t)rr;
-      }
-  else
-    while (n--)
-      {
+  while (n--)
+    {
 #define X(N)  state->S[N] ^= libkeccak_to_lane(message, len, rr, ww, (size_t)(LANE_TRANSPOSE_MAP[N] * ww));
-	LIST_25
+      LIST_25
 #undef X
-	libkeccak_f(state);
-	message += (size_t)rr;
-	len -= (size_t)rr;
-      }
+      libkeccak_f_generic(state);
+      message += (size_t)rr;
+      len -= (size_t)rr;
+    }
+}
+
+
+/**
+ * Perform the Keccak-f[1600] permutation, or Keccak-p[1600, nr]
+ * if the state has fewer than 24 rounds
+ * 
+ * The lanes are kept in local variables through all rounds,
+ * which are unrolled two at the time, so that the compiler can
+ * keep the state in registers as far as possible
+ * 
+ * This function is always inlined so that it is compiled
+ * separately for each instruction set it is used with
+ * 
+ * With `complement`, the six complemented lanes are complemented
+ * when they are loaded and again when they are stored, on every
+ * call, so the state is always stored as usual
+ * 
+ * @param  state       The hashing state
+ * @param  complement  Whether the lane-complementing rounds
+ *                     shall be used, must be a constant
+ */
+static inline __attribute__((nonnull, nothrow, hot, always_inline))
+void libkeccak_f1600(register libkeccak_state_t* restrict state, int complement)
+{
+#define X(N)  int_fast64_t a##N, e##N;
+  LIST_25
+#undef X
+  int_fast64_t b0, b1, b2, b3, b4, c0, c1, c2, c3, c4;
+  int_fast64_t da, db, dc, dd, de, nb = 0;
+  long i;
+  
+#define X(N)  a##N = state->S[N];
+  LIST_25
+#undef X
+  if (complement)
+    a4 = ~a4, a5 = ~a5, a10 = ~a10, a12 = ~a12, a13 = ~a13, a16 = ~a16;
+  
+  for (i = 24 - state->nr; i < 24; i += 2)
+    {
+      LIBKECCAK_ROUND64(a, e, RC[i]);
+      LIBKECCAK_ROUND64(e, a, RC[i + 1]);
+    }
+  
+  if (complement)
+    a4 = ~a4, a5 = ~a5, a10 = ~a10, a12 = ~a12, a13 = ~a13, a16 = ~a16;
+#define X(N)  state->S[N] = a##N;
+  LIST_25
+#undef X
+  (void) nb;
+}
+
+
+/**
+ * Perform the absorption phase, for 64-bit words
+ * 
+ * This function is always inlined so that it is compiled
+ * separately for each instruction set it is used with
+ * 
+ * @param  state       The hashing state
+ * @param  message     The message to absorb, normally `state->M`
+ * @param  len         The number of bytes from `message` to absorb
+ * @param  complement  Whether the lane-complementing rounds
+ *                     shall be used, must be a constant
+ */
+static inline __attribute__((nonnull, nothrow, hot, always_inline))
+void libkeccak_absorb1600(register libkeccak_state_t* restrict state,
+			  register const char* restrict message, register size_t len, int complement)
+{
+  register long rr = state->r >> 3;
+  register long n = (long)len / rr;
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  register long i;
+  uint64_t v;
+  if (!(rr & 7))
+    {
+      /* Every block is whole here, so lanes can be loaded
+       * directly, and the transposition is its own inverse. */
+      while (n--)
+	{
+	  for (i = 0; i < rr >> 3; i++)
+	    {
+	      __builtin_memcpy(&v, message + (i << 3), sizeof(v));
+	      state->S[LANE_TRANSPOSE_MAP[i]] ^= (int64_t)v;
+	    }
+	  libkeccak_f1600(state, complement);
+	  message += (size_t)rr;
+	}
+      return;
+    }
+#endif
+  while (n--)
+    {
+#define X(N)  state->S[N] ^= libkeccak_to_lane64(message, len, rr, (size_t)(LANE_TRANSPOSE_MAP[N] * 8));
+      LIST_25
+#undef X
+      libkeccak_f1600(state, complement);
+      message += (size_t)rr;
+      len -= (size_t)rr;
+    }
+}
+
+
+/**
+ * Define a permutation kernel and an absorption kernel
+ * for Keccak-f[1600] compiled for a specific instruction set
+ * 
+ * @param  NAME        The suffix for the names of the functions
+ * @param  TARGET      Attributes that select the instruction set
+ * @param  COMPLEMENT  1 to use lane-complementing rounds, 0 otherwise
+ */
+#define LIBKECCAK_KERNEL1600(NAME, TARGET, COMPLEMENT)						\
+  static __attribute__((nonnull, nothrow, hot)) TARGET						\
+  void libkeccak_f1600_##NAME(register libkeccak_state_t* restrict state)			\
+  {												\
+    libkeccak_f1600(state, COMPLEMENT);								\
+  }												\
+  static __attribute__((nonnull, nothrow, hot)) TARGET						\
+  void libkeccak_absorb1600_##NAME(register libkeccak_state_t* restrict state,			\
+				   register const char* restrict message, register size_t len)	\
+  {												\
+    libkeccak_absorb1600(state, message, len, COMPLEMENT);					\
+  }
+
+LIBKECCAK_KERNEL1600(generic, , 0)
+LIBKECCAK_KERNEL1600(complement, , 1)
+#ifdef LIBKECCAK_HAVE_X86_KERNELS
+LIBKECCAK_KERNEL1600(bmi2, __attribute__((target("bmi,bmi2"))), 0)
+LIBKECCAK_KERNEL1600(avx2, __attribute__((target("avx2,bmi,bmi2"))), 0)
+#endif
+
+#undef LIBKECCAK_KERNEL1600
+
+
+/**
+ * Perform the absorption phase using the
+ * kernel selected for the state
+ * 
+ * @param  state    The hashing state
+ * @param  message  The message to absorb, normally `state->M`
+ * @param  len      The number of bytes from `message` to absorb
+ */
+static inline __attribute__((nonnull, nothrow, gnu_inline))
+void libkeccak_absorption_phase(register libkeccak_state_t* restrict state,
+				register const char* restrict message, register size_t len)
+{
+  state->absorb(state, message, len);
+}
+
+
+/**
+ * Get the kernels a CPU supports
+ * 
+ * @return  Bitwise OR of `1 << LIBKECCAK_KERNEL_*` for each supported kernel
+ */
+static __attribute__((nothrow, warn_unused_result))
+int libkeccak_supported_kernels(void)
+{
+  /* Every state initialisation gets here, from any thread, but
+   * all threads store the same value, so relaxed atomics suffice. */
+  static int supported = 0;
+  int ret = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+  if (ret)
+    return ret;
+  ret = (1 << LIBKECCAK_KERNEL_GENERIC) | (1 << LIBKECCAK_KERNEL_COMPLEMENT);
+#ifdef LIBKECCAK_HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2"))
+    {
+      ret |= 1 << LIBKECCAK_KERNEL_BMI2;
+      if (__builtin_cpu_supports("avx2"))
+	ret |= 1 << LIBKECCAK_KERNEL_AVX2;
+    }
+#endif
+  __atomic_store_n(&supported, ret, __ATOMIC_RELAXED);
+  return ret;
+}
+
+
+/**
+ * Select the permutation and absorption kernels for a state
+ * 
+ * @param   state   The hashing state, must have its parameters set
+ * @param   kernel  `LIBKECCAK_KERNEL_AUTO` for the fastest kernel
+ *                  the CPU supports, or one of the other
+ *                  `LIBKECCAK_KERNEL_*` constants
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_state_set_kernel(libkeccak_state_t* restrict state, int kernel)
+{
+  int supported = libkeccak_supported_kernels();
+  
+  if (kernel == LIBKECCAK_KERNEL_AUTO)
+    {
+      kernel = LIBKECCAK_KERNEL_GENERIC;
+      if (state->w == 64)
+	{
+	  kernel = LIBKECCAK_KERNEL_COMPLEMENT;
+	  if (supported & (1 << LIBKECCAK_KERNEL_BMI2))  kernel = LIBKECCAK_KERNEL_BMI2;
+	  if (supported & (1 << LIBKECCAK_KERNEL_AVX2))  kernel = LIBKECCAK_KERNEL_AVX2;
+	}
+    }
+  else if ((kernel < 0) || (kernel > LIBKECCAK_KERNEL_MAX))
+    return errno = EINVAL, -1;
+  else if (!(supported & (1 << kernel)))
+    return errno = ENOTSUP, -1;
+  
+  if ((state->nr < 1) || (state->nr > 12 + (state->l << 1)))
+    return errno = EINVAL, -1;
+  if ((state->w == 64) && (state->nr & 1))
+    return errno = EINVAL, -1;
+  
+  if (state->w != 64)
+    {
+      if (kernel != LIBKECCAK_KERNEL_GENERIC)
+	return errno = EINVAL, -1;
+      state->permute = libkeccak_f_generic;
+      state->absorb  = libkeccak_absorb_generic;
+      return 0;
+    }
+  
+  switch (kernel)
+    {
+#ifdef LIBKECCAK_HAVE_X86_KERNELS
+    case LIBKECCAK_KERNEL_BMI2:
+      state->permute = libkeccak_f1600_bmi2;
+      state->absorb  = libkeccak_absorb1600_bmi2;
+      break;
+    case LIBKECCAK_KERNEL_AVX2:
+      state->permute = libkeccak_f1600_avx2;
+      state->absorb  = libkeccak_absorb1600_avx2;
+      break;
+#endif
+    case LIBKECCAK_KERNEL_COMPLEMENT:
+      state->permute = libkeccak_f1600_complement;
+      state->absorb  = libkeccak_absorb1600_complement;
+      break;
+    default:
+      state->permute = libkeccak_f1600_generic;
+      state->absorb  = libkeccak_absorb1600_generic;
+      break;
+    }
+  return 0;
 }
 
 
@@ -343,7 +813,13 @@ void libkeccak_squeezing_phase(register libkeccak_state_t* restrict state, long
   register long k;
   while (olen > 0)
     {
-      for (i = 0; (i < ni) && (j < nn); i++)
+      i = 0;
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+      if (ww == 8)
+	for (; (i < ni) && (j + 8 <= nn); i++, j += 8, hashsum += 8)
+	  __builtin_memcpy(hashsum, state->S + LANE_TRANSPOSE_MAP[i], 8);
+#endif
+      for (; (i < ni) && (j < nn); i++)
 	{
 	  v = state->S[LANE_TRANSPOSE_MAP[i]];
 	  for (k = 0; (k++ < ww) && (j++ < nn); v >>= 8)
@@ -357,6 +833,49 @@ void libkeccak_squeezing_phase(register libkeccak_state_t* restrict state, long
 }
 
 
+/**
+ * Absorb more of the message to the Keccak sponge
+ * 
+ * Whole blocks are absorbed directly from `msg`, only
+ * the incomplete block at the end is stored in `state->M`,
+ * which therefore never needs to grow
+ * 
+ * @param  state   The hashing state
+ * @param  msg     The partial message
+ * @param  msglen  The length of the partial message
+ * @param  wipe    Whether sensitive data shall be wiped when possible
+ */
+static inline __attribute__((nonnull, nothrow, always_inline))
+void libkeccak_absorb_message(libkeccak_state_t* restrict state, const char* restrict msg,
+			      size_t msglen, int wipe)
+{
+  register size_t rr = (size_t)(state->r >> 3);
+  register size_t len;
+  
+  if (state->mptr)
+    {
+      len = rr - state->mptr % rr;
+      if (len > msglen)
+	len = msglen;
+      __builtin_memcpy(state->M + state->mptr, msg, len * sizeof(char));
+      state->mptr += len;
+      msg += len;
+      msglen -= len;
+      if (state->mptr % rr)
+	return;
+      libkeccak_absorption_phase(state, state->M, state->mptr);
+      if (wipe)
+	libkeccak_state_wipe_message(state);
+      state->mptr = 0;
+    }
+  
+  len = msglen - msglen % rr;
+  libkeccak_absorption_phase(state, msg, len);
+  state->mptr = msglen - len;
+  __builtin_memcpy(state->M, msg + len, state->mptr * sizeof(char));
+}
+
+
 /**
  * Absorb more of the message to the Keccak sponge
  * without wiping sensitive data when possible
@@ -368,27 +887,7 @@ void libkeccak_squeezing_phase(register libkeccak_state_t* restrict state, long
  */
 int libkeccak_fast_update(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen)
 {
-  size_t len;
-  auto char* restrict new;
-  
-  if (__builtin_expect(state->mptr + msglen > state->mlen, 0))
-    {
-      state->mlen += msglen;
-      new = realloc(state->M, state->mlen * sizeof(char));
-      if (new == NULL)
-	return state->mlen -= msglen, -1;
-      state->M = new;
-    }
-  
-  __builtin_memcpy(state->M + state->mptr, msg, msglen * sizeof(char));
-  state->mptr += msglen;
-  len = state->mptr;
-  len -= state->mptr % (size_t)((state->r * state->b) >> 3);
-  state->mptr -= len;
-  
-  libkeccak_absorption_phase(state, len);
-  __builtin_memmove(state->M, state->M + len, state->mptr * sizeof(char));
-  
+  libkeccak_absorb_message(state, msg, msglen, 0);
   return 0;
 }
 
@@ -404,53 +903,51 @@ int libkeccak_fast_update(libkeccak_state_t* restrict state, const char* restric
  */
 int libkeccak_update(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen)
 {
-  size_t len;
-  auto char* restrict new;
-  
-  if (__builtin_expect(state->mptr + msglen > state->mlen, 0))
-    {
-      state->mlen += msglen;
-      new = malloc(state->mlen * sizeof(char));
-      if (new == NULL)
-	return state->mlen -= msglen, -1;
-      libkeccak_state_wipe_message(state);
-      free(state->M);
-      state->M = new;
-    }
-  
-  __builtin_memcpy(state->M + state->mptr, msg, msglen * sizeof(char));
-  state->mptr += msglen;
-  len = state->mptr;
-  len -= state->mptr % (size_t)((state->r * state->b) >> 3);
-  state->mptr -= len;
-  
-  libkeccak_absorption_phase(state, len);
-  __builtin_memmove(state->M, state->M + len, state->mptr * sizeof(char));
-  
+  libkeccak_absorb_message(state, msg, msglen, 1);
   return 0;
 }
 
 
 /**
- * Absorb the last part of the message and squeeze the Keccak sponge
- * without wiping sensitive data when possible
+ * Absorb the padded message in the state's message
+ * buffer and squeeze the Keccak sponge
  * 
- * @param   state    The hashing state
- * @param   msg      The rest of the message, may be `NULL`
- * @param   msglen   The length of the partial message
- * @param   bits     The number of bits at the end of the message not covered by `msglen`
- * @param   suffix   The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
- * @param   hashsum  Output parameter for the hashsum, may be `NULL`
- * @return           Zero on success, -1 on error
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the hashsum, may be `NULL`
  */
-int libkeccak_fast_digest(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
-			  size_t bits, const char* restrict suffix, char* restrict hashsum)
+static __attribute__((nonnull(1), nothrow))
+void libkeccak_absorb_and_squeeze(register libkeccak_state_t* restrict state, char* restrict hashsum)
+{
+  register long i;
+  libkeccak_absorption_phase(state, state->M, state->mptr);
+  if (hashsum != NULL)
+    libkeccak_squeezing_phase(state, state->r >> 3, (state->n + 7) >> 3, state->w >> 3, hashsum);
+  else
+    for (i = (state->n - 1) / state->r; i--;)
+      libkeccak_f(state);
+}
+
+
+/**
+ * Append the last part of the message, the suffix and the
+ * padding to the state's message buffer
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @param   wipe    Whether sensitive data shall be wiped when possible
+ * @return          Zero on success, -1 on error
+ */
+static __attribute__((nonnull(1)))
+int libkeccak_pad(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+		  size_t bits, const char* restrict suffix, int wipe)
 {
   auto char* restrict new;
   register long rr = state->r >> 3;
   auto size_t suffix_len = suffix ? __builtin_strlen(suffix) : 0;
   register size_t ext;
-  register long i;
   
   if (msg == NULL)
     msglen = bits = 0;
@@ -458,12 +955,34 @@ int libkeccak_fast_digest(libkeccak_state_t* restrict state, const char* restric
     msglen += bits >> 3, bits &= 7;
   
   ext = msglen + ((bits + suffix_len + 7) >> 3) + (size_t)rr;
+  if (__builtin_expect(state->mptr + ext > state->mlen, 0) && state->embedded)
+    {
+      /* The buffer cannot grow, but it has room for the padding
+       * if the whole blocks are absorbed directly from `msg`. */
+      if (msglen)
+	libkeccak_absorb_message(state, msg, msglen, wipe);
+      msg += msglen, ext -= msglen, msglen = 0;
+      if (state->mptr + ext > state->mlen)
+	return errno = ENOBUFS, -1;
+    }
   if (__builtin_expect(state->mptr + ext > state->mlen, 0))
     {
       state->mlen += ext;
-      new = realloc(state->M, state->mlen * sizeof(char));
-      if (new == NULL)
-	return state->mlen -= ext, -1;
+      if (wipe)
+	{
+	  new = malloc(state->mlen * sizeof(char));
+	  if (new == NULL)
+	    return state->mlen -= ext, -1;
+	  __builtin_memcpy(new, state->M, state->mptr * sizeof(char));
+	  libkeccak_state_wipe_message(state);
+	  free(state->M);
+	}
+      else
+	{
+	  new = realloc(state->M, state->mlen * sizeof(char));
+	  if (new == NULL)
+	    return state->mlen -= ext, -1;
+	}
       state->M = new;
     }
   
@@ -488,21 +1007,13 @@ int libkeccak_fast_digest(libkeccak_state_t* restrict state, const char* restric
     state->mptr++;
   
   libkeccak_pad10star1(state, bits);
-  libkeccak_absorption_phase(state, state->mptr);
-  
-  if (hashsum != NULL)
-    libkeccak_squeezing_phase(state, rr, (state->n + 7) >> 3, state->w >> 3, hashsum);
-  else
-    for (i = (state->n - 1) / state->r; i--;)
-      libkeccak_f(state);
-  
   return 0;
 }
 
 
 /**
  * Absorb the last part of the message and squeeze the Keccak sponge
- * and wipe sensitive data when possible
+ * without wiping sensitive data when possible
  * 
  * @param   state    The hashing state
  * @param   msg      The rest of the message, may be `NULL`
@@ -512,65 +1023,500 @@ int libkeccak_fast_digest(libkeccak_state_t* restrict state, const char* restric
  * @param   hashsum  Output parameter for the hashsum, may be `NULL`
  * @return           Zero on success, -1 on error
  */
-int libkeccak_digest(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
-		     size_t bits, const char* restrict suffix, char* restrict hashsum)
+int libkeccak_fast_digest(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			  size_t bits, const char* restrict suffix, char* restrict hashsum)
 {
-  auto char* restrict new;
-  register long rr = state->r >> 3;
-  auto size_t suffix_len = suffix ? __builtin_strlen(suffix) : 0;
-  register size_t ext;
-  register long i;
+  if (msg != NULL)
+    {
+      msglen += bits >> 3, bits &= 7;
+      libkeccak_absorb_message(state, msg, msglen, 0);
+      msg += msglen;
+    }
+  if (libkeccak_pad(state, msg, 0, bits, suffix, 0) < 0)
+    return -1;
+  libkeccak_absorb_and_squeeze(state, hashsum);
+  return 0;
+}
+
+
+/**
+ * Check whether four states can be processed in lock-step
+ * 
+ * @param   states  The four hashing states
+ * @return          Whether the states use the same Keccak-f[1600]
+ *                  based specifications and are distinct
+ */
+static __attribute__((nonnull, nothrow, pure, warn_unused_result))
+int libkeccak_compatible_x4(libkeccak_state_t* restrict const* states)
+{
+  int i, j;
+  for (i = 0; i < 4; i++)
+    {
+      if ((states[i]->w != 64) || (states[i]->nr != states[0]->nr))
+	return 0;
+      if ((states[i]->r != states[0]->r) || (states[i]->n != states[0]->n))
+	return 0;
+      for (j = 0; j < i; j++)
+	if (states[i] == states[j])
+	  return 0;
+    }
+  return 1;
+}
+
+
+#ifdef LIBKECCAK_HAVE_AVX2
+
+/**
+ * Output the part of the hashsum that is available
+ * in the rate of the state without permuting it
+ * 
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  j        The number of bytes already written to `hashsum`
+ * @param  nn       The output size in bytes, rounded up to whole bytes
+ */
+static inline __attribute__((nonnull, nothrow))
+void libkeccak_squeeze_block64(const libkeccak_state_t* restrict state, char* restrict hashsum, long j, long nn)
+{
+  register int_fast64_t v;
+  register long ni = state->r >> 6;
+  long i = 0, k;
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  for (; (i < ni) && (j + 8 <= nn); i++, j += 8)
+    __builtin_memcpy(hashsum + j, state->S + LANE_TRANSPOSE_MAP[i], 8);
+#endif
+  for (; (i < ni) && (j < nn); i++)
+    {
+      v = state->S[LANE_TRANSPOSE_MAP[i]];
+      for (k = 0; (k++ < 8) && (j < nn); v >>= 8)
+	hashsum[j++] = (char)v;
+    }
+}
+
+
+/**
+ * Absorb the padded messages in four compatible states
+ * in lock-step, and squeeze them in lock-step
+ * 
+ * @param  states    The four hashing states
+ * @param  hashsums  Output parameters for the hashsums, the elements may be `NULL`
+ */
+static __attribute__((nonnull, nothrow, target("avx2")))
+void libkeccak_absorb_and_squeeze_x4(libkeccak_state_t* restrict const* states, char* restrict const* hashsums)
+{
+  __m256i A[25];
+  const char* restrict message[4];
+  size_t len[4];
+  register long rr = states[0]->r >> 3;
+  register long nn = (states[0]->n + 7) >> 3;
+  register long bs = (states[0]->r >> 6) * 8;
+  long olen = states[0]->n, j = 0, n, i, off;
+  int lane, reload = 0;
   
-  if (msg == NULL)
-    msglen = bits = 0;
-  else
-    msglen += bits >> 3, bits &= 7;
+  n = (long)(states[0]->mptr) / rr;
+  for (lane = 0; lane < 4; lane++)
+    {
+      message[lane] = states[lane]->M;
+      len[lane] = states[lane]->mptr;
+      if ((long)(len[lane]) / rr < n)
+	n = (long)(len[lane]) / rr;
+    }
   
-  ext = msglen + ((bits + suffix_len + 7) >> 3) + (size_t)rr;
-  if (__builtin_expect(state->mptr + ext > state->mlen, 0))
+  libkeccak_load_x4(A, states);
+  while (n--)
     {
-      state->mlen += ext;
-      new = malloc(state->mlen * sizeof(char));
-      if (new == NULL)
-	return state->mlen -= ext, -1;
-      libkeccak_state_wipe_message(state);
-      free(state->M);
-      state->M = new;
+      for (i = 0; i < 25; i++)
+	{
+	  off = LANE_TRANSPOSE_MAP[i] * 8;
+	  if (off >= rr)
+	    continue;
+	  A[i] = _mm256_xor_si256(A[i], _mm256_set_epi64x(libkeccak_block_lane64(message[3], rr, (size_t)off),
+							  libkeccak_block_lane64(message[2], rr, (size_t)off),
+							  libkeccak_block_lane64(message[1], rr, (size_t)off),
+							  libkeccak_block_lane64(message[0], rr, (size_t)off)));
+	}
+      libkeccak_f_x4(A, states[0]->nr);
+      for (lane = 0; lane < 4; lane++)
+	message[lane] += (size_t)rr, len[lane] -= (size_t)rr;
     }
+  libkeccak_store_x4(states, A);
   
-  if (msglen)
-    __builtin_memcpy(state->M + state->mptr, msg, msglen * sizeof(char));
-  state->mptr += msglen;
+  /* Messages that are longer than the others are finished alone. */
+  for (lane = 0; lane < 4; lane++)
+    if (len[lane])
+      libkeccak_absorption_phase(states[lane], message[lane], len[lane]), reload = 1;
+  if (reload)
+    libkeccak_load_x4(A, states);
   
-  if (bits)
-    state->M[state->mptr] = msg[msglen] & (char)((1 << bits) - 1);
-  if (__builtin_expect(!!suffix_len, 1))
+  for (;;)
     {
-      if (bits == 0)
-	state->M[state->mptr] = 0;
-      while (suffix_len--)
+      for (lane = 0; lane < 4; lane++)
+	if (hashsums[lane] != NULL)
+	  libkeccak_squeeze_block64(states[lane], hashsums[lane], j, nn);
+      j += bs < nn - j ? bs : nn - j;
+      if (olen -= states[0]->r, olen <= 0)
+	break;
+      libkeccak_f_x4(A, states[0]->nr);
+      libkeccak_store_x4(states, A);
+    }
+  
+  if (states[0]->n & 7)
+    for (lane = 0; lane < 4; lane++)
+      if (hashsums[lane] != NULL)
+	hashsums[lane][nn - 1] &= (char)((1 << (states[0]->n & 7)) - 1);
+}
+
+#endif
+
+
+/**
+ * Absorb the last part of four independent messages and
+ * squeeze the four Keccak sponges, in lock-step when possible,
+ * without wiping sensitive data when possible
+ * 
+ * @param   states    The four hashing states, must be distinct
+ * @param   msgs      The rest of the four messages, the elements may be `NULL`
+ * @param   msglens   The lengths of the partial messages
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the hashsums, the elements may be `NULL`
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_fast_digest_x4(libkeccak_state_t* restrict const* states, const char* restrict const* msgs,
+			     const size_t* restrict msglens, const char* restrict suffix,
+			     char* restrict const* hashsums)
+{
+  int i;
+  
+  for (i = 0; i < 4; i++)
+    if (libkeccak_pad(states[i], msgs[i], msglens[i], 0, suffix, 0) < 0)
+      return -1;
+  
+#ifdef LIBKECCAK_HAVE_AVX2
+  if (libkeccak_compatible_x4(states) && (libkeccak_supported_kernels() & (1 << LIBKECCAK_KERNEL_AVX2)))
+    return libkeccak_absorb_and_squeeze_x4(states, hashsums), 0;
+#endif
+  
+  for (i = 0; i < 4; i++)
+    libkeccak_absorb_and_squeeze(states[i], hashsums[i]);
+  return 0;
+}
+
+
+/**
+ * Write the beginning of the rate of a Keccak-f[1600] state
+ * 
+ * @param  S        The lanes of the state
+ * @param  hashsum  Output parameter for the bytes
+ * @param  hashlen  The number of bytes to write, at most the rate in bytes
+ */
+static inline __attribute__((nonnull, nothrow))
+void libkeccak_squeeze_lanes64(const int64_t* restrict S, char* restrict hashsum, size_t hashlen)
+{
+  int_fast64_t v;
+  size_t i, j = 0;
+  for (i = 0; j < hashlen; i++)
+    {
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+      if (j + 8 <= hashlen)
 	{
-	  state->M[state->mptr] |= (char)((*suffix++ & 1) << bits++);
-	  if (bits == 8)
-	    bits = 0, state->M[++(state->mptr)] = 0;
+	  __builtin_memcpy(hashsum + j, S + LANE_TRANSPOSE_MAP[i], 8);
+	  j += 8;
+	  continue;
 	}
+#endif
+      for (v = S[LANE_TRANSPOSE_MAP[i]]; (j < hashlen) && (j < (i + 1) * 8); v >>= 8)
+	hashsum[j++] = (char)v;
     }
-  if (bits)
-    state->mptr++;
+}
+
+
+/**
+ * Build the last, padded, block of a message consisting of whole bytes
+ * 
+ * @param  block   Output parameter for the block, `rr` bytes
+ * @param  rr      The rate in bytes
+ * @param  msg     The part of the message not absorbed, shorter than `rr`
+ * @param  msglen  The length of `msg`
+ * @param  pad     The suffix and the first bit of the padding,
+ *                 as the byte they form at the end of the message
+ */
+static inline __attribute__((nonnull(1), nothrow))
+void libkeccak_last_block(char* restrict block, size_t rr, const char* restrict msg, size_t msglen, char pad)
+{
+  if (msglen)
+    __builtin_memcpy(block, msg, msglen);
+  block[msglen] = pad;
+  __builtin_memset(block + msglen + 1, 0, rr - msglen - 1);
+  block[rr - 1] |= (char)0x80;
+}
+
+
+/**
+ * Calculate a Keccak-p[1600, nr] based sponge hash of a
+ * message consisting of whole bytes without a heap
+ * allocated state
+ * 
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  hashlen  The size of the hashsum in bytes, at most `r / 8`
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ * @param  r        The bitrate, a multiple of 64
+ * @param  nr       The number of rounds, a positive even number at most 24
+ * @param  pad      The suffix and the first bit of the padding,
+ *                  as the byte they form at the end of the message
+ */
+void libkeccak_oneshot(char* restrict hashsum, size_t hashlen, const char* restrict msg, size_t msglen,
+		       long r, long nr, char pad)
+{
+  libkeccak_state_t state;
+  char block[1600 / 8];
+  size_t rr = (size_t)(r >> 3);
+  size_t len = msglen - msglen % rr;
   
-  libkeccak_pad10star1(state, bits);
-  libkeccak_absorption_phase(state, state->mptr);
+  /* Only the sponge, the rate and the number of
+   * rounds are used by the absorption kernels. */
+  state.r = r;
+  state.w = 64;
+  state.l = 6;
+  state.nr = nr;
+  libkeccak_state_set_kernel(&state, LIBKECCAK_KERNEL_AUTO);
+  __builtin_memset(state.S, 0, sizeof(state.S));
   
-  if (hashsum != NULL)
-    libkeccak_squeezing_phase(state, rr, (state->n + 7) >> 3, state->w >> 3, hashsum);
-  else
-    for (i = (state->n - 1) / state->r; i--;)
-      libkeccak_f(state);
+  if (len)
+    state.absorb(&state, msg, len);
+  
+  /* The last block, this is the only block for
+   * messages shorter than the rate. */
+  libkeccak_last_block(block, rr, msg + len, msglen - len, pad);
+  state.absorb(&state, block, rr);
   
+  libkeccak_squeeze_lanes64(state.S, hashsum, hashlen);
+}
+
+
+#ifdef LIBKECCAK_HAVE_AVX2
+
+/**
+ * Calculate four Keccak-p[1600, nr] based sponge hashes
+ * of equally long messages in lock-step
+ * 
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  hashlen   The size of each hashsum in bytes, at most `r / 8`
+ * @param  msgs      The messages
+ * @param  msglen    The length of each message
+ * @param  r         The bitrate, a multiple of 64
+ * @param  nr        The number of rounds, at most 24
+ * @param  pad       The suffix and the first bit of the padding,
+ *                   as the byte they form at the end of the messages
+ */
+static __attribute__((nonnull, nothrow, hot, target("avx2")))
+void libkeccak_oneshot_avx2_x4(char* restrict const* hashsums, size_t hashlen, const char* restrict const* msgs,
+			       size_t msglen, long r, long nr, char pad)
+{
+  __m256i A[25];
+  int64_t S[4][25];
+  char blocks[4][1600 / 8];
+  const char* restrict message[4];
+  long rr = r >> 3, n = (long)(msglen / (size_t)rr), i, off;
+  int lane;
+  
+  for (i = 0; i < 25; i++)
+    A[i] = _mm256_setzero_si256();
+  for (lane = 0; lane < 4; lane++)
+    message[lane] = msgs[lane];
+  
+  for (n++; n--;)
+    {
+      if (n == 0)
+	for (lane = 0; lane < 4; lane++)
+	  {
+	    libkeccak_last_block(blocks[lane], (size_t)rr, message[lane], msglen % (size_t)rr, pad);
+	    message[lane] = blocks[lane];
+	  }
+      for (i = 0; i < 25; i++)
+	{
+	  off = LANE_TRANSPOSE_MAP[i] * 8;
+	  if (off >= rr)
+	    continue;
+	  A[i] = _mm256_xor_si256(A[i], _mm256_set_epi64x(libkeccak_block_lane64(message[3], rr, (size_t)off),
+							  libkeccak_block_lane64(message[2], rr, (size_t)off),
+							  libkeccak_block_lane64(message[1], rr, (size_t)off),
+							  libkeccak_block_lane64(message[0], rr, (size_t)off)));
+	}
+      libkeccak_f_x4(A, nr);
+      for (lane = 0; lane < 4; lane++)
+	message[lane] += (size_t)rr;
+    }
+  
+  for (i = 0; i < 25; i++)
+    {
+      int64_t lanes[4];
+      _mm256_storeu_si256((__m256i*)(void*)lanes, A[i]);
+      for (lane = 0; lane < 4; lane++)
+	S[lane][i] = lanes[lane];
+    }
+  for (lane = 0; lane < 4; lane++)
+    libkeccak_squeeze_lanes64(S[lane], hashsums[lane], hashlen);
+}
+
+#endif
+
+
+/**
+ * Calculate four Keccak-p[1600, nr] based sponge hashes of equally
+ * long messages consisting of whole bytes, in lock-step when possible,
+ * without heap allocated states
+ * 
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  hashlen   The size of each hashsum in bytes, at most `r / 8`
+ * @param  msgs      The messages
+ * @param  msglen    The length of each message
+ * @param  r         The bitrate, a multiple of 64
+ * @param  nr        The number of rounds, a positive even number at most 24
+ * @param  pad       The suffix and the first bit of the padding,
+ *                   as the byte they form at the end of the messages
+ */
+void libkeccak_oneshot_x4(char* restrict const* hashsums, size_t hashlen, const char* restrict const* msgs,
+			  size_t msglen, long r, long nr, char pad)
+{
+  int i;
+#ifdef LIBKECCAK_HAVE_AVX2
+  if (libkeccak_supported_kernels() & (1 << LIBKECCAK_KERNEL_AVX2))
+    {
+      libkeccak_oneshot_avx2_x4(hashsums, hashlen, msgs, msglen, r, nr, pad);
+      return;
+    }
+#endif
+  for (i = 0; i < 4; i++)
+    libkeccak_oneshot(hashsums[i], hashlen, msgs[i], msglen, r, nr, pad);
+}
+
+
+/**
+ * Calculate the Keccak[r = 1088, c = 512, n = 256] hash of a message,
+ * as used by Ethereum, without allocating a state
+ * 
+ * @param  hashsum  Output parameter for the hashsum, 32 bytes
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ */
+void libkeccak_keccak256(char* restrict hashsum, const char* restrict msg, size_t msglen)
+{
+  libkeccak_oneshot(hashsum, 32, msg, msglen, 1088, 24, 0x01);
+}
+
+
+/**
+ * Calculate the SHA3-256 hash of a message without allocating a state
+ * 
+ * @param  hashsum  Output parameter for the hashsum, 32 bytes
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ */
+void libkeccak_sha3_256(char* restrict hashsum, const char* restrict msg, size_t msglen)
+{
+  libkeccak_oneshot(hashsum, 32, msg, msglen, 1088, 24, 0x06);
+}
+
+
+/**
+ * Absorb the last part of the message and squeeze the Keccak sponge
+ * and wipe sensitive data when possible
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message
+ * @param   bits     The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix   The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @param   hashsum  Output parameter for the hashsum, may be `NULL`
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_digest(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+		     size_t bits, const char* restrict suffix, char* restrict hashsum)
+{
+  if (msg != NULL)
+    {
+      msglen += bits >> 3, bits &= 7;
+      libkeccak_absorb_message(state, msg, msglen, 1);
+      msg += msglen;
+    }
+  if (libkeccak_pad(state, msg, 0, bits, suffix, 1) < 0)
+    return -1;
+  libkeccak_absorb_and_squeeze(state, hashsum);
+  return 0;
+}
+
+
+/**
+ * Absorb the last part of the message and prepare the Keccak sponge
+ * for squeezing output of any length with `libkeccak_squeeze_bytes`
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @param   wipe    Whether sensitive data shall be wiped when possible
+ * @return          Zero on success, -1 on error
+ */
+static __attribute__((nonnull(1)))
+int libkeccak_pad_and_absorb(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			     size_t bits, const char* restrict suffix, int wipe)
+{
+  if (msg != NULL)
+    {
+      msglen += bits >> 3, bits &= 7;
+      libkeccak_absorb_message(state, msg, msglen, wipe);
+      msg += msglen;
+    }
+  if (libkeccak_pad(state, msg, 0, bits, suffix, wipe) < 0)
+    return -1;
+  libkeccak_absorption_phase(state, state->M, state->mptr);
+  if (wipe)
+    libkeccak_state_wipe_message(state);
+  state->mptr = 0;
   return 0;
 }
 
 
+/**
+ * Absorb the last part of the message and prepare the Keccak sponge
+ * for squeezing output of any length with `libkeccak_squeeze_bytes`
+ * without wiping sensitive data when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_fast_digest_xof(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			      size_t bits, const char* restrict suffix)
+{
+  return libkeccak_pad_and_absorb(state, msg, msglen, bits, suffix, 0);
+}
+
+
+/**
+ * Absorb the last part of the message and prepare the Keccak sponge
+ * for squeezing output of any length with `libkeccak_squeeze_bytes`
+ * and wipe sensitive data when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_digest_xof(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			 size_t bits, const char* restrict suffix)
+{
+  return libkeccak_pad_and_absorb(state, msg, msglen, bits, suffix, 1);
+}
+
+
 /**
  * Force some rounds of Keccak-f
  * 
@@ -610,3 +1556,39 @@ void libkeccak_squeeze(register libkeccak_state_t* restrict state, register char
   libkeccak_squeezing_phase(state, state->r >> 3, (state->n + 7) >> 3, state->w >> 3, hashsum);
 }
 
+
+/**
+ * Squeeze out the next bytes of the output, continuing
+ * where the previous call to this function stopped
+ * 
+ * Like `libkeccak_squeezing_phase`, only the whole lanes
+ * of the rate are output from each block
+ * 
+ * @param  state   The hashing state, prepared with `libkeccak_fast_digest_xof`
+ *                 or `libkeccak_digest_xof`, `state->mptr` is the number of
+ *                 bytes of the current block that have been squeezed out
+ * @param  output  Output buffer for the bytes
+ * @param  len     The number of bytes to squeeze out
+ */
+void libkeccak_squeeze_bytes(register libkeccak_state_t* restrict state, register char* restrict output, size_t len)
+{
+  register size_t ww = (size_t)(state->w >> 3);
+  register size_t rr = (size_t)(state->r >> 3) / ww * ww;
+  register size_t off;
+  
+  while (len)
+    {
+      if (state->mptr >= rr)
+	libkeccak_f(state), state->mptr = 0;
+      off = state->mptr;
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+      if ((ww == 8) && !(off & 7))
+	for (; (off + 8 <= rr) && (len >= 8); off += 8, output += 8, len -= 8)
+	  __builtin_memcpy(output, state->S + LANE_TRANSPOSE_MAP[off >> 3], 8);
+#endif
+      for (; (off < rr) && len; off++, len--)
+	*output++ = (char)(state->S[LANE_TRANSPOSE_MAP[off / ww]] >> ((off % ww) << 3));
+      state->mptr = off;
+    }
+}
+
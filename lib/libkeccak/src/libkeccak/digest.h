@@ -84,6 +84,92 @@ int libkeccak_digest(libkeccak_state_t* restrict state, const char* restrict msg
 		     size_t bits, const char* restrict suffix, char* restrict hashsum);
 
 
+/**
+ * Absorb the last part of the message and prepare the Keccak sponge
+ * for squeezing output of any length with `libkeccak_squeeze_bytes`
+ * without wiping sensitive data when possible
+ * 
+ * This is an alternative to `libkeccak_fast_digest` for extendable-output
+ * functions, the output size in the state's specifications is ignored
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @return          Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_fast_digest_xof(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			      size_t bits, const char* restrict suffix);
+
+
+/**
+ * Absorb the last part of the message and prepare the Keccak sponge
+ * for squeezing output of any length with `libkeccak_squeeze_bytes`
+ * and wipe sensitive data when possible
+ * 
+ * This is an alternative to `libkeccak_digest` for extendable-output
+ * functions, the output size in the state's specifications is ignored
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The rest of the message, may be `NULL`
+ * @param   msglen  The length of the partial message
+ * @param   bits    The number of bits at the end of the message not covered by `msglen`
+ * @param   suffix  The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @return          Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_digest_xof(libkeccak_state_t* restrict state, const char* restrict msg, size_t msglen,
+			 size_t bits, const char* restrict suffix);
+
+
+/**
+ * Absorb the last part of four independent messages and
+ * squeeze the four Keccak sponges, in lock-step when possible,
+ * without wiping sensitive data when possible
+ * 
+ * The states are processed in lock-step if they are distinct, share the
+ * same bitrate and output size, use Keccak-f[1600], and the CPU supports
+ * AVX2; otherwise they are processed one by one. The hashsums are
+ * identical to those `libkeccak_fast_digest` would have produced.
+ * 
+ * @param   states    The four hashing states, must be distinct
+ * @param   msgs      The rest of the four messages, the elements may be `NULL`
+ * @param   msglens   The lengths of the partial messages
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the hashsums, the elements may be `NULL`
+ * @return            Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 2, 3, 5))))
+int libkeccak_fast_digest_x4(libkeccak_state_t* restrict const* states, const char* restrict const* msgs,
+			     const size_t* restrict msglens, const char* restrict suffix,
+			     char* restrict const* hashsums);
+
+
+/**
+ * Calculate the Keccak[r = 1088, c = 512, n = 256] hash of a message,
+ * as used by Ethereum, without allocating a state
+ * 
+ * @param  hashsum  Output parameter for the hashsum, 32 bytes
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow)))
+void libkeccak_keccak256(char* restrict hashsum, const char* restrict msg, size_t msglen);
+
+
+/**
+ * Calculate the SHA3-256 hash of a message without allocating a state
+ * 
+ * @param  hashsum  Output parameter for the hashsum, 32 bytes
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow)))
+void libkeccak_sha3_256(char* restrict hashsum, const char* restrict msg, size_t msglen);
+
+
 /**
  * Force some rounds of Keccak-f
  * 
@@ -114,5 +200,23 @@ LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow)))
 void libkeccak_squeeze(register libkeccak_state_t* restrict state, register char* restrict hashsum);
 
 
+
+/**
+ * Squeeze out the next bytes of the output, continuing where the
+ * previous call stopped, so that the output can be read in pieces
+ * of any size, and in constant memory, regardless of its length
+ * 
+ * The state must have been prepared with `libkeccak_fast_digest_xof`
+ * or `libkeccak_digest_xof`, and may not be passed to the other
+ * squeeze functions afterwards
+ * 
+ * @param  state   The hashing state
+ * @param  output  Output buffer for the bytes
+ * @param  len     The number of bytes to squeeze out
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow)))
+void libkeccak_squeeze_bytes(register libkeccak_state_t* restrict state, register char* restrict output, size_t len);
+
+
 #endif
 
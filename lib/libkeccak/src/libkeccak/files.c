@@ -16,15 +16,829 @@
  * You should have received a copy of the GNU Affero General Public License
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE  /* For O_DIRECT, F_SETPIPE_SZ and tee. */
+#endif
 #include "files.h"
 
+#include "private.h"
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
-#include <alloca.h>
 #include <errno.h>
 
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  if defined(IORING_FEAT_CUR_PERSONALITY) && defined(__NR_io_uring_setup)
+#   define LIBKECCAK_HAVE_IO_URING  1
+#  endif
+# endif
+#endif
+
+
+
+/**
+ * The number of bytes of a file that are mapped at a time
+ */
+#ifndef LIBKECCAK_MMAP_WINDOW
+# define LIBKECCAK_MMAP_WINDOW  ((size_t)64 << 20)
+#endif
+
+/**
+ * Regular files smaller than this are read rather than mapped
+ */
+#ifndef LIBKECCAK_MMAP_MIN
+# define LIBKECCAK_MMAP_MIN  ((size_t)256 << 10)
+#endif
+
+/**
+ * The smallest initial size, and the largest size, of the read buffer
+ */
+#ifndef LIBKECCAK_READ_MIN
+# define LIBKECCAK_READ_MIN  ((size_t)64 << 10)
+#endif
+#ifndef LIBKECCAK_READ_MAX
+# define LIBKECCAK_READ_MAX  ((size_t)1 << 20)
+#endif
+
+/**
+ * The size pipes are enlarged to, so that the writer
+ * can get further ahead, and reads return more data
+ */
+#ifndef LIBKECCAK_PIPE_SIZE
+# define LIBKECCAK_PIPE_SIZE  ((size_t)1 << 20)
+#endif
+
+/**
+ * The number of buffers, and the size of each buffer,
+ * in the ring `LIBKECCAK_SUM_FD_THREADED` reads into
+ */
+#ifndef LIBKECCAK_RING_BUFFERS
+# define LIBKECCAK_RING_BUFFERS  3
+#endif
+#ifndef LIBKECCAK_RING_BUFFER_SIZE
+# define LIBKECCAK_RING_BUFFER_SIZE  ((size_t)1 << 20)
+#endif
+
+/**
+ * The number of buffers, the size of each buffer, and their
+ * alignment, that `LIBKECCAK_SUM_FD_DIRECT` reads into
+ */
+#ifndef LIBKECCAK_DIRECT_BUFFERS
+# define LIBKECCAK_DIRECT_BUFFERS  4
+#endif
+#ifndef LIBKECCAK_DIRECT_BUFFER_SIZE
+# define LIBKECCAK_DIRECT_BUFFER_SIZE  ((size_t)4 << 20)
+#endif
+#ifndef LIBKECCAK_DIRECT_ALIGN
+# define LIBKECCAK_DIRECT_ALIGN  ((size_t)4096)
+#endif
+
+/**
+ * The number of files `libkeccak_sum_files` hashes at the same
+ * time, and the size of the read buffer for each of them
+ */
+#ifndef LIBKECCAK_BATCH_FILES
+# define LIBKECCAK_BATCH_FILES  32
+#endif
+#ifndef LIBKECCAK_BATCH_BUFFER_SIZE
+# define LIBKECCAK_BATCH_BUFFER_SIZE  ((size_t)128 << 10)
+#endif
+
+/**
+ * The phases of a file in `libkeccak_sum_files`
+ */
+#define SLOT_FREE     0
+#define SLOT_OPENING  1
+#define SLOT_READING  2
+#define SLOT_DONE     3
+
+
+
+/**
+ * A ring of buffers filled by a reader thread,
+ * and emptied by the hashing thread
+ */
+typedef struct libkeccak_ring
+{
+  /**
+   * Protects all other members, except `data` and `fd`
+   */
+  pthread_mutex_t mutex;
+  
+  /**
+   * Signalled when a buffer has been filled or emptied
+   */
+  pthread_cond_t cond;
+  
+  /**
+   * The buffers, one after the other
+   */
+  char* data;
+  
+  /**
+   * The number of bytes in each filled buffer
+   */
+  size_t lengths[LIBKECCAK_RING_BUFFERS];
+  
+  /**
+   * The number of buffers that have been filled
+   */
+  size_t filled;
+  
+  /**
+   * The number of buffers that have been emptied
+   */
+  size_t emptied;
+  
+  /**
+   * The file descriptor to read
+   */
+  int fd;
+  
+  /**
+   * `errno` for the failed read, zero if none failed
+   */
+  int error;
+  
+  /**
+   * Whether the reader thread has stopped
+   */
+  char done;
+  
+  char __pad[sizeof(void*) - 1];
+  
+} libkeccak_ring_t;
+
+
+/**
+ * A file being hashed by `libkeccak_sum_files`
+ */
+typedef struct libkeccak_sum_slot
+{
+  /**
+   * The hashing state
+   */
+  libkeccak_state_t state;
+  
+  /**
+   * The read buffer, `LIBKECCAK_BATCH_BUFFER_SIZE` bytes
+   */
+  char* buf;
+  
+  /**
+   * The file's index in the list of files
+   */
+  size_t index;
+  
+  /**
+   * The file descriptor, -1 if the file is not open
+   */
+  int fd;
+  
+  /**
+   * `errno` for the failure, zero if none failed
+   */
+  int error;
+  
+  /**
+   * `SLOT_FREE`, `SLOT_OPENING`, `SLOT_READING` or `SLOT_DONE`
+   */
+  char phase;
+  
+  char __pad[sizeof(void*) - 1];
+  
+} libkeccak_sum_slot_t;
+
+
+/**
+ * The files `libkeccak_sum_files` is hashing
+ */
+typedef struct libkeccak_sum_batch
+{
+  /**
+   * The files, file `i` uses slot `i % LIBKECCAK_BATCH_FILES`
+   */
+  libkeccak_sum_slot_t slots[LIBKECCAK_BATCH_FILES];
+  
+  /**
+   * The names of all files
+   */
+  const char* const* filenames;
+  
+  /**
+   * The index of the first file in the current
+   * group, when the thread pool is used
+   */
+  size_t first;
+  
+} libkeccak_sum_batch_t;
+
+
+
+#ifdef LIBKECCAK_HAVE_IO_URING
+
+/**
+ * An io_uring instance
+ */
+typedef struct libkeccak_uring
+{
+  /**
+   * The submission queue's head, tail, mask and index array
+   */
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  
+  /**
+   * The submission queue entries
+   */
+  struct io_uring_sqe* sqes;
+  
+  /**
+   * The completion queue's head, tail and mask
+   */
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  
+  /**
+   * The completion queue entries
+   */
+  struct io_uring_cqe* cqes;
+  
+  /**
+   * The mapped rings, and their sizes
+   */
+  void* sq_ring;
+  void* cq_ring;
+  size_t sq_ring_size;
+  size_t cq_ring_size;
+  size_t sqes_size;
+  
+  /**
+   * The number of entries that have been queued but not submitted
+   */
+  unsigned pending;
+  
+  /**
+   * The file descriptor of the instance
+   */
+  int fd;
+  
+} libkeccak_uring_t;
+
+
+/**
+ * Unmap and close an io_uring instance
+ * 
+ * @param  ring  The instance
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_uring_destroy(libkeccak_uring_t* restrict ring)
+{
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);
+}
+
+
+/**
+ * Create an io_uring instance, if the kernel supports
+ * opening and reading files with it
+ * 
+ * @param   ring     Output parameter for the instance
+ * @param   entries  The size of the submission queue
+ * @return           Zero on success, -1 if io_uring cannot be used
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_uring_create(libkeccak_uring_t* restrict ring, unsigned entries)
+{
+  struct io_uring_params p;
+  char probe_buf[sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)];
+  struct io_uring_probe* probe = (struct io_uring_probe*)(void*)probe_buf;
+  char* sq;
+  char* cq;
+  
+  memset(&p, 0, sizeof(p));
+  if (ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p), ring->fd < 0)
+    return -1;
+  
+  memset(probe_buf, 0, sizeof(probe_buf));
+  if ((syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) ||
+      (probe->last_op < IORING_OP_READ) ||
+      !(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+      !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED))
+    return close(ring->fd), -1;
+  
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (ring->cq_ring_size > ring->sq_ring_size)
+	ring->sq_ring_size = ring->cq_ring_size;
+      ring->cq_ring_size = ring->sq_ring_size;
+    }
+  
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED)
+    return close(ring->fd), -1;
+  ring->cq_ring = ring->sq_ring;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+      ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+      if (ring->cq_ring == MAP_FAILED)
+	return munmap(ring->sq_ring, ring->sq_ring_size), close(ring->fd), -1;
+    }
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    {
+      if (ring->cq_ring != ring->sq_ring)
+	munmap(ring->cq_ring, ring->cq_ring_size);
+      return munmap(ring->sq_ring, ring->sq_ring_size), close(ring->fd), -1;
+    }
+  
+  sq = ring->sq_ring, cq = ring->cq_ring;
+  ring->sq_head  = (unsigned*)(void*)(sq + p.sq_off.head);
+  ring->sq_tail  = (unsigned*)(void*)(sq + p.sq_off.tail);
+  ring->sq_mask  = (unsigned*)(void*)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(void*)(sq + p.sq_off.array);
+  ring->cq_head  = (unsigned*)(void*)(cq + p.cq_off.head);
+  ring->cq_tail  = (unsigned*)(void*)(cq + p.cq_off.tail);
+  ring->cq_mask  = (unsigned*)(void*)(cq + p.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe*)(void*)(cq + p.cq_off.cqes);
+  ring->pending = 0;
+  return 0;
+}
+
+
+/**
+ * Queue a submission, the submission queue must not be full
+ * 
+ * @param   ring  The io_uring instance
+ * @return        The entry to fill in, it is zeroed
+ */
+static __attribute__((nonnull, nothrow, returns_nonnull))
+struct io_uring_sqe* libkeccak_uring_queue(libkeccak_uring_t* restrict ring)
+{
+  unsigned tail = *ring->sq_tail, i = tail & *ring->sq_mask;
+  struct io_uring_sqe* sqe = ring->sqes + i;
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_array[i] = i;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending++;
+  return sqe;
+}
+
+#endif
+
+
+
+/**
+ * Hash a regular file directly from memory mappings of it,
+ * one window at a time
+ * 
+ * @param   fd      The file descriptor of the file to hash
+ * @param   state   The hashing state
+ * @param   offset  The position in the file to start at
+ * @param   end     The size of the file
+ * @return          The position in the file up to which the file
+ *                  has been hashed, `end` unless mapping failed
+ */
+static __attribute__((nonnull, nothrow))
+off_t libkeccak_sum_mapped(int fd, libkeccak_state_t* restrict state, off_t offset, off_t end)
+{
+  long pagesize = sysconf(_SC_PAGESIZE);
+  size_t skip, len;
+  off_t base;
+  char* map;
+  
+  if (pagesize <= 0)
+    return offset;
+  
+  while (offset < end)
+    {
+      /* The offset of a mapping must be page-aligned. */
+      skip = (size_t)(offset % (off_t)pagesize);
+      base = offset - (off_t)skip;
+      len = LIBKECCAK_MMAP_WINDOW;
+      if ((off_t)len > end - base)
+	len = (size_t)(end - base);
+      
+      map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, base);
+      if (map == MAP_FAILED)
+	break;
+      madvise(map, len, MADV_SEQUENTIAL);
+      
+      libkeccak_fast_update(state, map + skip, len - skip);
+      munmap(map, len);
+      offset = base + (off_t)len;
+    }
+  
+  return offset;
+}
+
+
+/**
+ * Enlarge a pipe to `LIBKECCAK_PIPE_SIZE` bytes, if it is smaller;
+ * this fails silently if the process is not allowed to do so
+ * 
+ * @param   fd  The file descriptor of the pipe
+ * @return      The size of the pipe, 0 if unknown
+ */
+static __attribute__((nothrow))
+size_t libkeccak_pipe_grow(int fd)
+{
+#ifdef F_SETPIPE_SZ
+  int size = fcntl(fd, F_GETPIPE_SZ), grown;
+  if ((size >= 0) && ((size_t)size < LIBKECCAK_PIPE_SIZE))
+    if (grown = fcntl(fd, F_SETPIPE_SZ, (int)LIBKECCAK_PIPE_SIZE), grown > 0)
+      size = grown;
+  return size < 0 ? 0 : (size_t)size;
+#else
+  (void) fd;
+  return 0;
+#endif
+}
+
+
+/**
+ * Hash the rest of a file with `read`, with a buffer
+ * that grows as long as the reads fill it
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   state    The hashing state
+ * @param   blksize  The file's preferred block size for reads
+ * @param   left     The maximum number of bytes to read, it is
+ *                   decreased by the number of bytes hashed
+ * @return           Zero on success, -1 on error
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_read(int fd, libkeccak_state_t* restrict state, size_t blksize, uint64_t* restrict left)
+{
+  size_t size = blksize;
+  ssize_t got;
+  char* chunk;
+  char* larger;
+  int saved_errno;
+  
+  if (size < LIBKECCAK_READ_MIN)
+    size = (LIBKECCAK_READ_MIN + blksize - 1) / blksize * blksize;
+  if (chunk = malloc(size), chunk == NULL)
+    return -1;
+  
+  while (*left)
+    {
+      got = read(fd, chunk, (uint64_t)size < *left ? size : (size_t)*left);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  goto fail;
+	}
+      if (got == 0)
+	break;
+      libkeccak_fast_update(state, chunk, (size_t)got);
+      *left -= (uint64_t)got;
+      
+      /* The data comes faster than the buffer can take it. The
+       * contents need not be kept, and a failure is not fatal. */
+      if (((size_t)got == size) && (size < LIBKECCAK_READ_MAX))
+	if (larger = malloc(size << 1), larger != NULL)
+	  free(chunk), chunk = larger, size <<= 1;
+    }
+  
+  free(chunk);
+  return 0;
+  
+ fail:
+  saved_errno = errno;
+  free(chunk);
+  errno = saved_errno;
+  return -1;
+}
+
+
+/**
+ * The main function of the reader thread for `libkeccak_sum_threaded`
+ * 
+ * @param   ring_  The ring, `libkeccak_ring_t*`
+ * @return         `NULL`
+ */
+static __attribute__((nonnull))
+void* libkeccak_ring_reader(void* ring_)
+{
+  libkeccak_ring_t* restrict ring = ring_;
+  size_t slot, len;
+  ssize_t got = 1;
+  char* buf;
+  int error = 0;
+  
+  for (slot = 0; (got > 0) && !error; slot++)
+    {
+      pthread_mutex_lock(&ring->mutex);
+      while (ring->filled - ring->emptied == LIBKECCAK_RING_BUFFERS)
+	pthread_cond_wait(&ring->cond, &ring->mutex);
+      pthread_mutex_unlock(&ring->mutex);
+      
+      /* Fill the buffer completely, unless the end is reached,
+       * so that the hashing thread gets few large blocks. */
+      buf = ring->data + (slot % LIBKECCAK_RING_BUFFERS) * LIBKECCAK_RING_BUFFER_SIZE;
+      for (len = 0; len < LIBKECCAK_RING_BUFFER_SIZE; len += (size_t)got)
+	if (got = read(ring->fd, buf + len, LIBKECCAK_RING_BUFFER_SIZE - len), got <= 0)
+	  {
+	    if ((got < 0) && (errno == EINTR))
+	      {
+		got = 0;
+		continue;
+	      }
+	    if (got < 0)
+	      error = errno;
+	    break;
+	  }
+      
+      pthread_mutex_lock(&ring->mutex);
+      if (len)
+	ring->lengths[slot % LIBKECCAK_RING_BUFFERS] = len, ring->filled++;
+      ring->error = error;
+      ring->done = (char)((got <= 0) || error);
+      pthread_cond_signal(&ring->cond);
+      pthread_mutex_unlock(&ring->mutex);
+    }
+  
+  return NULL;
+}
+
+
+/**
+ * Hash the rest of a file, reading it on a separate thread into
+ * a ring of buffers, so that reading and hashing overlap
+ * 
+ * @param   fd     The file descriptor of the file to hash
+ * @param   state  The hashing state
+ * @return         Zero on success, -1 on error, 1 if a thread could
+ *                 not be started and nothing has been read
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_threaded(int fd, libkeccak_state_t* restrict state)
+{
+  libkeccak_ring_t ring;
+  pthread_t thread;
+  sigset_t all, old;
+  size_t slot;
+  int r;
+  
+  ring.data = malloc(LIBKECCAK_RING_BUFFERS * LIBKECCAK_RING_BUFFER_SIZE);
+  if (ring.data == NULL)
+    return -1;
+  ring.filled = ring.emptied = 0;
+  ring.fd = fd;
+  ring.error = 0;
+  ring.done = 0;
+  pthread_mutex_init(&ring.mutex, NULL);
+  pthread_cond_init(&ring.cond, NULL);
+  
+  /* Signals should be delivered to the application's threads. */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  r = pthread_create(&thread, NULL, libkeccak_ring_reader, &ring);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (r)
+    {
+      r = 1;
+      goto out;
+    }
+  
+  for (slot = 0;; slot++)
+    {
+      pthread_mutex_lock(&ring.mutex);
+      while ((ring.filled == slot) && !ring.done)
+	pthread_cond_wait(&ring.cond, &ring.mutex);
+      if (ring.filled == slot)
+	{
+	  pthread_mutex_unlock(&ring.mutex);
+	  break;
+	}
+      pthread_mutex_unlock(&ring.mutex);
+      
+      libkeccak_fast_update(state, ring.data + (slot % LIBKECCAK_RING_BUFFERS) * LIBKECCAK_RING_BUFFER_SIZE,
+			    ring.lengths[slot % LIBKECCAK_RING_BUFFERS]);
+      
+      pthread_mutex_lock(&ring.mutex);
+      ring.emptied++;
+      pthread_cond_signal(&ring.cond);
+      pthread_mutex_unlock(&ring.mutex);
+    }
+  
+  pthread_join(thread, NULL);
+  r = ring.error ? (errno = ring.error, -1) : 0;
+  
+ out:
+  pthread_cond_destroy(&ring.cond);
+  pthread_mutex_destroy(&ring.mutex);
+  free(ring.data);
+  return r;
+}
+
+
+#ifdef O_DIRECT
+
+/**
+ * Hash the rest of a file opened for direct I/O, one read at
+ * a time, direct I/O is turned off if a read fails because
+ * the position is no longer aligned, as after a short read
+ * 
+ * @param   fd     The file descriptor of the file to hash
+ * @param   state  The hashing state
+ * @param   buf    Aligned buffer of `LIBKECCAK_DIRECT_BUFFER_SIZE` bytes
+ * @param   pos    The position in the file to start at, updated
+ *                 to the position up to which it has been hashed
+ * @return         Zero on success, -1 on error
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_direct_sync(int fd, libkeccak_state_t* restrict state, char* restrict buf, off_t* restrict pos)
+{
+  ssize_t got;
+  int oflags;
+  
+  for (;;)
+    {
+      got = pread(fd, buf, LIBKECCAK_DIRECT_BUFFER_SIZE, *pos);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if ((errno == EINVAL) && (oflags = fcntl(fd, F_GETFL), oflags >= 0) && (oflags & O_DIRECT))
+	    if (fcntl(fd, F_SETFL, oflags & ~O_DIRECT) == 0)
+	      continue;
+	  return -1;
+	}
+      if (got == 0)
+	return 0;
+      libkeccak_fast_update(state, buf, (size_t)got);
+      *pos += (off_t)got;
+    }
+}
+
+
+# ifdef LIBKECCAK_HAVE_IO_URING
+
+/**
+ * Hash a file opened for direct I/O with io_uring, keeping a
+ * read in flight for each buffer, and absorbing them in order
+ * 
+ * @param   ring   The io_uring instance, with room for at
+ *                 least `LIBKECCAK_DIRECT_BUFFERS` submissions
+ * @param   fd     The file descriptor of the file to hash
+ * @param   state  The hashing state
+ * @param   bufs   `LIBKECCAK_DIRECT_BUFFERS` aligned buffers of
+ *                 `LIBKECCAK_DIRECT_BUFFER_SIZE` bytes, one after the other
+ * @param   pos    The position in the file to start at, updated to the position
+ *                 up to which it has been hashed, which is where the first read
+ *                 that did not fill its buffer started, or ended if it read anything
+ * @return         Zero on success, -1 on error
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_direct_uring(libkeccak_uring_t* restrict ring, int fd, libkeccak_state_t* restrict state,
+			       char* restrict bufs, off_t* restrict pos)
+{
+  int res[LIBKECCAK_DIRECT_BUFFERS];
+  char done[LIBKECCAK_DIRECT_BUFFERS];
+  struct io_uring_sqe* sqe;
+  struct io_uring_cqe* cqe;
+  off_t start = *pos;
+  size_t queued = 0, next = 0, inflight = 0, i;
+  unsigned head, tail;
+  long got;
+  int stop = 0;
+  
+  for (;;)
+    {
+      /* Keep every buffer busy, read `k` goes into buffer `k % LIBKECCAK_DIRECT_BUFFERS`. */
+      for (; !stop && (queued < next + LIBKECCAK_DIRECT_BUFFERS); queued++, inflight++)
+	{
+	  i = queued % LIBKECCAK_DIRECT_BUFFERS;
+	  done[i] = 0;
+	  sqe = libkeccak_uring_queue(ring);
+	  sqe->opcode = IORING_OP_READ;
+	  sqe->fd = fd;
+	  sqe->addr = (uint64_t)(uintptr_t)(bufs + i * LIBKECCAK_DIRECT_BUFFER_SIZE);
+	  sqe->len = (uint32_t)LIBKECCAK_DIRECT_BUFFER_SIZE;
+	  sqe->off = (uint64_t)(start + (off_t)(queued * LIBKECCAK_DIRECT_BUFFER_SIZE));
+	  sqe->user_data = (uint64_t)i;
+	}
+      if (!inflight)
+	break;
+      
+      got = syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      ring->pending -= (unsigned)got;
+      
+      head = *ring->cq_head;
+      tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, inflight--)
+	{
+	  cqe = ring->cqes + (head & *ring->cq_mask);
+	  res[cqe->user_data] = cqe->res;
+	  done[cqe->user_data] = 1;
+	}
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+      
+      /* After the end, a short read, or a failed read, the remaining
+       * reads are only waited for, and the rest of the file is read
+       * synchronously, which also reports the error if it persists. */
+      while (!stop && done[i = next % LIBKECCAK_DIRECT_BUFFERS])
+	{
+	  done[i] = 0;
+	  if (res[i] > 0)
+	    {
+	      libkeccak_fast_update(state, bufs + i * LIBKECCAK_DIRECT_BUFFER_SIZE, (size_t)res[i]);
+	      *pos += (off_t)res[i];
+	    }
+	  stop = (size_t)res[i] != LIBKECCAK_DIRECT_BUFFER_SIZE;
+	  next++;
+	}
+    }
+  
+  return 0;
+}
+
+# endif
+
+
+/**
+ * Hash the rest of a regular file or block device with direct
+ * I/O, into large aligned buffers, bypassing the page cache
+ * 
+ * @param   fd     The file descriptor of the file to hash
+ * @param   state  The hashing state
+ * @return         Zero on success, -1 on error, 1 if direct I/O
+ *                 cannot be used and nothing has been read
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_direct(int fd, libkeccak_state_t* restrict state)
+{
+  void* bufs;
+  off_t pos;
+  int oflags, r, saved_errno;
+#ifdef LIBKECCAK_HAVE_IO_URING
+  libkeccak_uring_t ring;
+#endif
+  
+  pos = lseek(fd, 0, SEEK_CUR);
+  if ((pos < 0) || (pos % (off_t)LIBKECCAK_DIRECT_ALIGN) || (oflags = fcntl(fd, F_GETFL), oflags < 0))
+    return 1;
+  if ((r = posix_memalign(&bufs, LIBKECCAK_DIRECT_ALIGN, LIBKECCAK_DIRECT_BUFFERS * LIBKECCAK_DIRECT_BUFFER_SIZE)))
+    return errno = r, -1;
+  
+  /* Not every file system supports direct I/O. */
+  if (!(oflags & O_DIRECT) && (fcntl(fd, F_SETFL, oflags | O_DIRECT) < 0))
+    return free(bufs), 1;
+  
+  r = 0;
+#ifdef LIBKECCAK_HAVE_IO_URING
+  if (!libkeccak_uring_create(&ring, LIBKECCAK_DIRECT_BUFFERS))
+    {
+      r = libkeccak_sum_direct_uring(&ring, fd, state, bufs, &pos);
+      saved_errno = errno;
+      libkeccak_uring_destroy(&ring);
+      errno = saved_errno;
+    }
+#endif
+  if (!r)
+    r = libkeccak_sum_direct_sync(fd, state, bufs, &pos);
+  
+  saved_errno = errno;
+  lseek(fd, pos, SEEK_SET);
+  fcntl(fd, F_SETFL, oflags);
+  free(bufs);
+  errno = saved_errno;
+  return r;
+}
+
+#endif
+
 
 /**
  * Calculate a Keccak-family hashsum of a file,
@@ -42,35 +856,633 @@ int libkeccak_generalised_sum_fd(int fd, libkeccak_state_t* restrict state,
 				 const libkeccak_spec_t* restrict spec,
 				 const char* restrict suffix, char* restrict hashsum)
 {
-  ssize_t got;
+  return libkeccak_generalised_sum_fd_flags(fd, state, spec, suffix, hashsum, 0);
+}
+
+
+/**
+ * Calculate a Keccak-family hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * Files are read with a large, adaptive, buffer, unless
+ * `LIBKECCAK_SUM_FD_THREADED` or `LIBKECCAK_SUM_FD_DIRECT` is
+ * used, or `LIBKECCAK_SUM_FD_MMAP` is used and the file is a
+ * large regular file, which is then hashed straight from memory
+ * mappings of it; pipes are enlarged first
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   state    The hashing state, should not be initialised (memory leak otherwise)
+ * @param   spec     Specifications for the hashing algorithm
+ * @param   suffix   The data suffix, see `libkeccak_digest`
+ * @param   hashsum  Output array for the hashsum, have an allocation size of
+ *                   at least `((spec->output + 7) / 8) * sizeof(char)`, may be `NULL`
+ * @param   flags    Bitwise OR of `LIBKECCAK_SUM_FD_*` constants
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_generalised_sum_fd_flags(int fd, libkeccak_state_t* restrict state,
+				       const libkeccak_spec_t* restrict spec,
+				       const char* restrict suffix, char* restrict hashsum, int flags)
+{
   struct stat attr;
-  size_t blksize = 4096;
-  char* restrict chunk;
+  size_t blksize = 4096, pipesize;
+  off_t offset, reached;
+  uint64_t left = UINT64_MAX;
+  int r = 1;
+  
+  if (flags & ~(LIBKECCAK_SUM_FD_THREADED | LIBKECCAK_SUM_FD_DIRECT | LIBKECCAK_SUM_FD_MMAP))
+    return errno = EINVAL, -1;
   
   if (libkeccak_state_initialise(state, spec) < 0)
     return -1;
   
   if (fstat(fd, &attr) == 0)
-    if (attr.st_blksize > 0)
-      blksize = (size_t)(attr.st_blksize);
+    {
+      if (attr.st_blksize > 0)
+	blksize = (size_t)(attr.st_blksize);
+      /* A pipe's block size is a page, but a read can return the whole pipe. */
+      if (S_ISFIFO(attr.st_mode) && (pipesize = libkeccak_pipe_grow(fd), pipesize > blksize))
+	blksize = pipesize;
+#ifdef O_DIRECT
+      if ((flags & LIBKECCAK_SUM_FD_DIRECT) && (S_ISREG(attr.st_mode) || S_ISBLK(attr.st_mode)))
+	r = libkeccak_sum_direct(fd, state);
+#endif
+      if ((r > 0) && S_ISREG(attr.st_mode) && (offset = lseek(fd, 0, SEEK_CUR), offset >= 0))
+	{
+	  posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+	  if (((flags & (LIBKECCAK_SUM_FD_THREADED | LIBKECCAK_SUM_FD_MMAP)) == LIBKECCAK_SUM_FD_MMAP) &&
+	      (attr.st_size - offset >= (off_t)LIBKECCAK_MMAP_MIN))
+	    {
+	      /* Continue with `read` where the mappings ended, whether
+	       * mapping failed, or the file has grown since `fstat`. */
+	      reached = libkeccak_sum_mapped(fd, state, offset, attr.st_size);
+	      if ((reached != offset) && (lseek(fd, reached, SEEK_SET) < 0))
+		return -1;
+	    }
+	}
+    }
+  
+  /* Without a reader thread, the file is read on this thread. */
+  if ((r > 0) && (flags & LIBKECCAK_SUM_FD_THREADED))
+    r = libkeccak_sum_threaded(fd, state);
+  if (r > 0)
+    r = libkeccak_sum_read(fd, state, blksize, &left);
+  if (r < 0)
+    return -1;
+  
+  return libkeccak_fast_digest(state, NULL, 0, 0, suffix, hashsum);
+}
+
+
+/**
+ * Absorb the next part of a file, from its current position, into
+ * a hashing state, the content of the file is assumed non-sensitive
+ * 
+ * The file is read in the same way as by `libkeccak_generalised_sum_fd_flags`,
+ * and the file offset is advanced past the absorbed data
+ * 
+ * @param   state     The hashing state, it is updated but not digested
+ * @param   fd        The file descriptor of the file to absorb
+ * @param   limit     The maximum number of bytes to absorb
+ * @param   absorbed  Output parameter for the number of bytes absorbed,
+ *                    which is less than `limit` only at the end of the
+ *                    file or on error
+ * @param   flags     0 or `LIBKECCAK_SUM_FD_MMAP`
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_fast_update_fd(libkeccak_state_t* restrict state, int fd, uint64_t limit,
+			     uint64_t* restrict absorbed, int flags)
+{
+  struct stat attr;
+  size_t blksize = 4096, pipesize;
+  off_t offset, end, reached;
+  uint64_t left = limit;
+  int r = 0;
   
-  chunk = alloca(blksize);
+  *absorbed = 0;
+  if (flags & ~LIBKECCAK_SUM_FD_MMAP)
+    return errno = EINVAL, -1;
+  
+  if (fstat(fd, &attr) == 0)
+    {
+      if (attr.st_blksize > 0)
+	blksize = (size_t)(attr.st_blksize);
+      if (S_ISFIFO(attr.st_mode) && (pipesize = libkeccak_pipe_grow(fd), pipesize > blksize))
+	blksize = pipesize;
+      if ((flags & LIBKECCAK_SUM_FD_MMAP) && S_ISREG(attr.st_mode) &&
+	  (offset = lseek(fd, 0, SEEK_CUR), offset >= 0) && (attr.st_size > offset))
+	{
+	  end = attr.st_size;
+	  if ((uint64_t)(end - offset) > left)
+	    end = offset + (off_t)left;
+	  if (end - offset >= (off_t)LIBKECCAK_MMAP_MIN)
+	    {
+	      posix_fadvise(fd, offset, end - offset, POSIX_FADV_SEQUENTIAL);
+	      reached = libkeccak_sum_mapped(fd, state, offset, end);
+	      left -= (uint64_t)(reached - offset);
+	      if ((reached != offset) && (lseek(fd, reached, SEEK_SET) < 0))
+		r = -1;
+	    }
+	}
+    }
+  
+  if (r == 0)
+    r = libkeccak_sum_read(fd, state, blksize, &left);
+  *absorbed = limit - left;
+  return r;
+}
+
+
+#ifdef SPLICE_F_MOVE
+
+/**
+ * Hash the rest of a pipe, and forward it to another pipe, with
+ * `tee`, which duplicates the data into the other pipe without
+ * copying it, after which it is read from the first pipe
+ * 
+ * @param   fd     The file descriptor of the pipe to hash
+ * @param   out    The file descriptor of the pipe to forward it to
+ * @param   state  The hashing state
+ * @param   buf    Buffer of `size` bytes
+ * @param   size   The size of `buf`
+ * @return         Zero on success, -1 on error, 1 if `tee`
+ *                 cannot be used and nothing has been read
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_tee_pipe(int fd, int out, libkeccak_state_t* restrict state, char* restrict buf, size_t size)
+{
+  ssize_t teed, got;
+  size_t left;
+  int first = 1;
   
   for (;;)
     {
-      got = read(fd, chunk, blksize);
-      if (got < 0)
+      if (teed = tee(fd, out, size, 0), teed < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (first && ((errno == EINVAL) || (errno == ENOSYS)))
+	    return 1;
+	  return -1;
+	}
+      if (teed == 0)
+	return 0;
+      first = 0;
+      
+      /* Consume what has been duplicated. */
+      for (left = (size_t)teed; left; left -= (size_t)got)
+	{
+	  got = read(fd, buf, left);
+	  if (got < 0)
+	    {
+	      if (errno != EINTR)
+		return -1;
+	      got = 0;
+	      continue;
+	    }
+	  if (got == 0)
+	    return errno = EIO, -1;
+	  libkeccak_fast_update(state, buf, (size_t)got);
+	}
+    }
+}
+
+#endif
+
+
+/**
+ * Hash the rest of a file, and write it to another file
+ * 
+ * @param   fd     The file descriptor of the file to hash
+ * @param   out    The file descriptor of the file to write it to
+ * @param   state  The hashing state
+ * @param   buf    Buffer of `size` bytes
+ * @param   size   The size of `buf`
+ * @return         Zero on success, -1 on error
+ */
+static __attribute__((nonnull, nothrow))
+int libkeccak_sum_tee_copy(int fd, int out, libkeccak_state_t* restrict state, char* restrict buf, size_t size)
+{
+  ssize_t got, wrote;
+  size_t ptr;
+  
+  for (;;)
+    {
+      if (got = read(fd, buf, size), got < 0)
 	{
 	  if (errno == EINTR)
 	    continue;
 	  return -1;
 	}
       if (got == 0)
-	break;
-      if (libkeccak_fast_update(state, chunk, (size_t)got) < 0)
-	return -1;
+	return 0;
+      libkeccak_fast_update(state, buf, (size_t)got);
+      
+      for (ptr = 0; ptr < (size_t)got; ptr += (size_t)wrote)
+	if (wrote = write(out, buf + ptr, (size_t)got - ptr), wrote < 0)
+	  {
+	    if (errno == EINTR)
+	      {
+		wrote = 0;
+		continue;
+	      }
+	    return -1;
+	  }
+    }
+}
+
+
+/**
+ * Calculate a Keccak-family hashsum of a file, and write the file,
+ * unchanged, to another file while doing so; the content of the
+ * file is assumed non-sensitive
+ * 
+ * If both files are pipes, the data is duplicated into the
+ * output pipe with `tee`, rather than being copied
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   out      The file descriptor to write the file to
+ * @param   state    The hashing state, should not be initialised (memory leak otherwise)
+ * @param   spec     Specifications for the hashing algorithm
+ * @param   suffix   The data suffix, see `libkeccak_digest`
+ * @param   hashsum  Output array for the hashsum, have an allocation size of
+ *                   at least `((spec->output + 7) / 8) * sizeof(char)`, may be `NULL`
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_generalised_sum_fd_tee(int fd, int out, libkeccak_state_t* restrict state,
+				     const libkeccak_spec_t* restrict spec,
+				     const char* restrict suffix, char* restrict hashsum)
+{
+  struct stat attr;
+  size_t size = LIBKECCAK_READ_MAX;
+  char* buf;
+  int r = 1, saved_errno;
+  
+  if (libkeccak_state_initialise(state, spec) < 0)
+    return -1;
+  if (buf = malloc(size), buf == NULL)
+    return -1;
+  
+  if ((fstat(fd, &attr) == 0) && S_ISFIFO(attr.st_mode))
+    {
+      libkeccak_pipe_grow(fd);
+#ifdef SPLICE_F_MOVE
+      if ((fstat(out, &attr) == 0) && S_ISFIFO(attr.st_mode))
+	{
+	  libkeccak_pipe_grow(out);
+	  r = libkeccak_sum_tee_pipe(fd, out, state, buf, size);
+	}
+#endif
     }
+  if (r > 0)
+    r = libkeccak_sum_tee_copy(fd, out, state, buf, size);
+  
+  saved_errno = errno;
+  free(buf);
+  errno = saved_errno;
+  if (r < 0)
+    return -1;
   
   return libkeccak_fast_digest(state, NULL, 0, 0, suffix, hashsum);
 }
 
+
+/**
+ * Open, read and absorb a file into its slot, on the calling thread
+ * 
+ * @param  batch_  The files, `libkeccak_sum_batch_t*`
+ * @param  i       The file's offset from the first file in the group
+ */
+static __attribute__((nonnull))
+void libkeccak_sum_files_worker(void* batch_, size_t i)
+{
+  libkeccak_sum_batch_t* restrict batch = batch_;
+  libkeccak_sum_slot_t* restrict slot = batch->slots + i;
+  ssize_t got;
+  
+  slot->index = batch->first + i;
+  if (slot->fd = open(batch->filenames[slot->index], O_RDONLY | O_CLOEXEC), slot->fd < 0)
+    {
+      slot->error = errno;
+      slot->phase = SLOT_DONE;
+      return;
+    }
+  posix_fadvise(slot->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  
+  for (;;)
+    {
+      got = read(slot->fd, slot->buf, LIBKECCAK_BATCH_BUFFER_SIZE);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  slot->error = errno;
+	  break;
+	}
+      if (got == 0)
+	break;
+      libkeccak_fast_update(&slot->state, slot->buf, (size_t)got);
+    }
+  
+  close(slot->fd);
+  slot->fd = -1;
+  slot->phase = SLOT_DONE;
+}
+
+
+/**
+ * Hash files with the library's thread pool, a group of
+ * `LIBKECCAK_BATCH_FILES` files at a time
+ * 
+ * @param   batch     The files, the slots' states and buffers must be allocated
+ * @param   n         The number of files
+ * @param   callback  See `libkeccak_sum_files`
+ * @param   user      See `libkeccak_sum_files`
+ * @return            Zero on success, otherwise the value returned by `callback`
+ */
+static __attribute__((nonnull(1, 3)))
+int libkeccak_sum_files_threaded(libkeccak_sum_batch_t* restrict batch, size_t n,
+				 int (*callback)(void*, size_t, libkeccak_state_t*, int), void* user)
+{
+  size_t i, count;
+  int r;
+  
+  for (batch->first = 0; batch->first < n; batch->first += count)
+    {
+      count = n - batch->first;
+      if (count > LIBKECCAK_BATCH_FILES)
+	count = LIBKECCAK_BATCH_FILES;
+      libkeccak_pool_run(count, libkeccak_sum_files_worker, batch);
+      for (i = 0; i < count; i++)
+	{
+	  if ((r = callback(user, batch->first + i, &batch->slots[i].state, batch->slots[i].error)))
+	    return r;
+	  libkeccak_state_reset(&batch->slots[i].state);
+	  batch->slots[i].error = 0;
+	  batch->slots[i].phase = SLOT_FREE;
+	}
+    }
+  
+  return 0;
+}
+
+
+#ifdef LIBKECCAK_HAVE_IO_URING
+
+/**
+ * Queue a read of the next part of a file into its buffer
+ * 
+ * @param  ring  The io_uring instance
+ * @param  slot  The file
+ * @param  id    The slot's index, used to identify the completion
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_uring_read(libkeccak_uring_t* restrict ring, libkeccak_sum_slot_t* restrict slot, size_t id)
+{
+  struct io_uring_sqe* sqe = libkeccak_uring_queue(ring);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = slot->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(slot->buf);
+  sqe->len = (uint32_t)LIBKECCAK_BATCH_BUFFER_SIZE;
+  sqe->off = (uint64_t)-1; /* At, and update, the file offset, which also works for pipes. */
+  sqe->user_data = (uint64_t)id;
+  slot->phase = SLOT_READING;
+}
+
+
+/**
+ * Handle the completion of an operation on a file
+ * 
+ * @param  ring  The io_uring instance
+ * @param  slot  The file
+ * @param  id    The slot's index
+ * @param  res   The result of the operation
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_uring_complete(libkeccak_uring_t* restrict ring, libkeccak_sum_slot_t* restrict slot,
+			      size_t id, int res)
+{
+  if ((res == -EINTR) || (res == -EAGAIN))
+    {
+      /* Nothing has happened, so just try again. */
+      if (slot->phase == SLOT_READING)
+	libkeccak_uring_read(ring, slot, id);
+      else
+	slot->error = -res, slot->phase = SLOT_DONE;
+      return;
+    }
+  
+  if (res < 0)
+    {
+      slot->error = -res;
+    }
+  else if (slot->phase == SLOT_OPENING)
+    {
+      slot->fd = res;
+      libkeccak_uring_read(ring, slot, id);
+      return;
+    }
+  else if (res > 0)
+    {
+      libkeccak_fast_update(&slot->state, slot->buf, (size_t)res);
+      libkeccak_uring_read(ring, slot, id);
+      return;
+    }
+  
+  if (slot->fd >= 0)
+    close(slot->fd), slot->fd = -1;
+  slot->phase = SLOT_DONE;
+}
+
+
+/**
+ * Hash files with io_uring, up to `LIBKECCAK_BATCH_FILES` at a time,
+ * each with a read in flight, and absorb each read as it completes
+ * 
+ * @param   ring      The io_uring instance, with room for at least
+ *                    `LIBKECCAK_BATCH_FILES` submissions
+ * @param   batch     The files, the slots' states and buffers must be allocated
+ * @param   n         The number of files
+ * @param   callback  See `libkeccak_sum_files`
+ * @param   user      See `libkeccak_sum_files`
+ * @return            Zero on success, -1 on error, otherwise
+ *                    the value returned by `callback`
+ */
+static __attribute__((nonnull(1, 2, 4)))
+int libkeccak_sum_files_uring(libkeccak_uring_t* restrict ring, libkeccak_sum_batch_t* restrict batch, size_t n,
+			      int (*callback)(void*, size_t, libkeccak_state_t*, int), void* user)
+{
+  libkeccak_sum_slot_t* slot;
+  struct io_uring_sqe* sqe;
+  struct io_uring_cqe* cqe;
+  size_t started = 0, finished = 0, inflight = 0, id;
+  unsigned head, tail;
+  long got;
+  int r = 0;
+  
+  while (finished < n)
+    {
+      /* Keep a window of files in flight, so that a file's slot is free
+       * once the callback has been called for all earlier files. */
+      for (; (started < n) && (started < finished + LIBKECCAK_BATCH_FILES); started++, inflight++)
+	{
+	  slot = batch->slots + started % LIBKECCAK_BATCH_FILES;
+	  slot->index = started;
+	  slot->phase = SLOT_OPENING;
+	  sqe = libkeccak_uring_queue(ring);
+	  sqe->opcode = IORING_OP_OPENAT;
+	  sqe->fd = AT_FDCWD;
+	  sqe->addr = (uint64_t)(uintptr_t)(batch->filenames[started]);
+	  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	  sqe->user_data = (uint64_t)(started % LIBKECCAK_BATCH_FILES);
+	}
+      
+      if (inflight)
+	{
+	  got = syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	  if (got < 0)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      r = -1;
+	      break;
+	    }
+	  ring->pending -= (unsigned)got;
+	  
+	  head = *ring->cq_head;
+	  tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	  for (; head != tail; head++)
+	    {
+	      cqe = ring->cqes + (head & *ring->cq_mask);
+	      id = (size_t)(cqe->user_data);
+	      libkeccak_uring_complete(ring, batch->slots + id, id, cqe->res);
+	      inflight -= batch->slots[id].phase == SLOT_DONE;
+	    }
+	  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+      
+      /* Report the files in order. */
+      for (;;)
+	{
+	  slot = batch->slots + finished % LIBKECCAK_BATCH_FILES;
+	  if ((finished == started) || (slot->phase != SLOT_DONE))
+	    break;
+	  if ((r = callback(user, finished, &slot->state, slot->error)))
+	    goto out;
+	  libkeccak_state_reset(&slot->state);
+	  slot->error = 0;
+	  slot->phase = SLOT_FREE;
+	  finished++;
+	}
+    }
+  
+ out:
+  /* If stopped early, wait for the kernel to stop using the buffers. */
+  while (inflight)
+    {
+      got = syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if ((got < 0) && (errno != EINTR))
+	break;
+      ring->pending -= (unsigned)(got < 0 ? 0 : got);
+      head = *ring->cq_head;
+      tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, inflight--)
+	{
+	  cqe = ring->cqes + (head & *ring->cq_mask);
+	  slot = batch->slots + (size_t)(cqe->user_data);
+	  if ((cqe->res >= 0) && (slot->phase == SLOT_OPENING))
+	    close(cqe->res);
+	  else if (slot->fd >= 0)
+	    close(slot->fd), slot->fd = -1;
+	}
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+  return r;
+}
+
+#endif
+
+
+/**
+ * Calculate Keccak-family hashsums of many files, keeping many files
+ * open and reads in flight at the same time; io_uring is used if the
+ * kernel supports it, otherwise the library's thread pool is used
+ * 
+ * @param   filenames  The files to hash
+ * @param   n          The number of files
+ * @param   spec       Specifications for the hashing algorithm
+ * @param   flags      Bitwise OR of `LIBKECCAK_SUM_FILES_*` constants
+ * @param   callback   Called once for each file, in the order of `filenames`, with
+ *                     `user`, the file's index, a state that the file has been
+ *                     absorbed into but not digested, which becomes invalid when
+ *                     the function returns, and `errno` if the file could not be
+ *                     hashed, zero otherwise; if it returns non-zero, no more
+ *                     files are hashed
+ * @param   user       The first argument for `callback`, may be `NULL`
+ * @return             Zero on success, -1 on error, otherwise
+ *                     the value returned by `callback`
+ */
+int libkeccak_sum_files(const char* const* filenames, size_t n, const libkeccak_spec_t* restrict spec, int flags,
+			int (*callback)(void*, size_t, libkeccak_state_t*, int), void* user)
+{
+  libkeccak_sum_batch_t* batch;
+  size_t i, slots = n < LIBKECCAK_BATCH_FILES ? n : LIBKECCAK_BATCH_FILES;
+  int r, saved_errno, done = 0;
+#ifdef LIBKECCAK_HAVE_IO_URING
+  libkeccak_uring_t ring;
+#endif
+  
+  if (flags & ~LIBKECCAK_SUM_FILES_NO_IO_URING)
+    return errno = EINVAL, -1;
+  
+  if (batch = malloc(sizeof(*batch)), batch == NULL)
+    return -1;
+  batch->filenames = filenames;
+  for (i = 0; i < slots; i++)
+    {
+      batch->slots[i].fd = -1;
+      batch->slots[i].error = 0;
+      batch->slots[i].phase = SLOT_FREE;
+      if (batch->slots[i].buf = malloc(LIBKECCAK_BATCH_BUFFER_SIZE), batch->slots[i].buf == NULL)
+	goto fail;
+      if (libkeccak_state_initialise(&batch->slots[i].state, spec) < 0)
+	{
+	  free(batch->slots[i].buf);
+	  goto fail;
+	}
+    }
+  
+#ifdef LIBKECCAK_HAVE_IO_URING
+  if (!(flags & LIBKECCAK_SUM_FILES_NO_IO_URING) && (n > 0) &&
+      !libkeccak_uring_create(&ring, 2 * LIBKECCAK_BATCH_FILES))
+    {
+      r = libkeccak_sum_files_uring(&ring, batch, n, callback, user);
+      saved_errno = errno;
+      libkeccak_uring_destroy(&ring);
+      errno = saved_errno;
+      done = 1;
+    }
+#endif
+  if (!done)
+    r = libkeccak_sum_files_threaded(batch, n, callback, user);
+  
+  saved_errno = errno;
+  for (i = 0; i < slots; i++)
+    {
+      libkeccak_state_fast_destroy(&batch->slots[i].state);
+      free(batch->slots[i].buf);
+    }
+  free(batch);
+  errno = saved_errno;
+  return r;
+  
+ fail:
+  saved_errno = errno;
+  while (i--)
+    {
+      libkeccak_state_fast_destroy(&batch->slots[i].state);
+      free(batch->slots[i].buf);
+    }
+  free(batch);
+  errno = saved_errno;
+  return -1;
+}
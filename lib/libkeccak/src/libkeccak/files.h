@@ -24,6 +24,36 @@
 #include "internal.h"
 
 
+/**
+ * Flag for `libkeccak_generalised_sum_fd_flags`: read the file on a
+ * separate thread, into a ring of large buffers, while it is being
+ * hashed, so that reading and hashing overlap
+ */
+#define LIBKECCAK_SUM_FD_THREADED  0x0001
+
+/**
+ * Flag for `libkeccak_generalised_sum_fd_flags`: read regular files
+ * and block devices with direct I/O, bypassing the page cache, into
+ * large aligned buffers with several reads in flight
+ */
+#define LIBKECCAK_SUM_FD_DIRECT  0x0002
+
+/**
+ * Flag for `libkeccak_generalised_sum_fd_flags` and `libkeccak_fast_update_fd`:
+ * hash large regular files directly from memory mappings of them rather
+ * than reading them; if the file is truncated while it is being hashed,
+ * the process receives `SIGBUS`, which terminates it unless it is handled
+ */
+#define LIBKECCAK_SUM_FD_MMAP  0x0004
+
+/**
+ * Flag for `libkeccak_sum_files`: use the library's
+ * thread pool even if io_uring is available
+ */
+#define LIBKECCAK_SUM_FILES_NO_IO_URING  0x0001
+
+
+
 /**
  * Calculate a Keccak-family hashsum of a file,
  * the content of the file is assumed non-sensitive
@@ -42,6 +72,87 @@ int libkeccak_generalised_sum_fd(int fd, libkeccak_state_t* restrict state,
 				 const char* restrict suffix, char* restrict hashsum);
 
 
+/**
+ * Calculate a Keccak-family hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   state    The hashing state, should not be initialised (memory leak otherwise)
+ * @param   spec     Specifications for the hashing algorithm
+ * @param   suffix   The data suffix, see `libkeccak_digest`
+ * @param   hashsum  Output array for the hashsum, have an allocation size of
+ *                   at least `((spec->output + 7) / 8) * sizeof(char)`, may be `NULL`
+ * @param   flags    Bitwise OR of `LIBKECCAK_SUM_FD_*` constants
+ * @return           Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(2, 3))))
+int libkeccak_generalised_sum_fd_flags(int fd, libkeccak_state_t* restrict state,
+				       const libkeccak_spec_t* restrict spec,
+				       const char* restrict suffix, char* restrict hashsum, int flags);
+
+
+/**
+ * Absorb the next part of a file, from its current position, into
+ * a hashing state, the content of the file is assumed non-sensitive
+ * 
+ * @param   state     The hashing state, it is updated but not digested
+ * @param   fd        The file descriptor of the file to absorb
+ * @param   limit     The maximum number of bytes to absorb
+ * @param   absorbed  Output parameter for the number of bytes absorbed,
+ *                    which is less than `limit` only at the end of the
+ *                    file or on error
+ * @param   flags     0 or `LIBKECCAK_SUM_FD_MMAP`
+ * @return            Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull)))
+int libkeccak_fast_update_fd(libkeccak_state_t* restrict state, int fd, uint64_t limit,
+			     uint64_t* restrict absorbed, int flags);
+
+
+/**
+ * Calculate a Keccak-family hashsum of a file, and write the file,
+ * unchanged, to another file while doing so; the content of the
+ * file is assumed non-sensitive
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   out      The file descriptor to write the file to
+ * @param   state    The hashing state, should not be initialised (memory leak otherwise)
+ * @param   spec     Specifications for the hashing algorithm
+ * @param   suffix   The data suffix, see `libkeccak_digest`
+ * @param   hashsum  Output array for the hashsum, have an allocation size of
+ *                   at least `((spec->output + 7) / 8) * sizeof(char)`, may be `NULL`
+ * @return           Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(3, 4))))
+int libkeccak_generalised_sum_fd_tee(int fd, int out, libkeccak_state_t* restrict state,
+				     const libkeccak_spec_t* restrict spec,
+				     const char* restrict suffix, char* restrict hashsum);
+
+
+/**
+ * Calculate Keccak-family hashsums of many files, keeping many files
+ * open and reads in flight at the same time; io_uring is used if the
+ * kernel supports it, otherwise the library's thread pool is used
+ * 
+ * @param   filenames  The files to hash
+ * @param   n          The number of files
+ * @param   spec       Specifications for the hashing algorithm
+ * @param   flags      Bitwise OR of `LIBKECCAK_SUM_FILES_*` constants
+ * @param   callback   Called once for each file, in the order of `filenames`, with
+ *                     `user`, the file's index, a state that the file has been
+ *                     absorbed into but not digested, which becomes invalid when
+ *                     the function returns, and `errno` if the file could not be
+ *                     hashed, zero otherwise; if it returns non-zero, no more
+ *                     files are hashed
+ * @param   user       The first argument for `callback`, may be `NULL`
+ * @return             Zero on success, -1 on error, otherwise
+ *                     the value returned by `callback`
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(3, 5))))
+int libkeccak_sum_files(const char* const* filenames, size_t n, const libkeccak_spec_t* restrict spec, int flags,
+			int (*callback)(void*, size_t, libkeccak_state_t*, int), void* user);
+
+
 /**
  * Calculate the Keccak hashsum of a file,
  * the content of the file is assumed non-sensitive
@@ -18,28 +18,303 @@
  */
 #include "hex.h"
 
+#include <errno.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define LIBKECCAK_HAVE_X86_HEX  1
+# include <immintrin.h>
+#endif
+
 
 
 /**
- * Convert a binary hashsum to lower case hexadecimal representation
+ * The hexadecimal conversions the CPU supports
+ */
+#define HEX_GENERIC  0
+#define HEX_SSSE3    1
+#define HEX_AVX2     2
+
+
+
+#ifdef LIBKECCAK_HAVE_X86_HEX
+
+/**
+ * Convert 16 bytes to hexadecimal representation
+ * 
+ * @param  output  Output array for the 32 characters
+ * @param  x       The bytes to convert
+ * @param  digits  The 16 hexadecimal digits
+ * @param  mask    0x0F in each byte
+ */
+static inline __attribute__((nonnull, nothrow, target("ssse3")))
+void libkeccak_behex16_ssse3(char* restrict output, __m128i x, __m128i digits, __m128i mask)
+{
+  __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+  __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, mask));
+  _mm_storeu_si128((__m128i*)(void*)(output + 0), _mm_unpacklo_epi8(hi, lo));
+  _mm_storeu_si128((__m128i*)(void*)(output + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+
+/**
+ * Convert the beginning of a binary hashsum to hexadecimal representation,
+ * 16 bytes at a time
+ * 
+ * @param   output   Output array
+ * @param   hashsum  The hashsum to convert
+ * @param   n        The size of `hashsum`
+ * @param   digits   The 16 hexadecimal digits
+ * @return           The number of bytes in `hashsum` that were converted
+ */
+static __attribute__((nonnull, nothrow, target("ssse3")))
+size_t libkeccak_behex_ssse3(char* restrict output, const char* restrict hashsum, size_t n, const char* restrict digits)
+{
+  __m128i table = _mm_loadu_si128((const __m128i*)(const void*)digits);
+  __m128i mask = _mm_set1_epi8(0x0F);
+  size_t i;
+  for (i = 0; i + 16 <= n; i += 16)
+    libkeccak_behex16_ssse3(output + 2 * i, _mm_loadu_si128((const __m128i*)(const void*)(hashsum + i)), table, mask);
+  return i;
+}
+
+
+/**
+ * Convert the beginning of a binary hashsum to hexadecimal representation,
+ * 32 bytes at a time
+ * 
+ * @param   output   Output array
+ * @param   hashsum  The hashsum to convert
+ * @param   n        The size of `hashsum`
+ * @param   digits   The 16 hexadecimal digits
+ * @return           The number of bytes in `hashsum` that were converted
+ */
+static __attribute__((nonnull, nothrow, target("avx2")))
+size_t libkeccak_behex_avx2(char* restrict output, const char* restrict hashsum, size_t n, const char* restrict digits)
+{
+  __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(const void*)digits));
+  __m256i mask = _mm256_set1_epi8(0x0F);
+  __m256i x, hi, lo, a, b;
+  size_t i;
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      x = _mm256_loadu_si256((const __m256i*)(const void*)(hashsum + i));
+      hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+      lo = _mm256_shuffle_epi8(table, _mm256_and_si256(x, mask));
+      /* The unpacking is done within each 128-bit lane, so the
+       * lanes have to be put back in order when storing. */
+      a = _mm256_unpacklo_epi8(hi, lo);
+      b = _mm256_unpackhi_epi8(hi, lo);
+      _mm256_storeu_si256((__m256i*)(void*)(output + 2 * i + 0), _mm256_permute2x128_si256(a, b, 0x20));
+      _mm256_storeu_si256((__m256i*)(void*)(output + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+  return i;
+}
+
+
+/**
+ * Convert 32 hexadecimal digits to 16 bytes, invalid digits
+ * are converted in the same way as by `libkeccak_unhex_generic`
+ * 
+ * @param   x  The first 16 digits
+ * @param   y  The last 16 digits
+ * @return     The bytes
+ */
+static inline __attribute__((nothrow, const, target("ssse3")))
+__m128i libkeccak_unhex32_ssse3(__m128i x, __m128i y)
+{
+  __m128i mask = _mm_set1_epi8(0x0F), nine = _mm_set1_epi8(9), ascii9 = _mm_set1_epi8('9');
+  __m128i low = _mm_set1_epi16(0x00FF);
+  x = _mm_add_epi8(_mm_and_si128(x, mask), _mm_and_si128(_mm_cmpgt_epi8(x, ascii9), nine));
+  y = _mm_add_epi8(_mm_and_si128(y, mask), _mm_and_si128(_mm_cmpgt_epi8(y, ascii9), nine));
+  x = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(x, 4), _mm_srli_epi16(x, 8)), low);
+  y = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(y, 4), _mm_srli_epi16(y, 8)), low);
+  return _mm_packus_epi16(x, y);
+}
+
+
+/**
+ * Convert 64 hexadecimal digits to 32 bytes, invalid digits
+ * are converted in the same way as by `libkeccak_unhex_generic`
+ * 
+ * @param   x  The first 32 digits
+ * @param   y  The last 32 digits
+ * @return     The bytes
+ */
+static inline __attribute__((nothrow, const, target("avx2")))
+__m256i libkeccak_unhex64_avx2(__m256i x, __m256i y)
+{
+  __m256i mask = _mm256_set1_epi8(0x0F), nine = _mm256_set1_epi8(9), ascii9 = _mm256_set1_epi8('9');
+  __m256i low = _mm256_set1_epi16(0x00FF);
+  x = _mm256_add_epi8(_mm256_and_si256(x, mask), _mm256_and_si256(_mm256_cmpgt_epi8(x, ascii9), nine));
+  y = _mm256_add_epi8(_mm256_and_si256(y, mask), _mm256_and_si256(_mm256_cmpgt_epi8(y, ascii9), nine));
+  x = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(x, 4), _mm256_srli_epi16(x, 8)), low);
+  y = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(y, 4), _mm256_srli_epi16(y, 8)), low);
+  /* The packing is done within each 128-bit lane. */
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(x, y), 0xD8);
+}
+
+
+/**
+ * Get a mask of the bytes that are hexadecimal digits
+ * 
+ * @param   x  The characters
+ * @return     0xFF in the bytes that are hexadecimal digits, 0x00 in the others
+ */
+static inline __attribute__((nothrow, const, target("ssse3")))
+__m128i libkeccak_ishex16_ssse3(__m128i x)
+{
+  __m128i l = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1)));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(l, _mm_set1_epi8('f' + 1)));
+  return _mm_or_si128(digit, alpha);
+}
+
+
+/**
+ * Get a mask of the bytes that are hexadecimal digits
+ * 
+ * @param   x  The characters
+ * @return     0xFF in the bytes that are hexadecimal digits, 0x00 in the others
+ */
+static inline __attribute__((nothrow, const, target("avx2")))
+__m256i libkeccak_ishex32_avx2(__m256i x)
+{
+  __m256i l = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+  __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('0'), x),
+				      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), x));
+  __m256i alpha = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('a'), l),
+				      _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), l));
+  return _mm256_or_si256(digit, alpha);
+}
+
+
+/**
+ * Convert the beginning of a hexadecimal hashsum to binary
+ * representation, 16 bytes at a time
+ * 
+ * @param   output   Output array
+ * @param   hashsum  The hashsum to convert
+ * @param   n        The number of bytes to convert, half the number of digits
+ * @param   check    Whether to stop before the first 16 bytes that
+ *                   contain a character that is not a hexadecimal digit
+ * @return           The number of bytes that were converted
+ */
+static __attribute__((nonnull, nothrow, target("ssse3")))
+size_t libkeccak_unhex_ssse3(char* restrict output, const char* restrict hashsum, size_t n, int check)
+{
+  __m128i x, y;
+  size_t i;
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      x = _mm_loadu_si128((const __m128i*)(const void*)(hashsum + 2 * i + 0));
+      y = _mm_loadu_si128((const __m128i*)(const void*)(hashsum + 2 * i + 16));
+      if (check && (_mm_movemask_epi8(_mm_and_si128(libkeccak_ishex16_ssse3(x), libkeccak_ishex16_ssse3(y))) != 0xFFFF))
+	break;
+      _mm_storeu_si128((__m128i*)(void*)(output + i), libkeccak_unhex32_ssse3(x, y));
+    }
+  return i;
+}
+
+
+/**
+ * Convert the beginning of a hexadecimal hashsum to binary
+ * representation, 32 bytes at a time
+ * 
+ * @param   output   Output array
+ * @param   hashsum  The hashsum to convert
+ * @param   n        The number of bytes to convert, half the number of digits
+ * @param   check    Whether to stop before the first 32 bytes that
+ *                   contain a character that is not a hexadecimal digit
+ * @return           The number of bytes that were converted
+ */
+static __attribute__((nonnull, nothrow, target("avx2")))
+size_t libkeccak_unhex_avx2(char* restrict output, const char* restrict hashsum, size_t n, int check)
+{
+  __m256i x, y;
+  size_t i;
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      x = _mm256_loadu_si256((const __m256i*)(const void*)(hashsum + 2 * i + 0));
+      y = _mm256_loadu_si256((const __m256i*)(const void*)(hashsum + 2 * i + 32));
+      if (check && (~_mm256_movemask_epi8(_mm256_and_si256(libkeccak_ishex32_avx2(x), libkeccak_ishex32_avx2(y)))))
+	break;
+      _mm256_storeu_si256((__m256i*)(void*)(output + i), libkeccak_unhex64_avx2(x, y));
+    }
+  return i;
+}
+
+#endif
+
+
+/**
+ * Get the fastest hexadecimal conversion the CPU supports
+ * 
+ * @return  `HEX_GENERIC`, `HEX_SSSE3` or `HEX_AVX2`
+ */
+static __attribute__((nothrow, warn_unused_result))
+int libkeccak_hex_support(void)
+{
+  /* Threads may race to fill in the cache, but they all store
+   * the same value, so no more than atomicity is needed. */
+  static int supported = -1;
+  int ret = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+  if (ret >= 0)
+    return ret;
+  ret = HEX_GENERIC;
+#ifdef LIBKECCAK_HAVE_X86_HEX
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    ret = HEX_AVX2;
+  else if (__builtin_cpu_supports("ssse3"))
+    ret = HEX_SSSE3;
+#endif
+  __atomic_store_n(&supported, ret, __ATOMIC_RELAXED);
+  return ret;
+}
+
+
+/**
+ * Convert a binary hashsum to hexadecimal representation
  * 
  * @param  output   Output array, should have an allocation size of at least `2 * n + 1`
  * @param  hashsum  The hashsum to convert
  * @param  n        The size of `hashsum`
+ * @param  digits   The 16 hexadecimal digits
  */
-void libkeccak_behex_lower(char* restrict output, const char* restrict hashsum, size_t n)
+static __attribute__((nonnull, nothrow))
+void libkeccak_behex(char* restrict output, const char* restrict hashsum, size_t n, const char* restrict digits)
 {
+  size_t i = 0;
+#ifdef LIBKECCAK_HAVE_X86_HEX
+  int support = libkeccak_hex_support();
+  if (support == HEX_AVX2)
+    i = libkeccak_behex_avx2(output, hashsum, n, digits);
+  if (support >= HEX_SSSE3)
+    i += libkeccak_behex_ssse3(output + 2 * i, hashsum + i, n - i, digits);
+#endif
   output[2 * n] = '\0';
-  while (n--)
+  for (; i < n; i++)
     {
-      output[2 * n + 0] = "0123456789abcdef"[(hashsum[n] >> 4) & 15];
-      output[2 * n + 1] = "0123456789abcdef"[(hashsum[n] >> 0) & 15];
+      output[2 * i + 0] = digits[(hashsum[i] >> 4) & 15];
+      output[2 * i + 1] = digits[(hashsum[i] >> 0) & 15];
     }
 }
 
 
+/**
+ * Convert a binary hashsum to lower case hexadecimal representation
+ * 
+ * @param  output   Output array, should have an allocation size of at least `2 * n + 1`
+ * @param  hashsum  The hashsum to convert
+ * @param  n        The size of `hashsum`
+ */
+void libkeccak_behex_lower(char* restrict output, const char* restrict hashsum, size_t n)
+{
+  libkeccak_behex(output, hashsum, n, "0123456789abcdef");
+}
+
+
 /**
  * Convert a binary hashsum to upper case hexadecimal representation
  * 
@@ -49,12 +324,7 @@ void libkeccak_behex_lower(char* restrict output, const char* restrict hashsum,
  */
 void libkeccak_behex_upper(char* restrict output, const char* restrict hashsum, size_t n)
 {
-  output[2 * n] = '\0';
-  while (n--)
-    {
-      output[2 * n + 0] = "0123456789ABCDEF"[(hashsum[n] >> 4) & 15];
-      output[2 * n + 1] = "0123456789ABCDEF"[(hashsum[n] >> 0) & 15];
-    }
+  libkeccak_behex(output, hashsum, n, "0123456789ABCDEF");
 }
 
 
@@ -67,16 +337,88 @@ void libkeccak_behex_upper(char* restrict output, const char* restrict hashsum,
  */
 void libkeccak_unhex(char* restrict output, const char* restrict hashsum)
 {
-  size_t n = strlen(hashsum) / 2;
-  while (n--)
+  size_t i = 0, n = strlen(hashsum) / 2;
+#ifdef LIBKECCAK_HAVE_X86_HEX
+  int support = libkeccak_hex_support();
+  if (support == HEX_AVX2)
+    i = libkeccak_unhex_avx2(output, hashsum, n, 0);
+  if (support >= HEX_SSSE3)
+    i += libkeccak_unhex_ssse3(output + i, hashsum + 2 * i, n - i, 0);
+#endif
+  for (; i < n; i++)
     {
-      char a = hashsum[2 * n + 0];
-      char b = hashsum[2 * n + 1];
+      char a = hashsum[2 * i + 0];
+      char b = hashsum[2 * i + 1];
       
       a = (char)((a & 15) + (a > '9' ? 9 : 0));
       b = (char)((b & 15) + (b > '9' ? 9 : 0));
       
-      output[n] = (char)((a << 4) | b);
+      output[i] = (char)((a << 4) | b);
+    }
+}
+
+
+/**
+ * Get the value of a hexadecimal digit
+ * 
+ * @param   c  The character
+ * @return     The value of the digit, -1 if `c` is not a hexadecimal digit
+ */
+static __attribute__((nothrow, const, warn_unused_result))
+int libkeccak_hexval(char c)
+{
+  if (('0' <= c) && (c <= '9'))  return c - '0';
+  if (('a' <= c) && (c <= 'f'))  return c - 'a' + 10;
+  if (('A' <= c) && (c <= 'F'))  return c - 'A' + 10;
+  return -1;
+}
+
+
+/**
+ * Convert a hexadecimal hashsum (both lower case, upper case
+ * and mixed is supported) to binary representation, and
+ * fail if it contains anything but hexadecimal digits
+ * 
+ * @param   output   Output array, should have an allocation size of at least `len / 2`
+ * @param   hashsum  The hashsum to convert, need not be NUL-terminated
+ * @param   len      The number of characters in `hashsum`
+ * @param   bad      Output parameter for the index of the first character in
+ *                   `hashsum` that is not a hexadecimal digit, or `len` if
+ *                   `len` is odd, only set on failure, may be `NULL`
+ * @return           Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                   if `hashsum` is not a hexadecimal hashsum
+ */
+int libkeccak_unhex_checked(char* restrict output, const char* restrict hashsum, size_t len, size_t* restrict bad)
+{
+  size_t i = 0, n = len / 2;
+  int a, b;
+#ifdef LIBKECCAK_HAVE_X86_HEX
+  int support = libkeccak_hex_support();
+  if (support == HEX_AVX2)
+    i = libkeccak_unhex_avx2(output, hashsum, n, 1);
+  if (support >= HEX_SSSE3)
+    i += libkeccak_unhex_ssse3(output + i, hashsum + 2 * i, n - i, 1);
+#endif
+  for (; i < n; i++)
+    {
+      if (a = libkeccak_hexval(hashsum[2 * i + 0]), a < 0)
+	goto fail;
+      if (b = libkeccak_hexval(hashsum[2 * i + 1]), b < 0)
+	goto fail;
+      output[i] = (char)((a << 4) | b);
+    }
+  
+  if (len & 1)
+    {
+      if (bad != NULL)
+	*bad = len;
+      return errno = EINVAL, -1;
     }
+  return 0;
+  
+ fail:
+  if (bad != NULL)
+    *bad = 2 * i + (libkeccak_hexval(hashsum[2 * i]) < 0 ? 0 : 1);
+  return errno = EINVAL, -1;
 }
 
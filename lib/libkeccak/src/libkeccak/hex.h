@@ -58,5 +58,23 @@ LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull, nothrow)))
 void libkeccak_unhex(char* restrict output, const char* restrict hashsum);
 
 
+/**
+ * Convert a hexadecimal hashsum (both lower case, upper case
+ * and mixed is supported) to binary representation, and
+ * fail if it contains anything but hexadecimal digits
+ * 
+ * @param   output   Output array, should have an allocation size of at least `len / 2`
+ * @param   hashsum  The hashsum to convert, need not be NUL-terminated
+ * @param   len      The number of characters in `hashsum`
+ * @param   bad      Output parameter for the index of the first character in
+ *                   `hashsum` that is not a hexadecimal digit, or `len` if
+ *                   `len` is odd, only set on failure, may be `NULL`
+ * @return           Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                   if `hashsum` is not a hexadecimal hashsum
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 2), nothrow, warn_unused_result)))
+int libkeccak_unhex_checked(char* restrict output, const char* restrict hashsum, size_t len, size_t* restrict bad);
+
+
 #endif
 
@@ -0,0 +1,319 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "k12.h"
+
+#include "digest.h"
+#include "private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+
+/**
+ * The bitrate of TurboSHAKE128
+ */
+#define LIBKECCAK_K12_RATE  1344
+
+/**
+ * The number of rounds of Keccak-p[1600, nr] used by TurboSHAKE
+ */
+#define LIBKECCAK_K12_ROUNDS  12
+
+/**
+ * The size of the chaining values, in bytes
+ */
+#define LIBKECCAK_K12_CV_SIZE  32
+
+/**
+ * The domain separation byte, and first bit of the padding,
+ * for the leaves
+ */
+#define LIBKECCAK_K12_LEAF_PAD  0x0B
+
+
+
+/**
+ * Calculate the chaining values of whole chunks, across the library's
+ * worker threads and SIMD lanes, and absorb them into the final node
+ * 
+ * @param  state   The hashing state
+ * @param  chunks  The chunks
+ * @param  n       The number of chunks
+ */
+static __attribute__((nonnull, hot))
+void libkeccak_k12_chain(libkeccak_k12_state_t* restrict state, const char* restrict chunks, size_t n)
+{
+  char chains[LIBKECCAK_K12_BATCH * LIBKECCAK_K12_CV_SIZE];
+  size_t m;
+  
+  while (n)
+    {
+      m = n < LIBKECCAK_K12_BATCH ? n : LIBKECCAK_K12_BATCH;
+      libkeccak_hash_leaves(chains, LIBKECCAK_K12_CV_SIZE, chunks, LIBKECCAK_K12_CHUNK_SIZE, m,
+			    LIBKECCAK_K12_RATE, LIBKECCAK_K12_ROUNDS, LIBKECCAK_K12_LEAF_PAD);
+      libkeccak_fast_update(&(state->final), chains, m * LIBKECCAK_K12_CV_SIZE);
+      state->chains += m;
+      chunks += m * LIBKECCAK_K12_CHUNK_SIZE;
+      n -= m;
+    }
+}
+
+
+/**
+ * Encode an integer as done by `length_encode` in the
+ * KangarooTwelve specification: big-endian without leading
+ * zeroes, followed by the number of bytes used
+ * 
+ * @param   buf  Output parameter for the encoding, `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The length of the encoding
+ */
+static __attribute__((nonnull, nothrow))
+size_t libkeccak_k12_length_encode(char* restrict buf, size_t x)
+{
+  size_t n = 0, v;
+  for (v = x; v; v >>= 8)
+    n++;
+  for (v = n; v--; x >>= 8)
+    buf[v] = (char)x;
+  buf[n] = (char)n;
+  return n + 1;
+}
+
+
+/**
+ * Initialise a KangarooTwelve hashing-state
+ * 
+ * @param   state  The state that should be initialised
+ * @return         Zero on success, -1 on error
+ */
+int libkeccak_k12_initialise(libkeccak_k12_state_t* restrict state)
+{
+  libkeccak_spec_t spec;
+  spec.bitrate = LIBKECCAK_K12_RATE;
+  spec.capacity = 1600 - LIBKECCAK_K12_RATE;
+  spec.output = 256;
+  state->batch = NULL;
+  state->batch_length = 0;
+  state->length = 0;
+  state->chains = 0;
+  if (libkeccak_state_initialise(&(state->final), &spec) < 0)
+    return -1;
+  state->final.nr = LIBKECCAK_K12_ROUNDS;
+  libkeccak_state_set_kernel(&(state->final), LIBKECCAK_KERNEL_AUTO);
+  return 0;
+}
+
+
+/**
+ * Release resources allocation for a KangarooTwelve hashing-state
+ * and wipe sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_k12_destroy(libkeccak_k12_state_t* restrict state)
+{
+  volatile char* restrict batch;
+  size_t i;
+  if (state == NULL)
+    return;
+  libkeccak_state_destroy(&(state->final));
+  batch = state->batch;
+  for (i = 0; i < state->batch_length; i++)
+    batch[i] = 0;
+  free(state->batch);
+  state->batch = NULL;
+  state->batch_length = 0;
+}
+
+
+/**
+ * Absorb more of the message to the KangarooTwelve sponges
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_k12_update(libkeccak_k12_state_t* restrict state, const char* restrict msg, size_t msglen)
+{
+  static const char separator[8] = { 0x03, 0, 0, 0, 0, 0, 0, 0 };
+  size_t n;
+  
+  if (msglen == 0)
+    return 0;
+  if ((state->batch == NULL) && (msglen > LIBKECCAK_K12_CHUNK_SIZE - state->length))
+    {
+      state->batch = malloc(LIBKECCAK_K12_BATCH * LIBKECCAK_K12_CHUNK_SIZE * sizeof(char));
+      if (state->batch == NULL)
+	return -1;
+    }
+  
+  /* The first chunk is absorbed directly into the final node. */
+  if (state->length < LIBKECCAK_K12_CHUNK_SIZE)
+    {
+      n = LIBKECCAK_K12_CHUNK_SIZE - state->length;
+      n = msglen < n ? msglen : n;
+      libkeccak_fast_update(&(state->final), msg, n);
+      state->length += n;
+      msg += n, msglen -= n;
+      if (msglen == 0)
+	return 0;
+    }
+  
+  /* A second chunk turns the final node into the root of a tree. */
+  if (state->length == LIBKECCAK_K12_CHUNK_SIZE)
+    libkeccak_fast_update(&(state->final), separator, sizeof(separator));
+  state->length += msglen;
+  
+  if (state->batch_length)
+    {
+      n = LIBKECCAK_K12_BATCH * LIBKECCAK_K12_CHUNK_SIZE - state->batch_length;
+      n = msglen < n ? msglen : n;
+      memcpy(state->batch + state->batch_length, msg, n);
+      state->batch_length += n;
+      msg += n, msglen -= n;
+      if (state->batch_length < LIBKECCAK_K12_BATCH * LIBKECCAK_K12_CHUNK_SIZE)
+	return 0;
+      libkeccak_k12_chain(state, state->batch, LIBKECCAK_K12_BATCH);
+      state->batch_length = 0;
+    }
+  
+  /* Whole chunks are hashed where they are. */
+  n = msglen / LIBKECCAK_K12_CHUNK_SIZE;
+  libkeccak_k12_chain(state, msg, n);
+  msg += n * LIBKECCAK_K12_CHUNK_SIZE;
+  msglen -= n * LIBKECCAK_K12_CHUNK_SIZE;
+  
+  if (msglen)
+    memcpy(state->batch, msg, msglen);
+  state->batch_length = msglen;
+  return 0;
+}
+
+
+/**
+ * Absorb the last part of the message and the customisation
+ * string, and squeeze the KangarooTwelve tree
+ * 
+ * @param   state      The hashing state
+ * @param   msg        The rest of the message, may be `NULL`
+ * @param   msglen     The length of the partial message
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the hashsum
+ * @param   hashlen    The size of the hashsum, in bytes
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_k12_digest(libkeccak_k12_state_t* restrict state, const char* restrict msg, size_t msglen,
+			 const char* restrict custom, size_t customlen, char* restrict hashsum, size_t hashlen)
+{
+  char encoding[sizeof(size_t) + 3];
+  char chain[LIBKECCAK_K12_CV_SIZE];
+  size_t n;
+  
+  n = libkeccak_k12_length_encode(encoding, customlen);
+  if (libkeccak_k12_update(state, msg, msglen) < 0)
+    return -1;
+  if (libkeccak_k12_update(state, custom, customlen) < 0)
+    return -1;
+  if (libkeccak_k12_update(state, encoding, n) < 0)
+    return -1;
+  
+  state->final.n = (long)hashlen * 8;
+  if (state->length <= LIBKECCAK_K12_CHUNK_SIZE)
+    return libkeccak_fast_digest(&(state->final), NULL, 0, 0, "11", hashsum);
+  
+  /* Only the last chunk can be partial. */
+  n = state->batch_length / LIBKECCAK_K12_CHUNK_SIZE;
+  libkeccak_k12_chain(state, state->batch, n);
+  if (state->batch_length % LIBKECCAK_K12_CHUNK_SIZE)
+    {
+      libkeccak_oneshot(chain, sizeof(chain), state->batch + n * LIBKECCAK_K12_CHUNK_SIZE,
+			state->batch_length % LIBKECCAK_K12_CHUNK_SIZE,
+			LIBKECCAK_K12_RATE, LIBKECCAK_K12_ROUNDS, LIBKECCAK_K12_LEAF_PAD);
+      libkeccak_fast_update(&(state->final), chain, sizeof(chain));
+      state->chains += 1;
+    }
+  state->batch_length = 0;
+  
+  n = libkeccak_k12_length_encode(encoding, state->chains);
+  encoding[n++] = (char)0xFF;
+  encoding[n++] = (char)0xFF;
+  return libkeccak_fast_digest(&(state->final), encoding, n, 0, "01", hashsum);
+}
+
+
+/**
+ * Calculate the KangarooTwelve hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * @param   fd         The file descriptor of the file to hash
+ * @param   state      The hashing state, should not be initialised (memory leak otherwise)
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the hashsum
+ * @param   hashlen    The size of the hashsum, in bytes
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_k12sum_fd(int fd, libkeccak_k12_state_t* restrict state, const char* restrict custom,
+			size_t customlen, char* restrict hashsum, size_t hashlen)
+{
+  /* Reading a whole batch at a time lets `libkeccak_k12_update`
+   * hash the chunks in the buffer instead of copying them. */
+  size_t blksize = LIBKECCAK_K12_BATCH * LIBKECCAK_K12_CHUNK_SIZE;
+  char* restrict chunk;
+  ssize_t got;
+  int saved_errno;
+  
+  if (libkeccak_k12_initialise(state) < 0)
+    return -1;
+  
+  chunk = malloc(blksize * sizeof(char));
+  if (chunk == NULL)
+    return -1;
+  
+  for (;;)
+    {
+      got = read(fd, chunk, blksize);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  goto fail;
+	}
+      if (got == 0)
+	break;
+      if (libkeccak_k12_update(state, chunk, (size_t)got) < 0)
+	goto fail;
+    }
+  
+  free(chunk);
+  return libkeccak_k12_digest(state, NULL, 0, custom, customlen, hashsum, hashlen);
+  
+ fail:
+  saved_errno = errno;
+  free(chunk);
+  errno = saved_errno;
+  return -1;
+}
+
@@ -0,0 +1,151 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_K12_H
+#define LIBKECCAK_K12_H  1
+
+
+#include "state.h"
+#include "internal.h"
+
+#include <stddef.h>
+
+
+
+/**
+ * The size of the chunks KangarooTwelve splits its input into, in bytes
+ */
+#define LIBKECCAK_K12_CHUNK_SIZE  8192
+
+/**
+ * The number of chunks that are buffered before
+ * their chaining values are calculated in parallel
+ */
+#define LIBKECCAK_K12_BATCH  64
+
+
+
+/**
+ * Datastructure that describes the state of a KangarooTwelve hashing process
+ */
+typedef struct libkeccak_k12_state
+{
+  /**
+   * The sponge of the final node, it absorbs the first
+   * chunk and the chaining values of the other chunks
+   */
+  libkeccak_state_t final;
+  
+  /**
+   * Chunks, except the first, waiting for their chaining values
+   * to be calculated, `LIBKECCAK_K12_BATCH` chunks, `NULL` until
+   * the input is longer than one chunk
+   */
+  char* restrict batch;
+  
+  /**
+   * The number of bytes in `.batch`
+   */
+  size_t batch_length;
+  
+  /**
+   * The number of bytes of input that have been passed,
+   * including the customisation string and its length
+   */
+  size_t length;
+  
+  /**
+   * The number of chaining values absorbed into `.final`
+   */
+  size_t chains;
+  
+} libkeccak_k12_state_t;
+
+
+
+/**
+ * Initialise a KangarooTwelve hashing-state
+ * 
+ * @param   state  The state that should be initialised
+ * @return         Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull)))
+int libkeccak_k12_initialise(libkeccak_k12_state_t* restrict state);
+
+
+/**
+ * Release resources allocation for a KangarooTwelve hashing-state
+ * and wipe sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_k12_destroy(libkeccak_k12_state_t* restrict state);
+
+
+/**
+ * Absorb more of the message to the KangarooTwelve sponges
+ * 
+ * Whole chunks are not copied, they are hashed directly from
+ * `msg`, in parallel with each other when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message
+ * @return          Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_k12_update(libkeccak_k12_state_t* restrict state, const char* restrict msg, size_t msglen);
+
+
+/**
+ * Absorb the last part of the message and the customisation
+ * string, and squeeze the KangarooTwelve tree
+ * 
+ * @param   state      The hashing state
+ * @param   msg        The rest of the message, may be `NULL`
+ * @param   msglen     The length of the partial message
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the hashsum
+ * @param   hashlen    The size of the hashsum, in bytes
+ * @return             Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 6))))
+int libkeccak_k12_digest(libkeccak_k12_state_t* restrict state, const char* restrict msg, size_t msglen,
+			 const char* restrict custom, size_t customlen, char* restrict hashsum, size_t hashlen);
+
+
+/**
+ * Calculate the KangarooTwelve hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * @param   fd         The file descriptor of the file to hash
+ * @param   state      The hashing state, should not be initialised (memory leak otherwise)
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the hashsum
+ * @param   hashlen    The size of the hashsum, in bytes
+ * @return             Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(2, 5))))
+int libkeccak_k12sum_fd(int fd, libkeccak_k12_state_t* restrict state, const char* restrict custom,
+			size_t customlen, char* restrict hashsum, size_t hashlen);
+
+
+#endif
+
@@ -19,6 +19,11 @@
 #include "hmac.h"
 
 #include "../digest.h"
+#include "../private.h"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 
 
@@ -32,6 +37,12 @@
  */
 #define INNER_PAD  0x36
 
+/**
+ * The size of the buffer on the stack in which a message is
+ * bit-shifted, when the key is not a whole number of bytes
+ */
+#define LIBKECCAK_HMAC_CHUNK_SIZE  4096
+
 
 
 static void* (*volatile my_explicit_memset)(void*, int, size_t) = memset;
@@ -60,17 +71,17 @@ int libkeccak_hmac_set_key(libkeccak_hmac_state_t* restrict state, const char* r
   size = (size + 7) >> 3;
   key_bytes = (key_length + 7) >> 3;
   
-  if (size != key_bytes)
+  if (size != ((state->key_length + 7) >> 3))
     {
       state->key_opad = realloc(old = state->key_opad, 2 * size);
       if (state->key_opad == NULL)
 	return state->key_opad = old, -1;
-      state->key_ipad = state->key_opad + size / sizeof(char);
     }
+  state->key_ipad = state->key_opad + size / sizeof(char);
   
   memcpy(state->key_opad, key, key_bytes);
   if (key_length & 7)
-    state->key_opad[(key_bytes >> 3) - 1] &= (1 << (key_length & 7)) - 1;
+    state->key_opad[key_bytes - 1] &= (1 << (key_length & 7)) - 1;
   
   if ((size_t)(state->sponge.r) > key_length)
     __builtin_memset(state->key_opad + key_bytes / sizeof(char), 0, size - key_bytes);
@@ -80,11 +91,145 @@ int libkeccak_hmac_set_key(libkeccak_hmac_state_t* restrict state, const char* r
     state->key_opad[i] ^= OUTER_PAD;
   
   state->key_length = new_key_length;
+  state->leftover = 0;
+  state->midstates = NULL;
+  
+  return 0;
+}
+
+
+/**
+ * Reset the sponge of an HMAC-hashing state to a stored sponge
+ * 
+ * @param  state     The hashing state
+ * @param  midstate  The stored sponge
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_hmac_load_midstate(libkeccak_hmac_state_t* restrict state,
+				  const libkeccak_hmac_midstate_t* restrict midstate)
+{
+  memcpy(state->sponge.S, midstate->S, sizeof(midstate->S));
+  memcpy(state->sponge.M, midstate->M, midstate->mptr);
+  state->sponge.mptr = midstate->mptr;
+  state->leftover = midstate->leftover;
+  state->key_ipad = NULL;
+}
+
+
+/**
+ * Store the sponge of an HMAC-hashing state
+ * 
+ * @param  state     The hashing state
+ * @param  midstate  Output parameter for the sponge
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_hmac_store_midstate(const libkeccak_hmac_state_t* restrict state,
+				   libkeccak_hmac_midstate_t* restrict midstate)
+{
+  memcpy(midstate->S, state->sponge.S, sizeof(midstate->S));
+  memcpy(midstate->M, state->sponge.M, state->sponge.mptr);
+  midstate->mptr = state->sponge.mptr;
+  midstate->leftover = state->leftover;
+}
+
+
+/**
+ * Absorb the padded keys, and store the resulting sponges
+ * 
+ * @param   state      The state, must have been initialised or reset, and not have
+ *                     absorbed any part of a message, it is left ready for a message
+ * @param   midstates  Output parameter for the sponges
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_hmac_save_midstates(libkeccak_hmac_state_t* restrict state,
+				  libkeccak_hmac_midstates_t* restrict midstates)
+{
+  if (state->key_ipad == NULL)
+    return errno = EINVAL, -1;
+  
+  libkeccak_state_reset(&(state->sponge));
+  state->key_ipad = state->key_opad;
+  if (libkeccak_hmac_fast_update(state, NULL, 0) < 0)
+    return -1;
+  libkeccak_hmac_store_midstate(state, &(midstates->outer));
+  
+  libkeccak_state_reset(&(state->sponge));
+  state->key_ipad = state->key_opad + ((state->key_length + 7) >> 3) / sizeof(char);
+  if (libkeccak_hmac_fast_update(state, NULL, 0) < 0)
+    return -1;
+  libkeccak_hmac_store_midstate(state, &(midstates->inner));
   
+  state->midstates = midstates;
+  return 0;
+}
+
+
+/**
+ * Initialise an HMAC hashing-state according to hashing specifications
+ * 
+ * @param   state       The state that should be initialised
+ * @param   spec        The specifications for the state
+ * @param   key         The key
+ * @param   key_length  The length of key, in bits
+ * @return              Zero on success, -1 on error
+ */
+int libkeccak_hmac_initialise(libkeccak_hmac_state_t* restrict state, const libkeccak_spec_t* restrict spec,
+			      const char* restrict key, size_t key_length)
+{
+  int saved_errno;
+  if (libkeccak_state_initialise(&(state->sponge), spec) < 0)
+    return -1;
+  state->key_opad = NULL;
+  state->key_length = 0;
+  if (libkeccak_hmac_set_key(state, key, key_length) < 0)
+    return saved_errno = errno, libkeccak_state_destroy(&(state->sponge)), errno = saved_errno, -1;
+  state->leftover = 0;
+  return 0;
+}
+
+
+/**
+ * Reset an HMAC-hashing state according to hashing specifications,
+ * you can choose whether to change the key
+ * 
+ * @param   state       The state that should be reset
+ * @param   key         The new key, `NULL` to keep the old key
+ * @param   key_length  The length of key, in bits, ignored if `key == NULL`
+ * @return              Zero on success, -1 on error
+ */
+int libkeccak_hmac_reset(libkeccak_hmac_state_t* restrict state, const char* restrict key, size_t key_length)
+{
+  libkeccak_state_reset(&(state->sponge));
+  if (key != NULL)
+    return libkeccak_hmac_set_key(state, key, key_length);
+  state->key_ipad = state->key_opad + ((state->key_length + 7) >> 3) / sizeof(char);
+  state->leftover = 0;
+  state->midstates = NULL;
   return 0;
 }
 
 
+/**
+ * Reset an HMAC-hashing state to the sponges stored by
+ * `libkeccak_hmac_save_midstates`, this is a cheaper way
+ * to call `libkeccak_hmac_reset` without changing the key
+ * 
+ * @param  state      The state that should be reset, it must use the
+ *                    same key as the state the sponges were stored from
+ * @param  midstates  The stored sponges
+ */
+void libkeccak_hmac_restore_midstates(libkeccak_hmac_state_t* restrict state,
+				      const libkeccak_hmac_midstates_t* restrict midstates)
+{
+  memcpy(state->sponge.S, midstates->inner.S, sizeof(midstates->inner.S));
+  memcpy(state->sponge.M, midstates->inner.M, midstates->inner.mptr);
+  state->sponge.mptr = midstates->inner.mptr;
+  state->leftover = midstates->inner.leftover;
+  state->key_ipad = NULL;
+  state->midstates = midstates;
+}
+
+
 /**
  * Wipe sensitive data wihout freeing any data
  * 
@@ -100,7 +245,80 @@ void libkeccak_hmac_wipe(volatile libkeccak_hmac_state_t* restrict state)
   for (i = 0; i < size; i++)
     key_pads[i] = 0;
   state->leftover = 0;
-  __builtin_memset(state->buffer, 0, state->buffer_size);
+}
+
+
+/**
+ * Wrapper for `libkeccak_hmac_initialise` that also allocates the states
+ * 
+ * @param   spec        The specifications for the state
+ * @param   key         The key
+ * @param   key_length  The length of key, in bits
+ * @return              The state, `NULL` on error
+ */
+libkeccak_hmac_state_t* libkeccak_hmac_create(const libkeccak_spec_t* restrict spec,
+					      const char* restrict key, size_t key_length)
+{
+  libkeccak_hmac_state_t* restrict state;
+  int saved_errno;
+  
+  state = libkeccak_state_pool_take(LIBKECCAK_POOLED_HMAC, spec->bitrate, spec->capacity, spec->output);
+  if (state != NULL)
+    {
+      state->sponge.nr = 12 + (state->sponge.l << 1);
+      libkeccak_state_set_kernel(&(state->sponge), LIBKECCAK_KERNEL_AUTO);
+      if (libkeccak_hmac_reset(state, key, key_length))
+	return saved_errno = errno, libkeccak_hmac_fast_destroy(state), free(state), errno = saved_errno, NULL;
+      return state;
+    }
+  
+  state = malloc(sizeof(libkeccak_hmac_state_t));
+  if (state == NULL)
+    return NULL;
+  if (libkeccak_hmac_initialise(state, spec, key, key_length) == 0)
+    return state;
+  return saved_errno = errno, free(state), errno = saved_errno, NULL;
+}
+
+
+/**
+ * Wrapper for `libkeccak_fast_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+void libkeccak_hmac_fast_free(libkeccak_hmac_state_t* restrict state)
+{
+  if (state != NULL)
+    if (!libkeccak_state_pool_put(LIBKECCAK_POOLED_HMAC, state, state->sponge.r, state->sponge.c, state->sponge.n))
+      return;
+  libkeccak_hmac_fast_destroy(state);
+  free(state);
+}
+
+
+/**
+ * Wrapper for `libkeccak_hmac_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+void libkeccak_hmac_free(volatile libkeccak_hmac_state_t* restrict state)
+{
+#ifdef __GNUC__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wcast-qual"
+#endif
+  if (state != NULL)
+    {
+      libkeccak_hmac_wipe(state);
+      if (!libkeccak_state_pool_put(LIBKECCAK_POOLED_HMAC, (libkeccak_hmac_state_t*)state,
+				    state->sponge.r, state->sponge.c, state->sponge.n))
+	return;
+    }
+  libkeccak_hmac_destroy(state);
+  free((libkeccak_hmac_state_t*)state);
+#ifdef __GNUC__
+# pragma GCC diagnostic pop
+#endif
 }
 
 
@@ -124,15 +342,16 @@ int libkeccak_hmac_copy(libkeccak_hmac_state_t* restrict dest, const libkeccak_h
   
   dest->key_length = src->key_length;
   dest->leftover = src->leftover;
+  dest->midstates = src->midstates;
   
   size = (src->key_length + 7) >> 3;
   dest->key_opad = malloc(2 * size);
   if (dest->key_opad == NULL)
     return saved_errno = errno, libkeccak_state_destroy(&(dest->sponge)), errno = saved_errno, -1;
-  dest->key_ipad = dest->key_opad + size / sizeof(char);
   
-  memcpy(dest->key_opad, src->key_opad, size);
-  memcpy(dest->key_ipad, src->key_ipad, size);
+  memcpy(dest->key_opad, src->key_opad, 2 * size);
+  if (src->key_ipad != NULL)
+    dest->key_ipad = dest->key_opad + size / sizeof(char);
   
   return 0;
 }
@@ -168,22 +387,73 @@ size_t libkeccak_hmac_unmarshal(libkeccak_hmac_state_t* restrict state, const ch
   memcpy(state->key_opad, data, size);
   data += size / sizeof(char);
   
-  if (data[0])
-    {
-      state->key_ipad = state->key_opad + size / sizeof(char);
-      memcpy(state->key_ipad, state->key_opad, size);
-      for (i = 0; i < size / sizeof(char); i++)
-	state->key_ipad[i] ^= (char)(OUTER_PAD ^ INNER_PAD);
-    }
+  /* The inner key is recreated even if it has already been
+   * absorbed, because `libkeccak_hmac_reset` may need it. */
+  for (i = 0; i < size / sizeof(char); i++)
+    state->key_opad[size + i] = (char)(state->key_opad[i] ^ (OUTER_PAD ^ INNER_PAD));
+  state->key_ipad = data[0] ? state->key_opad + size / sizeof(char) : NULL;
   
   state->leftover = data[1];
-  state->buffer = NULL;
-  state->buffer_size = 0;
+  state->midstates = NULL;
   
   return parsed + sizeof(size_t) + size + 2 * sizeof(char);
 }
 
 
+/**
+ * Shift a message towards the end by a number of bits,
+ * filling the vacancy with the bits carried from the
+ * previous part of the message
+ * 
+ * @param   out     Output parameter for the shifted message, `msglen` bytes
+ * @param   msg     The message
+ * @param   msglen  The length of the message, in bytes
+ * @param   n       The number of bits to shift by, 1 to 7
+ * @param   carry   The bits carried from the previous part of the message,
+ *                  in the lowest `n` bits
+ * @return          The `n` highest bits of the message, in the lowest bits
+ */
+static __attribute__((nonnull, nothrow, hot))
+char libkeccak_hmac_shift(char* restrict out, const char* restrict msg, size_t msglen, int n, char carry)
+{
+  size_t i = 0;
+  unsigned c = (unsigned char)carry & ((1U << n) - 1);
+#ifdef LIBKECCAK_LITTLE_ENDIAN
+  /* In little-endian, shifting the bits of a message towards its end
+   * is a left-shift of each word, carrying its highest bits into the
+   * next word. */
+  uint64_t w, c64 = c;
+# ifdef __SSE2__
+  __m128i v, count = _mm_cvtsi32_si128(n), rcount = _mm_cvtsi32_si128(64 - n);
+  for (; i + 16 <= msglen; i += 16)
+    {
+      v = _mm_loadu_si128((const __m128i*)(msg + i));
+      _mm_storeu_si128((__m128i*)(out + i),
+		       _mm_or_si128(_mm_or_si128(_mm_sll_epi64(v, count),
+						 _mm_srl_epi64(_mm_slli_si128(v, 8), rcount)),
+				    _mm_set_epi64x(0, (long long)c64)));
+      memcpy(&w, msg + i + 8, sizeof(w));
+      c64 = w >> (64 - n);
+    }
+# endif
+  for (; i + 8 <= msglen; i += 8)
+    {
+      memcpy(&w, msg + i, sizeof(w));
+      c64 |= w << n;
+      memcpy(out + i, &c64, sizeof(c64));
+      c64 = w >> (64 - n);
+    }
+  c = (unsigned)c64;
+#endif
+  for (; i < msglen; i++)
+    {
+      out[i] = (char)(((unsigned char)(msg[i]) << n) | c);
+      c = (unsigned char)(msg[i]) >> (8 - n);
+    }
+  return (char)c;
+}
+
+
 /**
  * Absorb more, or the first part, of the message
  * without wiping sensitive data when possible
@@ -195,9 +465,9 @@ size_t libkeccak_hmac_unmarshal(libkeccak_hmac_state_t* restrict state, const ch
  */
 int libkeccak_hmac_fast_update(libkeccak_hmac_state_t* restrict state, const char* restrict msg, size_t msglen)
 {
-  char* old;
-  size_t i;
-  int n, cn;
+  char buffer[LIBKECCAK_HMAC_CHUNK_SIZE];
+  size_t n, chunk;
+  int bits;
   
   if (state->key_ipad != NULL)
     {
@@ -214,21 +484,17 @@ int libkeccak_hmac_fast_update(libkeccak_hmac_state_t* restrict state, const cha
   if (!(state->key_length & 7))
     return libkeccak_fast_update(&(state->sponge), msg, msglen);
   
-  if (msglen != state->buffer_size)
+  /* Whole blocks per chunk, so that the sponge can absorb them directly. */
+  bits = (int)(state->key_length & 7);
+  chunk = sizeof(buffer) / (size_t)(state->sponge.r >> 3) * (size_t)(state->sponge.r >> 3);
+  for (; msglen; msg += n, msglen -= n)
     {
-      state->buffer = realloc(old = state->buffer, state->buffer_size = msglen);
-      if (state->buffer == NULL)
-	return state->buffer = old, -1;
+      n = msglen < chunk ? msglen : chunk;
+      state->leftover = libkeccak_hmac_shift(buffer, msg, n, bits, state->leftover);
+      if (libkeccak_fast_update(&(state->sponge), buffer, n) < 0)
+	return -1;
     }
-  
-  n = (int)(state->key_length & 7);
-  cn = 8 - n;
-  for (i = 1; i < msglen; i++)
-    state->buffer[i] = (((unsigned char)(msg[i - 1])) >> cn) | (msg[i] << n);
-  state->buffer[0] = (state->leftover & ((1 << n) - 1)) | (msg[0] << n);
-  state->leftover = ((unsigned char)(msg[msglen - 1])) >> cn;
-  
-  return libkeccak_fast_update(&(state->sponge), state->buffer, msglen);
+  return 0;
 }
 
 
@@ -243,8 +509,9 @@ int libkeccak_hmac_fast_update(libkeccak_hmac_state_t* restrict state, const cha
  */
 int libkeccak_hmac_update(libkeccak_hmac_state_t* restrict state, const char* restrict msg, size_t msglen)
 {
-  size_t i;
-  int n, cn, r, saved_errno;
+  char buffer[LIBKECCAK_HMAC_CHUNK_SIZE];
+  size_t n, chunk, used;
+  int bits, r = 0;
   
   if (state->key_ipad != NULL)
     {
@@ -261,25 +528,18 @@ int libkeccak_hmac_update(libkeccak_hmac_state_t* restrict state, const char* re
   if (!(state->key_length & 7))
     return libkeccak_update(&(state->sponge), msg, msglen);
   
-  if (msglen != state->buffer_size)
+  bits = (int)(state->key_length & 7);
+  chunk = sizeof(buffer) / (size_t)(state->sponge.r >> 3) * (size_t)(state->sponge.r >> 3);
+  used = msglen < chunk ? msglen : chunk;
+  for (; msglen; msg += n, msglen -= n)
     {
-      free(state->buffer);
-      state->buffer = malloc(state->buffer_size = msglen);
-      if (state->buffer == NULL)
-	return -1;
+      n = msglen < chunk ? msglen : chunk;
+      state->leftover = libkeccak_hmac_shift(buffer, msg, n, bits, state->leftover);
+      if ((r = libkeccak_update(&(state->sponge), buffer, n)) < 0)
+	break;
     }
   
-  n = (int)(state->key_length & 7);
-  cn = 8 - n;
-  for (i = 1; i < msglen; i++)
-    state->buffer[i] = (((unsigned char)(msg[i - 1])) >> cn) | (msg[i] << n);
-  state->buffer[0] = (state->leftover & ((1 << n) - 1)) | (msg[0] << n);
-  state->leftover = ((unsigned char)(msg[msglen - 1])) >> cn;
-  
-  r = libkeccak_update(&(state->sponge), state->buffer, msglen);
-  saved_errno = errno;
-  my_explicit_bzero(state->buffer, msglen);
-  errno = saved_errno;
+  my_explicit_bzero(buffer, used);
   return r;
 }
 
@@ -302,28 +562,30 @@ int libkeccak_hmac_fast_digest(libkeccak_hmac_state_t* restrict state, const cha
 			       size_t bits, const char* restrict suffix, char* restrict hashsum)
 {
   size_t hashsize = state->sponge.n >> 3;
-  char* tmp = malloc(((state->sponge.n + 7) >> 3) * sizeof(char));
+  char stack_tmp[1600 / 8];
+  char* tmp = stack_tmp;
   char leftover[2];
   size_t newlen;
   int saved_errno;
   
-  if (tmp == NULL)
-    return -1;
+  if ((size_t)((state->sponge.n + 7) >> 3) > sizeof(stack_tmp))
+    if ((tmp = malloc(((state->sponge.n + 7) >> 3) * sizeof(char))) == NULL)
+      return -1;
   
+  if (libkeccak_hmac_fast_update(state, msg, msglen) < 0)
+    goto fail;
   if (!(state->key_length & 7))
     {
-      if (libkeccak_fast_digest(&(state->sponge), msg, msglen, bits, suffix, tmp) < 0)
+      if (libkeccak_fast_digest(&(state->sponge), msg + msglen, 0, bits, suffix, tmp) < 0)
 	goto fail;
       goto stage_2;
     }
   
-  if (libkeccak_hmac_fast_update(state, msg, msglen) < 0)
-    goto fail;
-  leftover[0] = state->leftover;
+  leftover[0] = (char)(state->leftover & ((1 << (state->key_length & 7)) - 1));
   if (bits)
     {
-      leftover[0] |= msg[msglen] >> (state->key_length & 7);
-      leftover[1] = ((unsigned char)(msg[msglen])) << (8 - (state->key_length & 7));
+      leftover[0] |= (char)(msg[msglen] << (state->key_length & 7));
+      leftover[1] = (char)(((unsigned char)(msg[msglen])) >> (8 - (state->key_length & 7)));
     }
   newlen = (state->key_length & 7) + bits;
   if (libkeccak_fast_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, tmp) < 0)
@@ -332,36 +594,42 @@ int libkeccak_hmac_fast_digest(libkeccak_hmac_state_t* restrict state, const cha
  stage_2:
   
   bits = state->sponge.n & 7;
-  state->key_ipad = state->key_opad;
-  if (libkeccak_hmac_fast_update(state, NULL, 0) < 0)
-    goto fail;
+  if (state->midstates != NULL)
+    libkeccak_hmac_load_midstate(state, &(state->midstates->outer));
+  else
+    {
+      libkeccak_state_reset(&(state->sponge));
+      state->key_ipad = state->key_opad;
+    }
   
+  if (libkeccak_hmac_fast_update(state, tmp, hashsize) < 0)
+    goto fail;
   if (!(state->key_length & 7))
     {
-      if (libkeccak_fast_digest(&(state->sponge), tmp, hashsize, bits, suffix, hashsum) < 0)
+      if (libkeccak_fast_digest(&(state->sponge), tmp + hashsize, 0, bits, suffix, hashsum) < 0)
 	goto fail;
       goto stage_3;
     }
   
-  if (libkeccak_hmac_fast_update(state, tmp, hashsize) < 0)
-    goto fail;
-  leftover[0] = state->leftover;
+  leftover[0] = (char)(state->leftover & ((1 << (state->key_length & 7)) - 1));
   if (bits)
     {
-      leftover[0] |= tmp[hashsize] >> (state->key_length & 7);
-      leftover[1] = ((unsigned char)(tmp[hashsize])) << (8 - (state->key_length & 7));
+      leftover[0] |= (char)(tmp[hashsize] << (state->key_length & 7));
+      leftover[1] = (char)(((unsigned char)(tmp[hashsize])) >> (8 - (state->key_length & 7)));
     }
   newlen = (state->key_length & 7) + bits;
-  if (libkeccak_fast_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, tmp) < 0)
+  if (libkeccak_fast_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, hashsum) < 0)
     goto fail;
   
  stage_3:
   
-  free(tmp);
+  if (tmp != stack_tmp)
+    free(tmp);
   return 0;
  fail:
   saved_errno = errno;
-  free(tmp);
+  if (tmp != stack_tmp)
+    free(tmp);
   return errno = saved_errno, -1;
 }
 
@@ -384,28 +652,30 @@ int libkeccak_hmac_digest(libkeccak_hmac_state_t* restrict state, const char* re
 			  size_t bits, const char* restrict suffix, char* restrict hashsum)
 {
   size_t hashsize = state->sponge.n >> 3;
-  char* tmp = malloc(((state->sponge.n + 7) >> 3) * sizeof(char));
+  char stack_tmp[1600 / 8];
+  char* tmp = stack_tmp;
   char leftover[2];
   size_t newlen;
   int saved_errno;
   
-  if (tmp == NULL)
-    return -1;
+  if ((size_t)((state->sponge.n + 7) >> 3) > sizeof(stack_tmp))
+    if ((tmp = malloc(((state->sponge.n + 7) >> 3) * sizeof(char))) == NULL)
+      return -1;
   
+  if (libkeccak_hmac_update(state, msg, msglen) < 0)
+    goto fail;
   if (!(state->key_length & 7))
     {
-      if (libkeccak_digest(&(state->sponge), msg, msglen, bits, suffix, tmp) < 0)
+      if (libkeccak_digest(&(state->sponge), msg + msglen, 0, bits, suffix, tmp) < 0)
 	goto fail;
       goto stage_2;
     }
   
-  if (libkeccak_hmac_update(state, msg, msglen) < 0)
-    goto fail;
-  leftover[0] = state->leftover;
+  leftover[0] = (char)(state->leftover & ((1 << (state->key_length & 7)) - 1));
   if (bits)
     {
-      leftover[0] |= msg[msglen] >> (state->key_length & 7);
-      leftover[1] = ((unsigned char)(msg[msglen])) << (8 - (state->key_length & 7));
+      leftover[0] |= (char)(msg[msglen] << (state->key_length & 7));
+      leftover[1] = (char)(((unsigned char)(msg[msglen])) >> (8 - (state->key_length & 7)));
     }
   newlen = (state->key_length & 7) + bits;
   if (libkeccak_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, tmp) < 0)
@@ -414,37 +684,258 @@ int libkeccak_hmac_digest(libkeccak_hmac_state_t* restrict state, const char* re
  stage_2:
   
   bits = state->sponge.n & 7;
-  state->key_ipad = state->key_opad;
-  if (libkeccak_hmac_update(state, NULL, 0) < 0)
-    goto fail;
+  if (state->midstates != NULL)
+    libkeccak_hmac_load_midstate(state, &(state->midstates->outer));
+  else
+    {
+      libkeccak_state_reset(&(state->sponge));
+      state->key_ipad = state->key_opad;
+    }
   
+  if (libkeccak_hmac_update(state, tmp, hashsize) < 0)
+    goto fail;
   if (!(state->key_length & 7))
     {
-      if (libkeccak_digest(&(state->sponge), tmp, hashsize, bits, suffix, hashsum) < 0)
+      if (libkeccak_digest(&(state->sponge), tmp + hashsize, 0, bits, suffix, hashsum) < 0)
 	goto fail;
       goto stage_3;
     }
   
-  if (libkeccak_hmac_update(state, tmp, hashsize) < 0)
-    goto fail;
-  leftover[0] = state->leftover;
+  leftover[0] = (char)(state->leftover & ((1 << (state->key_length & 7)) - 1));
   if (bits)
     {
-      leftover[0] |= tmp[hashsize] >> (state->key_length & 7);
-      leftover[1] = ((unsigned char)(tmp[hashsize])) << (8 - (state->key_length & 7));
+      leftover[0] |= (char)(tmp[hashsize] << (state->key_length & 7));
+      leftover[1] = (char)(((unsigned char)(tmp[hashsize])) >> (8 - (state->key_length & 7)));
     }
   newlen = (state->key_length & 7) + bits;
-  if (libkeccak_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, tmp) < 0)
+  if (libkeccak_digest(&(state->sponge), leftover, newlen >> 3, newlen & 7, suffix, hashsum) < 0)
     goto fail;
   
  stage_3:
   my_explicit_bzero(tmp, ((state->sponge.n + 7) >> 3) * sizeof(char));
-  free(tmp);
+  if (tmp != stack_tmp)
+    free(tmp);
   return 0;
  fail:
   saved_errno = errno;
   my_explicit_bzero(tmp, ((state->sponge.n + 7) >> 3) * sizeof(char));
-  free(tmp);
+  if (tmp != stack_tmp)
+    free(tmp);
   return errno = saved_errno, -1;
 }
 
+
+
+/**
+ * Prepare a sponge for the inner or outer hash of a message,
+ * by absorbing the padded key or loading the saved sponge
+ * 
+ * @param  sponge  The sponge, must use the same specifications as `key->sponge`
+ * @param  key     The state with the key
+ * @param  outer   Whether the sponge shall be prepared for the outer hash
+ */
+static __attribute__((nonnull, nothrow))
+void libkeccak_hmac_prime(libkeccak_state_t* restrict sponge, const libkeccak_hmac_state_t* restrict key, int outer)
+{
+  const libkeccak_hmac_midstate_t* midstate;
+  size_t size = (key->key_length + 7) >> 3;
+  
+  if (key->midstates != NULL)
+    {
+      midstate = outer ? &(key->midstates->outer) : &(key->midstates->inner);
+      memcpy(sponge->S, midstate->S, sizeof(midstate->S));
+      memcpy(sponge->M, midstate->M, midstate->mptr);
+      sponge->mptr = midstate->mptr;
+    }
+  else
+    {
+      libkeccak_state_reset(sponge);
+      libkeccak_fast_update(sponge, key->key_opad + (outer ? 0 : size / sizeof(char)), size);
+    }
+}
+
+
+/**
+ * Absorb the last part of up to four messages and squeeze
+ * the sponges, in lock-step when there are four of them
+ * 
+ * @param   sponges   The sponges
+ * @param   lanes     The number of sponges, 1 to 4
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the hashsums
+ * @return            Zero on success, -1 on error
+ */
+static __attribute__((nonnull(1, 3, 4, 6)))
+int libkeccak_hmac_digest_lanes(libkeccak_state_t* restrict const* sponges, int lanes,
+				const char* restrict const* msgs, const size_t* restrict msglens,
+				const char* restrict suffix, char* restrict const* hashsums)
+{
+  int lane;
+  if (lanes == 4)
+    return libkeccak_fast_digest_x4(sponges, msgs, msglens, suffix, hashsums);
+  for (lane = 0; lane < lanes; lane++)
+    if (libkeccak_fast_digest(sponges[lane], msgs[lane], msglens[lane], 0, suffix, hashsums[lane]) < 0)
+      return -1;
+  return 0;
+}
+
+
+/**
+ * Calculate the MAC of each message in an array, one by one,
+ * for keys that are not a whole number of bytes or MACs
+ * that are not a whole number of bytes or longer than 1600 bits
+ * 
+ * @param   keys      The states with the keys
+ * @param   nkeys     The number of elements in `keys`, 1 or `n`
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   nmsgs     The number of elements in `msgs` and `msglens`, 1 or `n`
+ * @param   n         The number of MACs to calculate
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the MACs
+ * @return            Zero on success, -1 on error
+ */
+static __attribute__((nonnull(1, 3, 4, 8)))
+int libkeccak_hmac_digest_serially(const libkeccak_hmac_state_t* restrict const* keys, size_t nkeys,
+				   const char* restrict const* msgs, const size_t* restrict msglens, size_t nmsgs,
+				   size_t n, const char* restrict suffix, char* restrict const* hashsums)
+{
+  libkeccak_hmac_state_t state;
+  const libkeccak_hmac_state_t* key;
+  size_t i, m;
+  int saved_errno;
+  
+  for (i = 0; i < n; i++)
+    {
+      key = keys[nkeys == 1 ? 0 : i];
+      m = nmsgs == 1 ? 0 : i;
+      if ((i == 0) || (nkeys > 1))
+	{
+	  if (i > 0)
+	    libkeccak_hmac_destroy(&state);
+	  if (libkeccak_hmac_copy(&state, key) < 0)
+	    return -1;
+	}
+      if (key->midstates != NULL)
+	libkeccak_hmac_restore_midstates(&state, key->midstates);
+      else
+	libkeccak_hmac_reset(&state, NULL, 0);
+      if (libkeccak_hmac_digest(&state, msgs[m], msglens[m], 0, suffix, hashsums[i]) < 0)
+	goto fail;
+    }
+  
+  libkeccak_hmac_destroy(&state);
+  return 0;
+ fail:
+  saved_errno = errno;
+  libkeccak_hmac_destroy(&state);
+  return errno = saved_errno, -1;
+}
+
+
+/**
+ * Calculate the MACs of many messages under one key, of one message under
+ * many keys, or of pairs of messages and keys, four at a time in lock-step
+ * when possible, and wipe sensitive data when possible
+ * 
+ * @param   keys      The states with the keys, they must use the same specifications and are
+ *                    not modified, their saved sponges are used if they have been restored
+ *                    with `libkeccak_hmac_restore_midstates`
+ * @param   nkeys     The number of elements in `keys`
+ * @param   msgs      The messages, the elements may be `NULL` if their lengths are zero
+ * @param   msglens   The lengths of the messages
+ * @param   nmsgs     The number of elements in `msgs` and `msglens`, 1 or `nkeys`
+ *                    unless `nkeys` is 1
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the MACs, one for each message or key,
+ *                    whichever is more
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_hmac_digest_many(const libkeccak_hmac_state_t* restrict const* keys, size_t nkeys,
+			       const char* restrict const* msgs, const size_t* restrict msglens, size_t nmsgs,
+			       const char* restrict suffix, char* restrict const* hashsums)
+{
+  libkeccak_state_t sponges[4];
+  libkeccak_state_t* sponge_ptrs[4];
+  const libkeccak_state_t* spec;
+  char inner[4][1600 / 8];
+  char* inner_ptrs[4];
+  const char* lane_msgs[4];
+  const char* lane_inner[4];
+  size_t lane_lens[4], inner_lens[4];
+  size_t i, k, n, mlen = 0, hashsize;
+  int lane, lanes, allocated = 0, serial = 0, saved_errno;
+  
+  n = nkeys > nmsgs ? nkeys : nmsgs;
+  if (((nkeys != n) && (nkeys != 1)) || ((nmsgs != n) && (nmsgs != 1)))
+    return errno = EINVAL, -1;
+  if (n == 0)
+    return 0;
+  
+  spec = &(keys[0]->sponge);
+  hashsize = (size_t)(spec->n >> 3);
+  for (k = 0; k < nkeys; k++)
+    {
+      if ((keys[k]->sponge.r != spec->r) || (keys[k]->sponge.c != spec->c) ||
+	  (keys[k]->sponge.n != spec->n) || (keys[k]->sponge.nr != spec->nr))
+	return errno = EINVAL, -1;
+      serial |= (int)(keys[k]->key_length & 7);
+    }
+  
+  /* The messages are shifted if the key is not a whole number of bytes,
+   * and the inner hash needs more than `msglen` if it is not either. */
+  if (serial || (spec->n & 7) || ((size_t)(spec->n >> 3) > sizeof(*inner)))
+    return libkeccak_hmac_digest_serially(keys, nkeys, msgs, msglens, nmsgs, n, suffix, hashsums);
+  
+  /* Make room for the padded messages, so that the sponges are not
+   * reallocated, which would leave copies of the messages behind. */
+  for (i = 0; i < nmsgs; i++)
+    if (mlen < msglens[i])
+      mlen = msglens[i];
+  mlen = (mlen > hashsize ? mlen : hashsize) + ((suffix ? strlen(suffix) : 0) + 7) / 8 + 2 * (size_t)(spec->r >> 3);
+  
+  for (; allocated < 4; allocated++)
+    {
+      sponges[allocated] = *spec;
+      sponges[allocated].embedded = 0;
+      sponges[allocated].mlen = mlen;
+      sponges[allocated].mptr = 0;
+      sponges[allocated].M = malloc(mlen * sizeof(char));
+      if (sponges[allocated].M == NULL)
+	goto fail;
+      sponge_ptrs[allocated] = sponges + allocated;
+      inner_ptrs[allocated] = inner[allocated];
+      lane_inner[allocated] = inner[allocated];
+      inner_lens[allocated] = hashsize;
+    }
+  
+  for (i = 0; i < n; i += (size_t)lanes)
+    {
+      lanes = n - i < 4 ? (int)(n - i) : 4;
+      for (lane = 0; lane < lanes; lane++)
+	{
+	  libkeccak_hmac_prime(sponges + lane, keys[nkeys == 1 ? 0 : i + (size_t)lane], 0);
+	  lane_msgs[lane] = msgs[nmsgs == 1 ? 0 : i + (size_t)lane];
+	  lane_lens[lane] = msglens[nmsgs == 1 ? 0 : i + (size_t)lane];
+	}
+      if (libkeccak_hmac_digest_lanes(sponge_ptrs, lanes, lane_msgs, lane_lens, suffix, inner_ptrs) < 0)
+	goto fail;
+      for (lane = 0; lane < lanes; lane++)
+	libkeccak_hmac_prime(sponges + lane, keys[nkeys == 1 ? 0 : i + (size_t)lane], 1);
+      if (libkeccak_hmac_digest_lanes(sponge_ptrs, lanes, lane_inner, inner_lens, suffix, hashsums + i) < 0)
+	goto fail;
+    }
+  
+  my_explicit_bzero(inner, sizeof(inner));
+  for (lane = 0; lane < allocated; lane++)
+    libkeccak_state_destroy(sponges + lane);
+  return 0;
+ fail:
+  saved_errno = errno;
+  my_explicit_bzero(inner, sizeof(inner));
+  for (lane = 0; lane < allocated; lane++)
+    libkeccak_state_destroy(sponges + lane);
+  return errno = saved_errno, -1;
+}
@@ -38,6 +38,57 @@
 
 
 
+/**
+ * The sponge of an HMAC-hashing process right after
+ * one of the padded keys has been absorbed
+ */
+typedef struct libkeccak_hmac_midstate
+{
+  /**
+   * The lanes of the sponge
+   */
+  int64_t S[25];
+  
+  /**
+   * The number of bytes in `.M`
+   */
+  size_t mptr;
+  
+  /**
+   * The end of the padded key, that did not fill a whole block
+   */
+  char M[1600 / 8];
+  
+  /**
+   * The bits of the padded key, that did not fill a whole byte
+   */
+  char leftover;
+  
+  char __pad[sizeof(void*) / sizeof(char) - 1];
+  
+} libkeccak_hmac_midstate_t;
+
+
+/**
+ * Datastructure that holds the sponges of an HMAC key, so that
+ * the padded key does not need to be absorbed for each message,
+ * it contains sensitive data and should be erased after use
+ */
+typedef struct libkeccak_hmac_midstates
+{
+  /**
+   * The sponge after absorbing the key XOR:ed with the inner pad
+   */
+  libkeccak_hmac_midstate_t inner;
+  
+  /**
+   * The sponge after absorbing the key XOR:ed with the outer pad
+   */
+  libkeccak_hmac_midstate_t outer;
+  
+} libkeccak_hmac_midstates_t;
+
+
 /**
  * Datastructure that describes the state of an HMAC-hashing process
  */
@@ -66,15 +117,11 @@ typedef struct libkeccak_hmac_state
   libkeccak_state_t sponge;
   
   /**
-   * Buffer used to temporarily store bit shift message if
-   * `.key_length` is not zero modulus 8
+   * The sponges to start from instead of absorbing the padded
+   * keys, set by `libkeccak_hmac_restore_midstates` and not
+   * marshalled, `NULL` if not used
    */
-  char* restrict buffer;
-  
-  /**
-   * The allocation size of `.buffer`
-   */
-  size_t buffer_size;
+  const libkeccak_hmac_midstates_t* midstates;
   
   /**
    * Part of feed key, message or digest that have not been passed yet
@@ -109,41 +156,24 @@ int libkeccak_hmac_set_key(libkeccak_hmac_state_t* restrict state, const char* r
  * @return              Zero on success, -1 on error
  */
 LIBKECCAK_GCC_ONLY(__attribute__((nonnull)))
-static inline
 int libkeccak_hmac_initialise(libkeccak_hmac_state_t* restrict state, const libkeccak_spec_t* restrict spec,
-			      const char* restrict key, size_t key_length)
-{
-  int saved_errno;
-  if (libkeccak_state_initialise(&(state->sponge), spec) < 0)
-    return -1;
-  if (libkeccak_hmac_set_key(state, key, key_length) < 0)
-    return saved_errno = errno, libkeccak_state_destroy(&(state->sponge)), errno = saved_errno, -1;
-  state->leftover = 0;
-  state->buffer = NULL;
-  state->buffer_size = 0;
-  return 0;
-}
+			      const char* restrict key, size_t key_length);
 
 
 /**
  * Wrapper for `libkeccak_hmac_initialise` that also allocates the states
  * 
+ * If the calling thread has released a state with the same specifications,
+ * that state is given the new key and reused instead of allocating one
+ * 
  * @param   spec        The specifications for the state
  * @param   key         The key
  * @param   key_length  The length of key, in bits
  * @return              The state, `NULL` on error
  */
-LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused, warn_unused_result, malloc)))
-static inline
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, warn_unused_result, malloc)))
 libkeccak_hmac_state_t* libkeccak_hmac_create(const libkeccak_spec_t* restrict spec,
-					      const char* restrict key, size_t key_length)
-{
-  libkeccak_hmac_state_t* restrict state = malloc(sizeof(libkeccak_hmac_state_t));
-  int saved_errno;
-  if ((state == NULL) || libkeccak_hmac_initialise(state, spec, key, key_length))
-    return saved_errno = errno, free(state), errno = saved_errno, NULL;
-  return state;
-}
+					      const char* restrict key, size_t key_length);
 
 
 /**
@@ -155,13 +185,40 @@ libkeccak_hmac_state_t* libkeccak_hmac_create(const libkeccak_spec_t* restrict s
  * @param   key_length  The length of key, in bits, ignored if `key == NULL`
  * @return              Zero on success, -1 on error
  */
-LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), unused)))
-static inline
-int libkeccak_hmac_reset(libkeccak_hmac_state_t* restrict state, const char* restrict key, size_t key_length)
-{
-  libkeccak_state_reset(&(state->sponge));
-  return key != NULL ? libkeccak_hmac_set_key(state, key, key_length) : 0;
-}
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_hmac_reset(libkeccak_hmac_state_t* restrict state, const char* restrict key, size_t key_length);
+
+
+/**
+ * Absorb the padded keys, and store the resulting sponges so that
+ * they can be restored for each message with
+ * `libkeccak_hmac_restore_midstates` instead of being absorbed again
+ * 
+ * @param   state      The state, must have been initialised or reset, and not have
+ *                     absorbed any part of a message, it is left ready for a message
+ * @param   midstates  Output parameter for the sponges
+ * @return             Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull)))
+int libkeccak_hmac_save_midstates(libkeccak_hmac_state_t* restrict state,
+				  libkeccak_hmac_midstates_t* restrict midstates);
+
+
+/**
+ * Reset an HMAC-hashing state to the sponges stored by
+ * `libkeccak_hmac_save_midstates`, this is a cheaper way
+ * to call `libkeccak_hmac_reset` without changing the key
+ * 
+ * `midstates` is used until the MAC has been digested,
+ * so it must not be modified or released before that
+ * 
+ * @param  state      The state that should be reset, it must use the
+ *                    same key as the state the sponges were stored from
+ * @param  midstates  The stored sponges
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow)))
+void libkeccak_hmac_restore_midstates(libkeccak_hmac_state_t* restrict state,
+				      const libkeccak_hmac_midstates_t* restrict midstates);
 
 
 /**
@@ -183,13 +240,11 @@ void libkeccak_hmac_fast_destroy(libkeccak_hmac_state_t* restrict state)
 {
   if (state == NULL)
     return;
+  libkeccak_state_fast_destroy(&(state->sponge));
   free(state->key_opad);
   state->key_opad = NULL;
   state->key_ipad = NULL;
   state->key_length = 0;
-  free(state->buffer);
-  state->buffer = NULL;
-  state->buffer_size = 0;
 }
 
 
@@ -205,50 +260,36 @@ void libkeccak_hmac_destroy(volatile libkeccak_hmac_state_t* restrict state)
   if (state == NULL)
     return;
   libkeccak_hmac_wipe(state);
+  libkeccak_state_destroy(&(state->sponge));
   free(state->key_opad);
   state->key_opad = NULL;
   state->key_ipad = NULL;
   state->key_length = 0;
   state->leftover = 0;
-  free(state->buffer);
-  state->buffer = NULL;
-  state->buffer_size = 0;
 }
 
 
 /**
  * Wrapper for `libkeccak_fast_destroy` that also frees the allocation of the state
  * 
+ * The state is kept for reuse by `libkeccak_hmac_create`
+ * instead if the calling thread's pool has room for it
+ * 
  * @param  state  The state that should be freed
  */
-LIBKECCAK_GCC_ONLY(__attribute__((unused)))
-static inline
-void libkeccak_hmac_fast_free(libkeccak_hmac_state_t* restrict state)
-{
-  libkeccak_hmac_fast_destroy(state);
-  free(state);
-}
+void libkeccak_hmac_fast_free(libkeccak_hmac_state_t* restrict state);
 
 
 /**
  * Wrapper for `libkeccak_hmac_destroy` that also frees the allocation of the state
  * 
+ * The state is wiped, and then kept for reuse by `libkeccak_hmac_create`
+ * instead if the calling thread's pool has room for it
+ * 
  * @param  state  The state that should be freed
  */
-LIBKECCAK_GCC_ONLY(__attribute__((unused, optimize("-O0"))))
-static inline
-void libkeccak_hmac_free(volatile libkeccak_hmac_state_t* restrict state)
-{
-#ifdef __GNUC__
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Wcast-qual"
-#endif
-  libkeccak_hmac_destroy(state);
-  free((libkeccak_hmac_state_t*)state);
-#ifdef __GNUC__
-# pragma GCC diagnostic pop
-#endif
-}
+LIBKECCAK_GCC_ONLY(__attribute__((optimize("-O0"))))
+void libkeccak_hmac_free(volatile libkeccak_hmac_state_t* restrict state);
 
 
 /**
@@ -275,7 +316,7 @@ libkeccak_hmac_state_t* libkeccak_hmac_duplicate(const libkeccak_hmac_state_t* r
   libkeccak_hmac_state_t* restrict dest = malloc(sizeof(libkeccak_hmac_state_t));
   int saved_errno;
   if ((dest == NULL) || libkeccak_hmac_copy(dest, src))
-    return saved_errno = errno, libkeccak_hmac_free(dest), errno = saved_errno, NULL;
+    return saved_errno = errno, free(dest), errno = saved_errno, NULL;
   return dest;
 }
 
@@ -411,5 +452,34 @@ int libkeccak_hmac_digest(libkeccak_hmac_state_t* restrict state, const char* re
 			  size_t bits, const char* restrict suffix, char* restrict hashsum);
 
 
+/**
+ * Calculate the MACs of many messages under one key, of one message under
+ * many keys, or of pairs of messages and keys, four at a time in lock-step
+ * when possible, and wipe sensitive data when possible
+ * 
+ * The lock-step is used when the keys and the MACs are whole numbers of
+ * bytes, and the MACs are at most 1600 bits long; otherwise the MACs are
+ * calculated one by one. The MACs are identical to those
+ * `libkeccak_hmac_digest` would have produced.
+ * 
+ * @param   keys      The states with the keys, they must use the same specifications and are
+ *                    not modified, their saved sponges are used if they have been restored
+ *                    with `libkeccak_hmac_restore_midstates`
+ * @param   nkeys     The number of elements in `keys`
+ * @param   msgs      The messages, the elements may be `NULL` if their lengths are zero
+ * @param   msglens   The lengths of the messages
+ * @param   nmsgs     The number of elements in `msgs` and `msglens`, 1 or `nkeys`
+ *                    unless `nkeys` is 1
+ * @param   suffix    The suffix concatenate to the messages, only '1':s and '0':s, and NUL-termination
+ * @param   hashsums  Output parameters for the MACs, one for each message or key,
+ *                    whichever is more
+ * @return            Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 3, 4, 7))))
+int libkeccak_hmac_digest_many(const libkeccak_hmac_state_t* restrict const* keys, size_t nkeys,
+			       const char* restrict const* msgs, const size_t* restrict msglens, size_t nmsgs,
+			       const char* restrict suffix, char* restrict const* hashsums);
+
+
 #endif
 
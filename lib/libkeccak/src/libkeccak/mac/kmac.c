@@ -0,0 +1,104 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "kmac.h"
+
+#include "../cshake.h"
+#include "../private.h"
+
+
+
+/**
+ * Initialise a KMAC hashing-state
+ * 
+ * @param   state         The state that should be initialised
+ * @param   semicapacity  128 for KMAC128, 256 for KMAC256
+ * @param   key           The key, `K`, may be `NULL` if `keylen` is zero
+ * @param   keylen        The length of the key, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string, in bytes
+ * @return                Zero on success, -1 on error
+ */
+int libkeccak_kmac_initialise(libkeccak_kmac_state_t* restrict state, long semicapacity,
+			      const char* restrict key, size_t keylen,
+			      const char* restrict custom, size_t customlen)
+{
+  static const char name[] = "KMAC";
+  libkeccak_spec_t spec;
+  size_t n;
+  
+  if ((semicapacity != 128) && (semicapacity != 256))
+    return errno = EINVAL, -1;
+  
+  libkeccak_spec_cshake(&spec, semicapacity, 2 * semicapacity);
+  if (libkeccak_state_initialise(&(state->sponge), &spec) < 0)
+    return -1;
+  libkeccak_cshake_initialise(&(state->sponge), name, sizeof(name) - 1, custom, customlen);
+  
+  n  = libkeccak_bytepad_begin(&(state->sponge));
+  n += libkeccak_encode_string(&(state->sponge), key, keylen);
+  libkeccak_bytepad_end(&(state->sponge), n);
+  return 0;
+}
+
+
+/**
+ * Absorb the last part of the message and fetch the MAC
+ * without wiping sensitive data when possible
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message, in bytes
+ * @param   hashsum  Output parameter for the MAC, may be `NULL`
+ * @param   hashlen  The size of the MAC, in bytes, `L / 8`
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_kmac_fast_digest(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen,
+			       char* restrict hashsum, size_t hashlen)
+{
+  char encoding[sizeof(size_t) + 1];
+  if (msglen && (libkeccak_fast_update(&(state->sponge), msg, msglen) < 0))
+    return -1;
+  state->sponge.n = (long)hashlen * 8;
+  return libkeccak_fast_digest(&(state->sponge), encoding, libkeccak_right_encode(encoding, hashlen * 8),
+			       0, LIBKECCAK_CSHAKE_SUFFIX, hashsum);
+}
+
+
+/**
+ * Absorb the last part of the message and fetch the MAC
+ * and wipe sensitive data when possible
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message, in bytes
+ * @param   hashsum  Output parameter for the MAC, may be `NULL`
+ * @param   hashlen  The size of the MAC, in bytes, `L / 8`
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_kmac_digest(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen,
+			  char* restrict hashsum, size_t hashlen)
+{
+  char encoding[sizeof(size_t) + 1];
+  if (msglen && (libkeccak_update(&(state->sponge), msg, msglen) < 0))
+    return -1;
+  state->sponge.n = (long)hashlen * 8;
+  return libkeccak_digest(&(state->sponge), encoding, libkeccak_right_encode(encoding, hashlen * 8),
+			  0, LIBKECCAK_CSHAKE_SUFFIX, hashsum);
+}
+
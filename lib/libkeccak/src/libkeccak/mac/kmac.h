@@ -0,0 +1,343 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_MAC_KMAC_H
+#define LIBKECCAK_MAC_KMAC_H  1
+
+
+/* KMAC, specified in NIST SP 800-185, is the keyed variant of cSHAKE.
+ * Unlike HMAC it needs only a single pass over the message, and since
+ * the key is padded to a whole number of blocks and absorbed first,
+ * the message is never bit-shifted.
+ */
+
+
+#include "../spec.h"
+#include "../state.h"
+#include "../digest.h"
+#include "../internal.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+
+
+
+/**
+ * Datastructure that describes the state of a KMAC-hashing process
+ */
+typedef struct libkeccak_kmac_state
+{
+  /**
+   * The state of the underlaying cSHAKE sponge,
+   * the key has already been absorbed
+   */
+  libkeccak_state_t sponge;
+  
+} libkeccak_kmac_state_t;
+
+
+
+/**
+ * Initialise a KMAC hashing-state
+ * 
+ * @param   state         The state that should be initialised
+ * @param   semicapacity  128 for KMAC128, 256 for KMAC256
+ * @param   key           The key, `K`, may be `NULL` if `keylen` is zero
+ * @param   keylen        The length of the key, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string, in bytes
+ * @return                Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_kmac_initialise(libkeccak_kmac_state_t* restrict state, long semicapacity,
+			      const char* restrict key, size_t keylen,
+			      const char* restrict custom, size_t customlen);
+
+
+/**
+ * Wrapper for `libkeccak_kmac_initialise` that also allocates the states
+ * 
+ * @param   semicapacity  128 for KMAC128, 256 for KMAC256
+ * @param   key           The key, `K`, may be `NULL` if `keylen` is zero
+ * @param   keylen        The length of the key, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string, in bytes
+ * @return                The state, `NULL` on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((unused, warn_unused_result, malloc)))
+static inline
+libkeccak_kmac_state_t* libkeccak_kmac_create(long semicapacity, const char* restrict key, size_t keylen,
+					      const char* restrict custom, size_t customlen)
+{
+  libkeccak_kmac_state_t* restrict state = malloc(sizeof(libkeccak_kmac_state_t));
+  int saved_errno;
+  if ((state == NULL) || libkeccak_kmac_initialise(state, semicapacity, key, keylen, custom, customlen))
+    return saved_errno = errno, free(state), errno = saved_errno, NULL;
+  return state;
+}
+
+
+/**
+ * Wipe sensitive data wihout freeing any data
+ * 
+ * @param  state  The state that should be wipe
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, unused, optimize("-O0"))))
+static inline
+void libkeccak_kmac_wipe(volatile libkeccak_kmac_state_t* restrict state)
+{
+  libkeccak_state_wipe(&(state->sponge));
+}
+
+
+/**
+ * Release resources allocation for a KMAC hashing-state without wiping sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((unused)))
+static inline
+void libkeccak_kmac_fast_destroy(libkeccak_kmac_state_t* restrict state)
+{
+  if (state == NULL)
+    return;
+  libkeccak_state_fast_destroy(&(state->sponge));
+}
+
+
+/**
+ * Release resources allocation for a KMAC hashing-state and wipe sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((unused, optimize("-O0"))))
+static inline
+void libkeccak_kmac_destroy(volatile libkeccak_kmac_state_t* restrict state)
+{
+  if (state == NULL)
+    return;
+  libkeccak_state_destroy(&(state->sponge));
+}
+
+
+/**
+ * Wrapper for `libkeccak_kmac_fast_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((unused)))
+static inline
+void libkeccak_kmac_fast_free(libkeccak_kmac_state_t* restrict state)
+{
+  libkeccak_kmac_fast_destroy(state);
+  free(state);
+}
+
+
+/**
+ * Wrapper for `libkeccak_kmac_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((unused, optimize("-O0"))))
+static inline
+void libkeccak_kmac_free(volatile libkeccak_kmac_state_t* restrict state)
+{
+#ifdef __GNUC__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wcast-qual"
+#endif
+  libkeccak_kmac_destroy(state);
+  free((libkeccak_kmac_state_t*)state);
+#ifdef __GNUC__
+# pragma GCC diagnostic pop
+#endif
+}
+
+
+/**
+ * Make a copy of a KMAC hashing-state
+ * 
+ * This is an inexpensive way to reuse a key: initialise one state,
+ * and copy it for each message instead of absorbing the key again
+ * 
+ * @param   dest  The slot for the duplicate, must not be initialised (memory leak otherwise)
+ * @param   src   The state to duplicate
+ * @return        Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused)))
+static inline
+int libkeccak_kmac_copy(libkeccak_kmac_state_t* restrict dest, const libkeccak_kmac_state_t* restrict src)
+{
+  return libkeccak_state_copy(&(dest->sponge), &(src->sponge));
+}
+
+
+/**
+ * A wrapper for `libkeccak_kmac_copy` that also allocates the duplicate
+ * 
+ * @param   src  The state to duplicate
+ * @return       The duplicate, `NULL` on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused, warn_unused_result, malloc)))
+static inline
+libkeccak_kmac_state_t* libkeccak_kmac_duplicate(const libkeccak_kmac_state_t* restrict src)
+{
+  libkeccak_kmac_state_t* restrict dest = malloc(sizeof(libkeccak_kmac_state_t));
+  int saved_errno;
+  if ((dest == NULL) || libkeccak_kmac_copy(dest, src))
+    return saved_errno = errno, free(dest), errno = saved_errno, NULL;
+  return dest;
+}
+
+
+/**
+ * Calculates the allocation size required for the second argument
+ * of `libkeccak_kmac_marshal` (`char* restrict data)`)
+ * 
+ * @param   state  The state as it will be marshalled by a subsequent call to `libkeccak_kmac_marshal`
+ * @return         The allocation size needed for the buffer to which the state will be marshalled
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, unused, warn_unused_result, pure)))
+static inline
+size_t libkeccak_kmac_marshal_size(const libkeccak_kmac_state_t* restrict state)
+{
+  return libkeccak_state_marshal_size(&(state->sponge));
+}
+
+
+/**
+ * Marshal a `libkeccak_kmac_state_t` into a buffer
+ * 
+ * @param   state  The state to marshal
+ * @param   data   The output buffer
+ * @return         The number of bytes stored to `data`
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, unused)))
+static inline
+size_t libkeccak_kmac_marshal(const libkeccak_kmac_state_t* restrict state, char* restrict data)
+{
+  return libkeccak_state_marshal(&(state->sponge), data);
+}
+
+
+/**
+ * Unmarshal a `libkeccak_kmac_state_t` from a buffer
+ * 
+ * @param   state  The slot for the unmarshalled state, must not be initialised (memory leak otherwise)
+ * @param   data   The input buffer
+ * @return         The number of bytes read from `data`, 0 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused)))
+static inline
+size_t libkeccak_kmac_unmarshal(libkeccak_kmac_state_t* restrict state, const char* restrict data)
+{
+  return libkeccak_state_unmarshal(&(state->sponge), data);
+}
+
+
+/**
+ * Gets the number of bytes the `libkeccak_kmac_state_t` stored
+ * at the beginning of `data` occupies
+ * 
+ * @param   data  The data buffer
+ * @return        The byte size of the stored state
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, unused, warn_unused_result, pure)))
+static inline
+size_t libkeccak_kmac_unmarshal_skip(const char* restrict data)
+{
+  return libkeccak_state_unmarshal_skip(data);
+}
+
+
+/**
+ * Absorb more, or the first part, of the message
+ * without wiping sensitive data when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message, in bytes
+ * @return          Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), unused)))
+static inline
+int libkeccak_kmac_fast_update(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen)
+{
+  return libkeccak_fast_update(&(state->sponge), msg, msglen);
+}
+
+
+/**
+ * Absorb more, or the first part, of the message
+ * and wipe sensitive data when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message, in bytes
+ * @return          Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), unused)))
+static inline
+int libkeccak_kmac_update(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen)
+{
+  return libkeccak_update(&(state->sponge), msg, msglen);
+}
+
+
+/**
+ * Absorb the last part of the message and fetch the MAC
+ * without wiping sensitive data when possible
+ * 
+ * The output length is part of the MAC, so a shorter
+ * MAC is not a prefix of a longer MAC
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message, in bytes
+ * @param   hashsum  Output parameter for the MAC, may be `NULL`
+ * @param   hashlen  The size of the MAC, in bytes, `L / 8`
+ * @return           Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_kmac_fast_digest(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen,
+			       char* restrict hashsum, size_t hashlen);
+
+
+/**
+ * Absorb the last part of the message and fetch the MAC
+ * and wipe sensitive data when possible
+ * 
+ * The output length is part of the MAC, so a shorter
+ * MAC is not a prefix of a longer MAC
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message, in bytes
+ * @param   hashsum  Output parameter for the MAC, may be `NULL`
+ * @param   hashlen  The size of the MAC, in bytes, `L / 8`
+ * @return           Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_kmac_digest(libkeccak_kmac_state_t* restrict state, const char* restrict msg, size_t msglen,
+			  char* restrict hashsum, size_t hashlen);
+
+
+#endif
+
@@ -0,0 +1,271 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "parallelhash.h"
+
+#include "cshake.h"
+#include "digest.h"
+#include "private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+
+/**
+ * The maximum number of chaining values calculated
+ * at the same time, before they are absorbed
+ */
+#define LIBKECCAK_PARALLELHASH_GROUP  64
+
+/**
+ * The domain separation byte, and first bit of the padding,
+ * for the blocks, which are hashed with SHAKE
+ */
+#define LIBKECCAK_PARALLELHASH_LEAF_PAD  0x1F
+
+
+
+/**
+ * Calculate the chaining values of whole blocks, across the library's
+ * worker threads and SIMD lanes, and absorb them into the final sponge
+ * 
+ * @param  state   The hashing state
+ * @param  blocks  The blocks
+ * @param  n       The number of blocks
+ */
+static __attribute__((nonnull, hot))
+void libkeccak_parallelhash_chain(libkeccak_parallelhash_state_t* restrict state,
+				  const char* restrict blocks, size_t n)
+{
+  char chains[LIBKECCAK_PARALLELHASH_GROUP * 512 / 8];
+  size_t m, cvlen = (size_t)(state->semicapacity / 4);
+  
+  while (n)
+    {
+      m = n < LIBKECCAK_PARALLELHASH_GROUP ? n : LIBKECCAK_PARALLELHASH_GROUP;
+      libkeccak_hash_leaves(chains, cvlen, blocks, state->block_size, m,
+			    state->final.r, 24, LIBKECCAK_PARALLELHASH_LEAF_PAD);
+      libkeccak_fast_update(&(state->final), chains, m * cvlen);
+      state->blocks += m;
+      blocks += m * state->block_size;
+      n -= m;
+    }
+}
+
+
+/**
+ * Initialise a ParallelHash hashing-state
+ * 
+ * @param   state         The state that should be initialised
+ * @param   semicapacity  128 for ParallelHash128, 256 for ParallelHash256
+ * @param   block_size    The block size, `B`, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string
+ * @return                Zero on success, -1 on error
+ */
+int libkeccak_parallelhash_initialise(libkeccak_parallelhash_state_t* restrict state, long semicapacity,
+				      size_t block_size, const char* restrict custom, size_t customlen)
+{
+  static const char name[] = "ParallelHash";
+  libkeccak_spec_t spec;
+  char encoding[sizeof(size_t) + 1];
+  int saved_errno;
+  
+  if (((semicapacity != 128) && (semicapacity != 256)) || (block_size == 0))
+    return errno = EINVAL, -1;
+  
+  state->batch_length = 0;
+  state->block_size = block_size;
+  state->blocks = 0;
+  state->semicapacity = semicapacity;
+  state->batch_blocks = LIBKECCAK_PARALLELHASH_BATCH_SIZE / block_size;
+  state->batch_blocks += !state->batch_blocks;
+  state->batch = NULL;
+  
+  libkeccak_spec_cshake(&spec, semicapacity, 2 * semicapacity);
+  if (libkeccak_state_initialise(&(state->final), &spec) < 0)
+    return -1;
+  state->batch = malloc(state->batch_blocks * block_size * sizeof(char));
+  if (state->batch == NULL)
+    return saved_errno = errno, libkeccak_state_destroy(&(state->final)), errno = saved_errno, -1;
+  libkeccak_cshake_initialise(&(state->final), name, sizeof(name) - 1, custom, customlen);
+  libkeccak_fast_update(&(state->final), encoding, libkeccak_left_encode(encoding, block_size));
+  return 0;
+}
+
+
+/**
+ * Release resources allocation for a ParallelHash hashing-state
+ * and wipe sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_parallelhash_destroy(libkeccak_parallelhash_state_t* restrict state)
+{
+  volatile char* restrict batch;
+  size_t i;
+  if (state == NULL)
+    return;
+  libkeccak_state_destroy(&(state->final));
+  batch = state->batch;
+  for (i = 0; i < state->batch_length; i++)
+    batch[i] = 0;
+  free(state->batch);
+  state->batch = NULL;
+  state->batch_length = 0;
+}
+
+
+/**
+ * Absorb more of the message to the ParallelHash sponges
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message
+ * @return          Zero on success
+ */
+int libkeccak_parallelhash_update(libkeccak_parallelhash_state_t* restrict state,
+				  const char* restrict msg, size_t msglen)
+{
+  size_t n, capacity = state->batch_blocks * state->block_size;
+  
+  if (state->batch_length)
+    {
+      n = capacity - state->batch_length;
+      n = msglen < n ? msglen : n;
+      memcpy(state->batch + state->batch_length, msg, n);
+      state->batch_length += n;
+      msg += n, msglen -= n;
+      if (state->batch_length < capacity)
+	return 0;
+      libkeccak_parallelhash_chain(state, state->batch, state->batch_blocks);
+      state->batch_length = 0;
+    }
+  
+  /* Whole blocks are hashed where they are. */
+  n = msglen / state->block_size;
+  libkeccak_parallelhash_chain(state, msg, n);
+  msg += n * state->block_size;
+  msglen -= n * state->block_size;
+  
+  if (msglen)
+    memcpy(state->batch, msg, msglen);
+  state->batch_length = msglen;
+  return 0;
+}
+
+
+/**
+ * Absorb the last part of the message and squeeze the ParallelHash sponge
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message
+ * @param   hashsum  Output parameter for the hashsum
+ * @param   hashlen  The size of the hashsum, in bytes, `L / 8`
+ * @return           Zero on success
+ */
+int libkeccak_parallelhash_digest(libkeccak_parallelhash_state_t* restrict state, const char* restrict msg,
+				  size_t msglen, char* restrict hashsum, size_t hashlen)
+{
+  char encoding[2 * (sizeof(size_t) + 1)];
+  char chain[512 / 8];
+  size_t n, rem, cvlen = (size_t)(state->semicapacity / 4);
+  
+  libkeccak_parallelhash_update(state, msg, msglen);
+  
+  /* Only the last block can be partial. */
+  n = state->batch_length / state->block_size;
+  rem = state->batch_length % state->block_size;
+  libkeccak_parallelhash_chain(state, state->batch, n);
+  if (rem)
+    {
+      libkeccak_oneshot(chain, cvlen, state->batch + n * state->block_size, rem,
+			state->final.r, 24, LIBKECCAK_PARALLELHASH_LEAF_PAD);
+      libkeccak_fast_update(&(state->final), chain, cvlen);
+      state->blocks += 1;
+    }
+  state->batch_length = 0;
+  
+  n  = libkeccak_right_encode(encoding, state->blocks);
+  n += libkeccak_right_encode(encoding + n, hashlen * 8);
+  state->final.n = (long)hashlen * 8;
+  return libkeccak_fast_digest(&(state->final), encoding, n, 0, LIBKECCAK_CSHAKE_SUFFIX, hashsum);
+}
+
+
+/**
+ * Calculate the ParallelHash hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * @param   fd            The file descriptor of the file to hash
+ * @param   state         The hashing state, should not be initialised (memory leak otherwise)
+ * @param   semicapacity  128 for ParallelHash128, 256 for ParallelHash256
+ * @param   block_size    The block size, `B`, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string
+ * @param   hashsum       Output parameter for the hashsum
+ * @param   hashlen       The size of the hashsum, in bytes
+ * @return                Zero on success, -1 on error
+ */
+int libkeccak_parallelhashsum_fd(int fd, libkeccak_parallelhash_state_t* restrict state, long semicapacity,
+				 size_t block_size, const char* restrict custom, size_t customlen,
+				 char* restrict hashsum, size_t hashlen)
+{
+  char* restrict chunk;
+  size_t blksize;
+  ssize_t got;
+  int saved_errno;
+  
+  if (libkeccak_parallelhash_initialise(state, semicapacity, block_size, custom, customlen) < 0)
+    return -1;
+  
+  /* Reading a whole batch at a time lets `libkeccak_parallelhash_update`
+   * hash the blocks in the buffer instead of copying them. */
+  blksize = state->batch_blocks * block_size;
+  chunk = malloc(blksize * sizeof(char));
+  if (chunk == NULL)
+    return -1;
+  
+  for (;;)
+    {
+      got = read(fd, chunk, blksize);
+      if (got < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  goto fail;
+	}
+      if (got == 0)
+	break;
+      libkeccak_parallelhash_update(state, chunk, (size_t)got);
+    }
+  
+  free(chunk);
+  return libkeccak_parallelhash_digest(state, NULL, 0, hashsum, hashlen);
+  
+ fail:
+  saved_errno = errno;
+  free(chunk);
+  errno = saved_errno;
+  return -1;
+}
+
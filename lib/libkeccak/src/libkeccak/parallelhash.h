@@ -0,0 +1,160 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_PARALLELHASH_H
+#define LIBKECCAK_PARALLELHASH_H  1
+
+
+#include "state.h"
+#include "internal.h"
+
+#include <stddef.h>
+
+
+
+/**
+ * The number of bytes of whole blocks that are buffered before their
+ * chaining values are calculated in parallel, at least one block
+ * is buffered regardless of the block size
+ */
+#define LIBKECCAK_PARALLELHASH_BATCH_SIZE  (512UL << 10)
+
+
+
+/**
+ * Datastructure that describes the state of a ParallelHash hashing process
+ */
+typedef struct libkeccak_parallelhash_state
+{
+  /**
+   * The cSHAKE sponge that absorbs the chaining values
+   */
+  libkeccak_state_t final;
+  
+  /**
+   * Blocks waiting for their chaining values
+   * to be calculated, `.batch_blocks` blocks
+   */
+  char* restrict batch;
+  
+  /**
+   * The number of bytes in `.batch`
+   */
+  size_t batch_length;
+  
+  /**
+   * The number of blocks `.batch` can hold
+   */
+  size_t batch_blocks;
+  
+  /**
+   * The block size, `B`, in bytes
+   */
+  size_t block_size;
+  
+  /**
+   * The number of chaining values absorbed into `.final`
+   */
+  size_t blocks;
+  
+  /**
+   * The security strength, 128 or 256, half the capacity
+   */
+  long semicapacity;
+  
+} libkeccak_parallelhash_state_t;
+
+
+
+/**
+ * Initialise a ParallelHash hashing-state
+ * 
+ * @param   state         The state that should be initialised
+ * @param   semicapacity  128 for ParallelHash128, 256 for ParallelHash256
+ * @param   block_size    The block size, `B`, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string
+ * @return                Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_parallelhash_initialise(libkeccak_parallelhash_state_t* restrict state, long semicapacity,
+				      size_t block_size, const char* restrict custom, size_t customlen);
+
+
+/**
+ * Release resources allocation for a ParallelHash hashing-state
+ * and wipe sensitive data
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_parallelhash_destroy(libkeccak_parallelhash_state_t* restrict state);
+
+
+/**
+ * Absorb more of the message to the ParallelHash sponges
+ * 
+ * Whole blocks are not copied, they are hashed directly from
+ * `msg`, in parallel with each other when possible
+ * 
+ * @param   state   The hashing state
+ * @param   msg     The partial message
+ * @param   msglen  The length of the partial message
+ * @return          Zero on success
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1))))
+int libkeccak_parallelhash_update(libkeccak_parallelhash_state_t* restrict state,
+				  const char* restrict msg, size_t msglen);
+
+
+/**
+ * Absorb the last part of the message and squeeze the ParallelHash sponge
+ * 
+ * @param   state    The hashing state
+ * @param   msg      The rest of the message, may be `NULL`
+ * @param   msglen   The length of the partial message
+ * @param   hashsum  Output parameter for the hashsum
+ * @param   hashlen  The size of the hashsum, in bytes, `L / 8`
+ * @return           Zero on success
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1, 4))))
+int libkeccak_parallelhash_digest(libkeccak_parallelhash_state_t* restrict state, const char* restrict msg,
+				  size_t msglen, char* restrict hashsum, size_t hashlen);
+
+
+/**
+ * Calculate the ParallelHash hashsum of a file,
+ * the content of the file is assumed non-sensitive
+ * 
+ * @param   fd            The file descriptor of the file to hash
+ * @param   state         The hashing state, should not be initialised (memory leak otherwise)
+ * @param   semicapacity  128 for ParallelHash128, 256 for ParallelHash256
+ * @param   block_size    The block size, `B`, in bytes
+ * @param   custom        The customisation string, `S`, may be `NULL` if `customlen` is zero
+ * @param   customlen     The length of the customisation string
+ * @param   hashsum       Output parameter for the hashsum
+ * @param   hashlen       The size of the hashsum, in bytes
+ * @return                Zero on success, -1 on error
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(2, 7))))
+int libkeccak_parallelhashsum_fd(int fd, libkeccak_parallelhash_state_t* restrict state, long semicapacity,
+				 size_t block_size, const char* restrict custom, size_t customlen,
+				 char* restrict hashsum, size_t hashlen);
+
+
+#endif
+
@@ -0,0 +1,229 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "private.h"
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+
+
+/**
+ * The maximum number of worker threads
+ */
+#define LIBKECCAK_POOL_MAX  63
+
+
+
+/**
+ * Serialises submissions, a caller that cannot
+ * acquire it does its work by itself
+ */
+static pthread_mutex_t submit_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Protects `job`
+ */
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when a job is submitted
+ */
+static pthread_cond_t job_submitted = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Signalled when the last call of a job has returned
+ */
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Makes sure the worker threads are only started once
+ */
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+/**
+ * The number of started worker threads
+ */
+static size_t pool_threads = 0;
+
+/**
+ * The current job
+ */
+static struct
+{
+  /**
+   * The function to call
+   */
+  void (*fn)(void*, size_t);
+  
+  /**
+   * The first argument for `fn`
+   */
+  void* arg;
+  
+  /**
+   * The number of calls to make
+   */
+  size_t n;
+  
+  /**
+   * The index of the next call to make
+   */
+  size_t next;
+  
+  /**
+   * The number of calls that have returned
+   */
+  size_t done;
+  
+  /**
+   * Incremented for each submitted job
+   */
+  unsigned long generation;
+  
+} job;
+
+
+
+/**
+ * Make calls for the current job until there are none left,
+ * `job_mutex` must be held, and is held on return
+ */
+static void libkeccak_pool_work(void)
+{
+  void (*fn)(void*, size_t) = job.fn;
+  void* arg = job.arg;
+  size_t i;
+  while (job.next < job.n)
+    {
+      i = job.next++;
+      pthread_mutex_unlock(&job_mutex);
+      fn(arg, i);
+      pthread_mutex_lock(&job_mutex);
+      if (++job.done == job.n)
+	pthread_cond_broadcast(&job_finished);
+    }
+}
+
+
+/**
+ * The main function of the worker threads
+ * 
+ * @param   unused  Ignored
+ * @return          Does not return
+ */
+static __attribute__((noreturn))
+void* libkeccak_pool_worker(void* unused)
+{
+  unsigned long seen = 0;
+  (void) unused;
+  pthread_mutex_lock(&job_mutex);
+  for (;;)
+    {
+      while (job.generation == seen)
+	pthread_cond_wait(&job_submitted, &job_mutex);
+      seen = job.generation;
+      libkeccak_pool_work();
+    }
+}
+
+
+/**
+ * Forget the worker threads in the child after `fork`,
+ * they only exist in the parent
+ */
+static void libkeccak_pool_forked(void)
+{
+  pool_threads = 0;
+  pthread_mutex_init(&submit_mutex, NULL);
+  pthread_mutex_init(&job_mutex, NULL);
+}
+
+
+/**
+ * Start the worker threads
+ */
+static void libkeccak_pool_start(void)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  sigset_t all, old;
+  const char* env = getenv("LIBKECCAK_THREADS");
+  long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  
+  if (--n > LIBKECCAK_POOL_MAX)
+    n = LIBKECCAK_POOL_MAX;
+  if ((n <= 0) || pthread_atfork(NULL, NULL, libkeccak_pool_forked) || pthread_attr_init(&attr))
+    return;
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  
+  /* The workers inherit the signal mask, signals
+   * should be delivered to the application's threads. */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  while (n--)
+    if (pthread_create(&thread, &attr, libkeccak_pool_worker, NULL))
+      break;
+    else
+      pool_threads++;
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  pthread_attr_destroy(&attr);
+}
+
+
+/**
+ * Call `fn(arg, i)` for each `i` in [0, `n`), using the library's
+ * worker threads alongside the calling thread when possible
+ * 
+ * @param  n    The number of calls to make
+ * @param  fn   The function to call
+ * @param  arg  The first argument for `fn`
+ */
+void libkeccak_pool_run(size_t n, void (*fn)(void*, size_t), void* arg)
+{
+  size_t i;
+  
+  if (n > 1)
+    pthread_once(&pool_once, libkeccak_pool_start);
+  
+  if ((n <= 1) || (pool_threads == 0) || pthread_mutex_trylock(&submit_mutex))
+    {
+      for (i = 0; i < n; i++)
+	fn(arg, i);
+      return;
+    }
+  
+  pthread_mutex_lock(&job_mutex);
+  job.fn = fn;
+  job.arg = arg;
+  job.n = n;
+  job.next = 0;
+  job.done = 0;
+  job.generation++;
+  pthread_cond_broadcast(&job_submitted);
+  libkeccak_pool_work();
+  while (job.done < job.n)
+    pthread_cond_wait(&job_finished, &job_mutex);
+  pthread_mutex_unlock(&job_mutex);
+  
+  pthread_mutex_unlock(&submit_mutex);
+}
+
@@ -0,0 +1,220 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBKECCAK_PRIVATE_H
+#define LIBKECCAK_PRIVATE_H  1
+
+
+/* This header is not installed, it declares functions that
+ * are shared between the translation units of the library. */
+
+
+#include "state.h"
+#include "internal.h"
+
+#include <stddef.h>
+
+
+
+/**
+ * Defined if lanes and words are stored in little-endian,
+ * so that they can be loaded and stored whole
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+# define LIBKECCAK_LITTLE_ENDIAN  1
+#endif
+
+
+
+/**
+ * Calculate a Keccak-p[1600, nr] based sponge hash of a
+ * message consisting of whole bytes without a heap
+ * allocated state
+ * 
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  hashlen  The size of the hashsum in bytes, at most `r / 8`
+ * @param  msg      The message, may be `NULL` if `msglen` is zero
+ * @param  msglen   The length of the message
+ * @param  r        The bitrate, a multiple of 64
+ * @param  nr       The number of rounds, a positive even number at most 24
+ * @param  pad      The suffix and the first bit of the padding,
+ *                  as the byte they form at the end of the message
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow, visibility("hidden"))))
+void libkeccak_oneshot(char* restrict hashsum, size_t hashlen, const char* restrict msg, size_t msglen,
+		       long r, long nr, char pad);
+
+/**
+ * Calculate four Keccak-p[1600, nr] based sponge hashes of equally
+ * long messages consisting of whole bytes, in lock-step when possible,
+ * without heap allocated states
+ * 
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  hashlen   The size of each hashsum in bytes, at most `r / 8`
+ * @param  msgs      The messages
+ * @param  msglen    The length of each message
+ * @param  r         The bitrate, a multiple of 64
+ * @param  nr        The number of rounds, a positive even number at most 24
+ * @param  pad       The suffix and the first bit of the padding,
+ *                   as the byte they form at the end of the messages
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+void libkeccak_oneshot_x4(char* restrict const* hashsums, size_t hashlen, const char* restrict const* msgs,
+			  size_t msglen, long r, long nr, char pad);
+
+/**
+ * Calculate the chaining values of equally long leaves of a tree
+ * hashing mode, across the library's worker threads and four at a
+ * time when possible, each is a Keccak-p[1600, nr] based sponge hash
+ * 
+ * @param  chains   Output parameter for the chaining values, `n * cvlen` bytes
+ * @param  cvlen    The size of each chaining value in bytes, at most `r / 8`
+ * @param  leaves   The leaves, stored contiguously
+ * @param  leaflen  The length of each leaf
+ * @param  n        The number of leaves
+ * @param  r        The bitrate, a multiple of 64
+ * @param  nr       The number of rounds, a positive even number at most 24
+ * @param  pad      The suffix and the first bit of the padding,
+ *                  as the byte they form at the end of the leaves
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, visibility("hidden"))))
+void libkeccak_hash_leaves(char* restrict chains, size_t cvlen, const char* restrict leaves, size_t leaflen,
+			   size_t n, long r, long nr, char pad);
+
+/**
+ * Encode an integer as done by `left_encode` in NIST SP 800-185:
+ * the number of bytes used, followed by the integer in big-endian
+ * without leading zeroes, but at least one byte
+ * 
+ * @param   buf  Output parameter for the encoding, `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The length of the encoding
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+size_t libkeccak_left_encode(char* restrict buf, size_t x);
+
+/**
+ * Encode an integer as done by `right_encode` in NIST SP 800-185:
+ * the integer in big-endian without leading zeroes, but at least
+ * one byte, followed by the number of bytes used
+ * 
+ * @param   buf  Output parameter for the encoding, `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The length of the encoding
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+size_t libkeccak_right_encode(char* restrict buf, size_t x);
+
+/**
+ * Absorb a string as encoded by `encode_string` in NIST SP 800-185
+ * 
+ * @param   state  The hashing state
+ * @param   str    The string, may be `NULL` if `len` is zero
+ * @param   len    The length of the string, in bytes
+ * @return         The number of absorbed bytes
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(1), nothrow, visibility("hidden"))))
+size_t libkeccak_encode_string(libkeccak_state_t* restrict state, const char* restrict str, size_t len);
+
+/**
+ * Absorb the beginning of `bytepad` in NIST SP 800-185,
+ * the encoding of the rate
+ * 
+ * @param   state  The hashing state
+ * @return         The number of absorbed bytes
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+size_t libkeccak_bytepad_begin(libkeccak_state_t* restrict state);
+
+/**
+ * Absorb the end of `bytepad` in NIST SP 800-185,
+ * the zeroes up to the next multiple of the rate
+ * 
+ * @param  state  The hashing state
+ * @param  n      The number of bytes absorbed since `libkeccak_bytepad_begin`
+ *                was called, including the bytes it absorbed
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+void libkeccak_bytepad_end(libkeccak_state_t* restrict state, size_t n);
+
+/**
+ * `kind` for `libkeccak_state_pool_take` and `libkeccak_state_pool_put`
+ * for `libkeccak_state_t`
+ */
+#define LIBKECCAK_POOLED_STATE  0
+
+/**
+ * `kind` for `libkeccak_state_pool_take` and `libkeccak_state_pool_put`
+ * for `libkeccak_hmac_state_t`
+ */
+#define LIBKECCAK_POOLED_HMAC  1
+
+/**
+ * Take a released state from the calling thread's pool
+ * 
+ * The state is as it was when it was given to the pool,
+ * except that its sponge may have been wiped
+ * 
+ * @param   kind  `LIBKECCAK_POOLED_STATE` or `LIBKECCAK_POOLED_HMAC`
+ * @param   r     The bitrate
+ * @param   c     The capacity
+ * @param   n     The output size
+ * @return        The state, `NULL` if the pool has none with the specification
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nothrow, warn_unused_result, visibility("hidden"))))
+void* libkeccak_state_pool_take(long kind, long r, long c, long n);
+
+/**
+ * Give a released state to the calling thread's pool, the
+ * pool is bounded, and the states in it are freed with
+ * `libkeccak_state_fast_destroy` or `libkeccak_hmac_fast_destroy`
+ * and `free` when the thread exits or the pool is trimmed
+ * 
+ * @param   kind    `LIBKECCAK_POOLED_STATE` or `LIBKECCAK_POOLED_HMAC`
+ * @param   object  The state, allocated with `malloc`
+ * @param   r       The bitrate of the state
+ * @param   c       The capacity of the state
+ * @param   n       The output size of the state
+ * @return          Zero if the state was kept, -1 if the caller shall free it
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, visibility("hidden"))))
+int libkeccak_state_pool_put(long kind, void* object, long r, long c, long n);
+
+/**
+ * Call `fn(arg, i)` for each `i` in [0, `n`), using the library's
+ * worker threads alongside the calling thread when possible
+ * 
+ * The calls are made in no particular order, and perhaps concurrently,
+ * the function returns when all calls have returned. If the worker
+ * threads are busy with another caller or could not be started, all
+ * calls are made by the calling thread.
+ * 
+ * The number of worker threads is one less than the number of online
+ * processors, or one less than the value of the environment variable
+ * `LIBKECCAK_THREADS` if set when the first job is submitted.
+ * 
+ * @param  n    The number of calls to make
+ * @param  fn   The function to call
+ * @param  arg  The first argument for `fn`
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull(2), visibility("hidden"))))
+void libkeccak_pool_run(size_t n, void (*fn)(void*, size_t), void* arg);
+
+
+#endif
+
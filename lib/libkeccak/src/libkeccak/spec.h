@@ -41,6 +41,13 @@
  */
 #define LIBKECCAK_SHAKE_SUFFIX  "1111"
 
+/**
+ * Message suffix for cSHAKE hashing, unless both the function
+ * name and the customisation string are empty, then cSHAKE is
+ * SHAKE, see `libkeccak_cshake_suffix`
+ */
+#define LIBKECCAK_CSHAKE_SUFFIX  "00"
+
 
 /**
  * Invalid `libkeccak_spec_t.bitrate`: non-positive
@@ -162,6 +169,16 @@ void libkeccak_spec_rawshake(libkeccak_spec_t* restrict spec, long x, long d)
 #define libkeccak_spec_shake  libkeccak_spec_rawshake
 
 
+/**
+ * Fill in a `libkeccak_spec_t` for a cSHAKEx hashing
+ * 
+ * @param  spec:libkeccak_spec_t*  The specifications datastructure to fill in
+ * @param  x:long                  The value of x in `cSHAKEx`, half the capacity
+ * @param  d:long                  The output size
+ */
+#define libkeccak_spec_cshake  libkeccak_spec_rawshake
+
+
 /**
  * Check for errors in a `libkeccak_spec_t`
  * 
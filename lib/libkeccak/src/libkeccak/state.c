@@ -17,19 +17,21 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "state.h"
+#include "private.h"
 
 #include <string.h>
 
 
 
 /**
- * Initialise a state according to hashing specifications
+ * Set the parameters of a state according to hashing
+ * specifications, and reset the sponge
  * 
- * @param   state  The state that should be initialised
- * @param   spec   The specifications for the state
- * @return         Zero on success, -1 on error
+ * @param  state  The state that should be initialised
+ * @param  spec   The specifications for the state
  */
-int libkeccak_state_initialise(libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec)
+static __attribute__((nonnull, nothrow))
+void libkeccak_state_initialise_parameters(libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec)
 {
   long x;
   state->r = spec->bitrate;
@@ -46,9 +48,153 @@ int libkeccak_state_initialise(libkeccak_state_t* restrict state, const libkecca
   for (x = 0; x < 25; x++)
     state->S[x] = 0;
   state->mptr = 0;
-  state->mlen = (size_t)(state->r * state->b) >> 2;
+}
+
+
+/**
+ * Initialise a state according to hashing specifications
+ * 
+ * @param   state  The state that should be initialised
+ * @param   spec   The specifications for the state
+ * @return         Zero on success, -1 on error
+ */
+int libkeccak_state_initialise(libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec)
+{
+  libkeccak_state_initialise_parameters(state, spec);
+  state->mlen = (size_t)(state->r >> 3) << 1;
   state->M = malloc(state->mlen * sizeof(char));
-  return state->M == NULL ? -1 : 0;
+  state->embedded = 0;
+  if (state->M == NULL)
+    return -1;
+  libkeccak_state_set_kernel(state, LIBKECCAK_KERNEL_AUTO);
+  return 0;
+}
+
+
+/**
+ * Initialise a state with an embedded message buffer
+ * according to hashing specifications
+ * 
+ * @param   state  The state that should be initialised
+ * @param   spec   The specifications for the state
+ * @return         Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                 if the state size is greater than 1600 bits
+ */
+int libkeccak_embedded_state_initialise(libkeccak_embedded_state_t* restrict state,
+					const libkeccak_spec_t* restrict spec)
+{
+  if ((spec->bitrate < 0) || (spec->capacity < 0) || (spec->bitrate + spec->capacity > 1600))
+    return errno = EINVAL, -1;
+  libkeccak_state_initialise_parameters(&(state->state), spec);
+  state->state.mlen = sizeof(state->buffer);
+  state->state.M = state->buffer;
+  state->state.embedded = 1;
+  libkeccak_state_set_kernel(&(state->state), LIBKECCAK_KERNEL_AUTO);
+  return 0;
+}
+
+
+/**
+ * Wrapper for `libkeccak_state_initialise` that also allocates the states
+ * 
+ * @param   spec  The specifications for the state
+ * @return        The state, `NULL` on error
+ */
+libkeccak_state_t* libkeccak_state_create(const libkeccak_spec_t* restrict spec)
+{
+  libkeccak_state_t* restrict state;
+  int saved_errno;
+  
+  state = libkeccak_state_pool_take(LIBKECCAK_POOLED_STATE, spec->bitrate, spec->capacity, spec->output);
+  if (state != NULL)
+    {
+      state->nr = 12 + (state->l << 1);
+      libkeccak_state_reset(state);
+      libkeccak_state_set_kernel(state, LIBKECCAK_KERNEL_AUTO);
+      return state;
+    }
+  
+  state = malloc(sizeof(libkeccak_state_t));
+  if ((state == NULL) || libkeccak_state_initialise(state, spec))
+    return saved_errno = errno, free(state), errno = saved_errno, NULL;
+  return state;
+}
+
+
+/**
+ * Wrapper for `libkeccak_state_fast_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+void libkeccak_state_fast_free(libkeccak_state_t* restrict state)
+{
+  if ((state != NULL) && !state->embedded)
+    if (!libkeccak_state_pool_put(LIBKECCAK_POOLED_STATE, state, state->r, state->c, state->n))
+      return;
+  libkeccak_state_fast_destroy(state);
+  free(state);
+}
+
+
+/**
+ * Wrapper for `libkeccak_state_destroy` that also frees the allocation of the state
+ * 
+ * @param  state  The state that should be freed
+ */
+void libkeccak_state_free(volatile libkeccak_state_t* restrict state)
+{
+#ifdef __GNUC__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wcast-qual"
+#endif
+  if ((state != NULL) && !state->embedded)
+    {
+      libkeccak_state_wipe(state);
+      if (!libkeccak_state_pool_put(LIBKECCAK_POOLED_STATE, (libkeccak_state_t*)state, state->r, state->c, state->n))
+	return;
+    }
+  libkeccak_state_destroy(state);
+  free((libkeccak_state_t*)state);
+#ifdef __GNUC__
+# pragma GCC diagnostic pop
+#endif
+}
+
+
+/**
+ * Release resources allocation for a state without wiping sensitive data
+ * 
+ * The message buffer of a `libkeccak_embedded_state_t`
+ * is part of the state, and is therefore not freed
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_state_fast_destroy(libkeccak_state_t* restrict state)
+{
+  if (state == NULL)
+    return;
+  if (!state->embedded)
+    free(state->M);
+  state->M = NULL;
+}
+
+
+/**
+ * Release resources allocation for a state and wipe sensitive data
+ * 
+ * The message buffer of a `libkeccak_embedded_state_t`
+ * is part of the state, and is therefore not freed
+ * 
+ * @param  state  The state that should be destroyed
+ */
+void libkeccak_state_destroy(volatile libkeccak_state_t* restrict state)
+{
+  if (state == NULL)
+    return;
+  libkeccak_state_wipe(state);
+  if (!state->embedded)
+    free(state->M);
+  state->M = NULL;
 }
 
 
@@ -101,6 +247,7 @@ int libkeccak_state_copy(libkeccak_state_t* restrict dest, const libkeccak_state
 {
   memcpy(dest, src, sizeof(libkeccak_state_t));
   dest->M = malloc(src->mlen * sizeof(char));
+  dest->embedded = 0;
   if (dest->M == NULL)
     return -1;
   memcpy(dest->M, src->M, src->mptr * sizeof(char));
@@ -108,6 +255,62 @@ int libkeccak_state_copy(libkeccak_state_t* restrict dest, const libkeccak_state
 }
 
 
+/**
+ * A wrapper for `libkeccak_state_copy` that also allocates the duplicate
+ * 
+ * @param   src  The state to duplicate
+ * @return       The duplicate, `NULL` on error
+ */
+libkeccak_state_t* libkeccak_state_duplicate(const libkeccak_state_t* restrict src)
+{
+  libkeccak_state_t* restrict dest;
+  size_t mlen;
+  char* M;
+  int saved_errno;
+  
+  dest = libkeccak_state_pool_take(LIBKECCAK_POOLED_STATE, src->r, src->c, src->n);
+  if ((dest != NULL) && (dest->mlen < src->mptr))
+    libkeccak_state_fast_destroy(dest), free(dest), dest = NULL;
+  if (dest != NULL)
+    {
+      M = dest->M, mlen = dest->mlen;
+      memcpy(dest, src, sizeof(libkeccak_state_t));
+      dest->M = M, dest->mlen = mlen;
+      dest->embedded = 0;
+      memcpy(dest->M, src->M, src->mptr * sizeof(char));
+      return dest;
+    }
+  
+  dest = malloc(sizeof(libkeccak_state_t));
+  if ((dest != NULL) && libkeccak_state_copy(dest, src))
+    return saved_errno = errno, free(dest), errno = saved_errno, NULL;
+  return dest;
+}
+
+
+/**
+ * Make a copy of a state into a state with an embedded message buffer
+ * 
+ * @param   dest  The slot for the duplicate
+ * @param   src   The state to duplicate
+ * @return        Zero on success, -1 on error; `errno` is set to `EINVAL` if
+ *                the state size of `src` is greater than 1600 bits or its
+ *                message buffer holds more than `LIBKECCAK_EMBEDDED_BUFFER_SIZE`
+ *                bytes
+ */
+int libkeccak_embedded_state_copy(libkeccak_embedded_state_t* restrict dest, const libkeccak_state_t* restrict src)
+{
+  if ((src->b > 1600) || (src->mptr > sizeof(dest->buffer)))
+    return errno = EINVAL, -1;
+  memcpy(&(dest->state), src, sizeof(libkeccak_state_t));
+  memcpy(dest->buffer, src->M, src->mptr * sizeof(char));
+  dest->state.mlen = sizeof(dest->buffer);
+  dest->state.M = dest->buffer;
+  dest->state.embedded = 1;
+  return 0;
+}
+
+
 /**
  * Marshal a `libkeccak_state_t` into a buffer
  * 
@@ -132,7 +335,7 @@ size_t libkeccak_state_marshal(const libkeccak_state_t* restrict state, char* re
   set(size_t, mlen);
   memcpy(data, state->M, state->mptr * sizeof(char));
   data += state->mptr;
-  return sizeof(libkeccak_state_t) - sizeof(char*) + state->mptr * sizeof(char);
+  return 7 * sizeof(long) + 26 * sizeof(int64_t) + 2 * sizeof(size_t) + state->mptr * sizeof(char);
 #undef set
 }
 
@@ -159,12 +362,14 @@ size_t libkeccak_state_unmarshal(libkeccak_state_t* restrict state, const char*
   data += sizeof(state->S) / sizeof(char);
   get(size_t, mptr);
   get(size_t, mlen);
-  state->M = malloc(state->mptr * sizeof(char));
+  state->M = malloc(state->mlen * sizeof(char));
+  state->embedded = 0;
   if (state->M == NULL)
     return 0;
   memcpy(state->M, data, state->mptr * sizeof(char));
   data += state->mptr;
-  return sizeof(libkeccak_state_t) - sizeof(char*) + state->mptr * sizeof(char);
+  libkeccak_state_set_kernel(state, LIBKECCAK_KERNEL_AUTO);
+  return 7 * sizeof(long) + 26 * sizeof(int64_t) + 2 * sizeof(size_t) + state->mptr * sizeof(char);
 #undef get
 }
 
@@ -179,6 +384,6 @@ size_t libkeccak_state_unmarshal(libkeccak_state_t* restrict state, const char*
 size_t libkeccak_state_unmarshal_skip(const char* restrict data)
 {
   data += (7 * sizeof(long) + 26 * sizeof(int64_t)) / sizeof(char);
-  return sizeof(libkeccak_state_t) - sizeof(char*) + *(const size_t*)data * sizeof(char);
+  return 7 * sizeof(long) + 26 * sizeof(int64_t) + 2 * sizeof(size_t) + *(const size_t*)data * sizeof(char);
 }
 
@@ -31,10 +31,47 @@
 
 
 
+/**
+ * Select the fastest Keccak-f kernel the CPU supports
+ */
+#define LIBKECCAK_KERNEL_AUTO  0
+
+/**
+ * Portable Keccak-f kernel, the only kernel
+ * available for word sizes other than 64 bits
+ */
+#define LIBKECCAK_KERNEL_GENERIC  1
+
+/**
+ * Keccak-f[1600] kernel compiled for BMI and BMI2 (x86 only)
+ */
+#define LIBKECCAK_KERNEL_BMI2  2
+
+/**
+ * Keccak-f[1600] kernel compiled for AVX2, BMI and BMI2 (x86 only)
+ */
+#define LIBKECCAK_KERNEL_AVX2  3
+
+/**
+ * Portable lane-complementing Keccak-f[1600] kernel,
+ * it uses fewer NOT operations than `LIBKECCAK_KERNEL_GENERIC`
+ */
+#define LIBKECCAK_KERNEL_COMPLEMENT  4
+
+/**
+ * The greatest value of the `LIBKECCAK_KERNEL_*` constants
+ */
+#define LIBKECCAK_KERNEL_MAX  4
+
+
+
 /**
  * Datastructure that describes the state of a hashing process
  * 
  * The `char`-size of the output hashsum is calculated by `(.n + 7) / 8`
+ * 
+ * The fields used for every block come first, so that they
+ * share cache lines with the end of the lanes
  */
 typedef struct libkeccak_state
 {
@@ -48,6 +85,40 @@ typedef struct libkeccak_state
    */
   long r;
   
+  /**
+   * Pointer for `M`
+   */
+  size_t mptr;
+  
+  /**
+   * Left over water to fill the sponge with at next update
+   */
+  char* M;
+  
+  /**
+   * The Keccak-f permutation kernel selected for the state,
+   * this is not marshalled
+   */
+  void (*permute)(struct libkeccak_state* restrict state);
+  
+  /**
+   * The absorption kernel selected for the state, it absorbs
+   * all whole blocks in its input, this is not marshalled
+   */
+  void (*absorb)(struct libkeccak_state* restrict state, const char* restrict message, size_t len);
+  
+  /**
+   * 12 + 2ℓ, the number of rounds, may be lowered before calling
+   * `libkeccak_state_set_kernel` to use the last `.nr` rounds,
+   * that is Keccak-p instead of Keccak-f
+   */
+  long nr;
+  
+  /**
+   * Size of `M`
+   */
+  size_t mlen;
+  
   /**
    * The capacity
    */
@@ -79,24 +150,13 @@ typedef struct libkeccak_state
   long l;
   
   /**
-   * 12 + 2ℓ, the number of rounds
+   * Whether `M` is the buffer of a `libkeccak_embedded_state_t`
+   * rather than allocated, if so it is never reallocated or
+   * freed, this is not marshalled
    */
-  long nr;
+  char embedded;
   
-  /**
-   * Pointer for `M`
-   */
-  size_t mptr;
-  
-  /**
-   * Size of `M`
-   */
-  size_t mlen;
-  
-  /**
-   * Left over water to fill the sponge with at next update
-   */
-  char* M;
+  char __pad[sizeof(int64_t) / sizeof(char) - 1];
   
 } libkeccak_state_t;
 
@@ -113,6 +173,21 @@ LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull)))
 int libkeccak_state_initialise(libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec);
 
 
+/**
+ * Select the Keccak-f kernel used by a state, `libkeccak_state_initialise`
+ * and `libkeccak_state_unmarshal` selects `LIBKECCAK_KERNEL_AUTO`
+ * 
+ * @param   state   The state, must be initialised
+ * @param   kernel  `LIBKECCAK_KERNEL_AUTO` or another `LIBKECCAK_KERNEL_*` constant
+ * @return          Zero on success, -1 on error; `errno` is set to `EINVAL` if
+ *                  the kernel is unknown or cannot be used with the state's word
+ *                  size, or if the number of rounds is out of range or odd for
+ *                  64-bit words, and to `ENOTSUP` if the CPU does not support the kernel
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull)))
+int libkeccak_state_set_kernel(libkeccak_state_t* restrict state, int kernel);
+
+
 /**
  * Reset a state according to hashing specifications
  * 
@@ -132,14 +207,7 @@ void libkeccak_state_reset(libkeccak_state_t* restrict state)
  * 
  * @param  state  The state that should be destroyed
  */
-static inline
-void libkeccak_state_fast_destroy(libkeccak_state_t* restrict state)
-{
-  if (state == NULL)
-    return;
-  free(state->M);
-  state->M = NULL;
-}
+void libkeccak_state_fast_destroy(libkeccak_state_t* restrict state);
 
 
 /**
@@ -172,69 +240,46 @@ void libkeccak_state_wipe(volatile libkeccak_state_t* restrict state);
  * 
  * @param  state  The state that should be destroyed
  */
-LIBKECCAK_GCC_ONLY(__attribute__((unused, optimize("-O0"))))
-static inline
-void libkeccak_state_destroy(volatile libkeccak_state_t* restrict state)
-{
-  if (state == NULL)
-    return;
-  libkeccak_state_wipe(state);
-  free(state->M);
-  state->M = NULL;
-}
+LIBKECCAK_GCC_ONLY(__attribute__((optimize("-O0"))))
+void libkeccak_state_destroy(volatile libkeccak_state_t* restrict state);
 
 
 /**
  * Wrapper for `libkeccak_state_initialise` that also allocates the states
  * 
+ * A state with the same specifications that has been released with
+ * `libkeccak_state_fast_free` or `libkeccak_state_free` by the calling
+ * thread is reset and reused if available, instead of allocating one
+ * 
  * @param   spec  The specifications for the state
  * @return        The state, `NULL` on error
  */
-LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused, warn_unused_result, malloc)))
-static inline
-libkeccak_state_t* libkeccak_state_create(const libkeccak_spec_t* restrict spec)
-{
-  libkeccak_state_t* restrict state = malloc(sizeof(libkeccak_state_t));
-  int saved_errno;
-  if ((state == NULL) || libkeccak_state_initialise(state, spec))
-    return saved_errno = errno, free(state), errno = saved_errno, NULL;
-  return state;
-}
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, warn_unused_result, malloc)))
+libkeccak_state_t* libkeccak_state_create(const libkeccak_spec_t* restrict spec);
 
 
 /**
  * Wrapper for `libkeccak_state_fast_destroy` that also frees the allocation of the state
  * 
+ * The state is kept for reuse by `libkeccak_state_create` and `libkeccak_state_duplicate`
+ * in the calling thread instead, if its pool of released states is not full
+ * 
  * @param  state  The state that should be freed
  */
-LIBKECCAK_GCC_ONLY(__attribute__((unused)))
-static inline
-void libkeccak_state_fast_free(libkeccak_state_t* restrict state)
-{
-  libkeccak_state_fast_destroy(state);
-  free(state);
-}
+void libkeccak_state_fast_free(libkeccak_state_t* restrict state);
 
 
 /**
  * Wrapper for `libkeccak_state_destroy` that also frees the allocation of the state
  * 
+ * The state is wiped and kept for reuse by `libkeccak_state_create` and
+ * `libkeccak_state_duplicate` in the calling thread instead, if its pool
+ * of released states is not full
+ * 
  * @param  state  The state that should be freed
  */
-LIBKECCAK_GCC_ONLY(__attribute__((unused, optimize("-O0"))))
-static inline
-void libkeccak_state_free(volatile libkeccak_state_t* restrict state)
-{
-#ifdef __GNUC__
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Wcast-qual"
-#endif
-  libkeccak_state_destroy(state);
-  free((libkeccak_state_t*)state);
-#ifdef __GNUC__
-# pragma GCC diagnostic pop
-#endif
-}
+LIBKECCAK_GCC_ONLY(__attribute__((optimize("-O0"))))
+void libkeccak_state_free(volatile libkeccak_state_t* restrict state);
 
 
 /**
@@ -251,19 +296,15 @@ int libkeccak_state_copy(libkeccak_state_t* restrict dest, const libkeccak_state
 /**
  * A wrapper for `libkeccak_state_copy` that also allocates the duplicate
  * 
+ * A state with the same specifications that has been released with
+ * `libkeccak_state_fast_free` or `libkeccak_state_free` by the calling
+ * thread is reused if available, instead of allocating one
+ * 
  * @param   src  The state to duplicate
  * @return       The duplicate, `NULL` on error
  */
-LIBKECCAK_GCC_ONLY(__attribute__((nonnull, unused, warn_unused_result, malloc)))
-static inline
-libkeccak_state_t* libkeccak_state_duplicate(const libkeccak_state_t* restrict src)
-{
-  libkeccak_state_t* restrict dest = malloc(sizeof(libkeccak_state_t));
-  int saved_errno;
-  if ((dest == NULL) || libkeccak_state_copy(dest, src))
-    return saved_errno = errno, libkeccak_state_free(dest), errno = saved_errno, NULL;
-  return dest;
-}
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, warn_unused_result, malloc)))
+libkeccak_state_t* libkeccak_state_duplicate(const libkeccak_state_t* restrict src);
 
 
 /**
@@ -277,7 +318,7 @@ LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow, unused, warn_unused_result,
 static inline
 size_t libkeccak_state_marshal_size(const libkeccak_state_t* restrict state)
 {
-  return sizeof(libkeccak_state_t) - sizeof(char*) + state->mptr * sizeof(char);
+  return 7 * sizeof(long) + 26 * sizeof(int64_t) + 2 * sizeof(size_t) + state->mptr * sizeof(char);
 }
 
 
@@ -314,5 +355,136 @@ LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull, nothrow, warn_unused_result, pu
 size_t libkeccak_state_unmarshal_skip(const char* restrict data);
 
 
+/**
+ * Statistics for the calling thread's pool of states released
+ * with `libkeccak_state_free`, `libkeccak_state_fast_free`,
+ * `libkeccak_hmac_free` and `libkeccak_hmac_fast_free`
+ */
+typedef struct libkeccak_state_pool_stats
+{
+  /**
+   * The number of states created or duplicated from the pool
+   */
+  size_t hits;
+  
+  /**
+   * The number of states created or duplicated by allocation
+   */
+  size_t misses;
+  
+  /**
+   * The number of released states that were kept in the pool
+   */
+  size_t kept;
+  
+  /**
+   * The number of released states that were freed
+   * because the pool was full
+   */
+  size_t discarded;
+  
+  /**
+   * The number of states currently in the pool
+   */
+  size_t pooled;
+  
+} libkeccak_state_pool_stats_t;
+
+
+/**
+ * Get the statistics of the calling thread's pool of released states
+ * 
+ * @param  stats  Output parameter for the statistics
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nonnull, nothrow)))
+void libkeccak_state_pool_stats(libkeccak_state_pool_stats_t* restrict stats);
+
+
+/**
+ * Free states kept in the calling thread's pool of released states,
+ * the pool is also emptied automatically when the thread exits
+ * 
+ * @param   keep  The number of states to keep
+ * @return        The number of freed states
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((nothrow)))
+size_t libkeccak_state_pool_trim(size_t keep);
+
+
+/**
+ * The size of the message buffer of a `libkeccak_embedded_state_t`,
+ * two blocks of the largest bitrate, which is enough to pad the
+ * last block of a message without growing the buffer
+ */
+#define LIBKECCAK_EMBEDDED_BUFFER_SIZE  (2 * 1600 / 8)
+
+
+/**
+ * A hashing state whose message buffer is stored inside
+ * the structure, rather than allocated, so that it can be
+ * initialised, copied and destroyed without calling
+ * `malloc` or `free`
+ * 
+ * `&(.state)` can be used with all functions that take a
+ * `libkeccak_state_t`, except `libkeccak_state_unmarshal`,
+ * `libkeccak_state_fast_free` and `libkeccak_state_free`; its
+ * message buffer is never reallocated, `libkeccak_state_destroy`
+ * and `libkeccak_state_fast_destroy` do not free it, and
+ * `libkeccak_state_copy` copies it to an allocated buffer
+ * 
+ * The structure is aligned to a cache line, so the state does not
+ * share cache lines with other data; use `aligned_alloc` rather than
+ * `malloc` if it is not allocated on the stack or statically
+ */
+#ifdef __GNUC__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wpadded"
+#endif
+typedef struct libkeccak_embedded_state
+{
+  /**
+   * The hashing state, its `M` points to `buffer`
+   */
+  libkeccak_state_t state;
+  
+  /**
+   * The message buffer
+   */
+  char buffer[LIBKECCAK_EMBEDDED_BUFFER_SIZE];
+  
+} LIBKECCAK_GCC_ONLY(__attribute__((aligned(64)))) libkeccak_embedded_state_t;
+#ifdef __GNUC__
+# pragma GCC diagnostic pop
+#endif
+
+
+/**
+ * Initialise a state with an embedded message buffer
+ * according to hashing specifications
+ * 
+ * @param   state  The state that should be initialised
+ * @param   spec   The specifications for the state
+ * @return         Zero on success, -1 on error; `errno` is set to `EINVAL`
+ *                 if the state size is greater than 1600 bits
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull, nothrow)))
+int libkeccak_embedded_state_initialise(libkeccak_embedded_state_t* restrict state,
+					const libkeccak_spec_t* restrict spec);
+
+
+/**
+ * Make a copy of a state into a state with an embedded message buffer
+ * 
+ * @param   dest  The slot for the duplicate
+ * @param   src   The state to duplicate
+ * @return        Zero on success, -1 on error; `errno` is set to `EINVAL` if
+ *                the state size of `src` is greater than 1600 bits or its
+ *                message buffer holds more than `LIBKECCAK_EMBEDDED_BUFFER_SIZE`
+ *                bytes
+ */
+LIBKECCAK_GCC_ONLY(__attribute__((leaf, nonnull, nothrow)))
+int libkeccak_embedded_state_copy(libkeccak_embedded_state_t* restrict dest, const libkeccak_state_t* restrict src);
+
+
 #endif
 
@@ -0,0 +1,258 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "private.h"
+#include "mac/hmac.h"
+
+
+#include <stdlib.h>
+#include <pthread.h>
+
+
+
+/**
+ * The number of specifications, per kind of state,
+ * for which each thread keeps released states
+ */
+#define LIBKECCAK_STATE_POOL_GROUPS  4
+
+/**
+ * The number of released states of one kind and
+ * specification that each thread keeps
+ */
+#define LIBKECCAK_STATE_POOL_DEPTH  16
+
+
+
+/**
+ * Released states of one kind and specification
+ */
+struct libkeccak_state_pool_group
+{
+  /**
+   * The states, the last `count` are unused
+   */
+  void* objects[LIBKECCAK_STATE_POOL_DEPTH];
+  
+  /**
+   * The bitrate of the states
+   */
+  long r;
+  
+  /**
+   * The capacity of the states
+   */
+  long c;
+  
+  /**
+   * The output size of the states
+   */
+  long n;
+  
+  /**
+   * `LIBKECCAK_POOLED_STATE` or `LIBKECCAK_POOLED_HMAC`
+   */
+  long kind;
+  
+  /**
+   * The number of states in `objects`
+   */
+  size_t count;
+};
+
+
+/**
+ * The released states of the thread, and its statistics
+ */
+static __thread struct
+{
+  /**
+   * The states, grouped by kind and specification
+   */
+  struct libkeccak_state_pool_group groups[LIBKECCAK_STATE_POOL_GROUPS];
+  
+  /**
+   * The statistics of the pool
+   */
+  libkeccak_state_pool_stats_t stats;
+  
+} pool;
+
+/**
+ * Makes sure `pool_key` is only created once
+ */
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Key whose destructor releases the states of an exiting thread
+ */
+static pthread_key_t pool_key;
+
+/**
+ * Whether `pool_key` could be created
+ */
+static int pool_key_created = 0;
+
+
+
+/**
+ * Release the states kept by a thread that is exiting
+ * 
+ * @param  unused  Ignored
+ */
+static void libkeccak_state_pool_exit(void* unused)
+{
+  (void) unused;
+  libkeccak_state_pool_trim(0);
+}
+
+
+/**
+ * Create `pool_key`
+ */
+static void libkeccak_state_pool_create_key(void)
+{
+  pool_key_created = !pthread_key_create(&pool_key, libkeccak_state_pool_exit);
+}
+
+
+/**
+ * Make sure the states kept by the calling thread
+ * are released when the thread exits
+ * 
+ * @return  Whether the thread may keep states
+ */
+static int libkeccak_state_pool_register(void)
+{
+  pthread_once(&pool_key_once, libkeccak_state_pool_create_key);
+  if (!pool_key_created)
+    return 0;
+  if (pthread_getspecific(pool_key) != NULL)
+    return 1;
+  return !pthread_setspecific(pool_key, &pool);
+}
+
+
+/**
+ * Take a released state from the calling thread's pool
+ * 
+ * @param   kind  `LIBKECCAK_POOLED_STATE` or `LIBKECCAK_POOLED_HMAC`
+ * @param   r     The bitrate
+ * @param   c     The capacity
+ * @param   n     The output size
+ * @return        The state, `NULL` if the pool has none with the specification
+ */
+void* libkeccak_state_pool_take(long kind, long r, long c, long n)
+{
+  struct libkeccak_state_pool_group* group;
+  size_t i;
+  for (i = 0; i < LIBKECCAK_STATE_POOL_GROUPS; i++)
+    {
+      group = pool.groups + i;
+      if (group->count && (group->kind == kind) && (group->r == r) && (group->c == c) && (group->n == n))
+	{
+	  pool.stats.hits++;
+	  pool.stats.pooled--;
+	  return group->objects[--(group->count)];
+	}
+    }
+  pool.stats.misses++;
+  return NULL;
+}
+
+
+/**
+ * Give a released state to the calling thread's pool
+ * 
+ * @param   kind    `LIBKECCAK_POOLED_STATE` or `LIBKECCAK_POOLED_HMAC`
+ * @param   object  The state
+ * @param   r       The bitrate of the state
+ * @param   c       The capacity of the state
+ * @param   n       The output size of the state
+ * @return          Zero if the state was kept, -1 if the caller shall free it
+ */
+int libkeccak_state_pool_put(long kind, void* object, long r, long c, long n)
+{
+  struct libkeccak_state_pool_group* group;
+  struct libkeccak_state_pool_group* empty = NULL;
+  size_t i;
+  
+  for (i = 0; i < LIBKECCAK_STATE_POOL_GROUPS; i++)
+    {
+      group = pool.groups + i;
+      if (!group->count)
+	empty = empty ? empty : group;
+      else if ((group->kind == kind) && (group->r == r) && (group->c == c) && (group->n == n))
+	goto found;
+    }
+  
+  if ((empty == NULL) || !libkeccak_state_pool_register())
+    goto discard;
+  group = empty;
+  group->kind = kind, group->r = r, group->c = c, group->n = n;
+  
+ found:
+  if (group->count == LIBKECCAK_STATE_POOL_DEPTH)
+    goto discard;
+  group->objects[group->count++] = object;
+  pool.stats.kept++;
+  pool.stats.pooled++;
+  return 0;
+  
+ discard:
+  pool.stats.discarded++;
+  return -1;
+}
+
+
+/**
+ * Get the statistics of the calling thread's pool of released states
+ * 
+ * @param  stats  Output parameter for the statistics
+ */
+void libkeccak_state_pool_stats(libkeccak_state_pool_stats_t* restrict stats)
+{
+  *stats = pool.stats;
+}
+
+
+/**
+ * Free states kept in the calling thread's pool of released states
+ * 
+ * @param   keep  The number of states to keep
+ * @return        The number of freed states
+ */
+size_t libkeccak_state_pool_trim(size_t keep)
+{
+  struct libkeccak_state_pool_group* group;
+  size_t i, freed = 0;
+  void* object;
+  
+  for (i = LIBKECCAK_STATE_POOL_GROUPS; i-- && (pool.stats.pooled > keep);)
+    for (group = pool.groups + i; group->count && (pool.stats.pooled > keep); freed++, pool.stats.pooled--)
+      {
+	object = group->objects[--(group->count)];
+	if (group->kind == LIBKECCAK_POOLED_HMAC)
+	  libkeccak_hmac_fast_destroy(object);
+	else
+	  libkeccak_state_fast_destroy(object);
+	free(object);
+      }
+  
+  return freed;
+}
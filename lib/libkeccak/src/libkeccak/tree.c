@@ -0,0 +1,132 @@
+/**
+ * libkeccak – Keccak-family hashing library
+ * 
+ * Copyright © 2014, 2015, 2017  Mattias Andrée (maandree@kth.se)
+ * 
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "private.h"
+
+
+
+/**
+ * Leaves whose chaining values shall be calculated
+ */
+typedef struct libkeccak_leaves
+{
+  /**
+   * Output parameter for the chaining values
+   */
+  char* restrict chains;
+  
+  /**
+   * The leaves, stored contiguously
+   */
+  const char* restrict leaves;
+  
+  /**
+   * The length of each leaf
+   */
+  size_t leaflen;
+  
+  /**
+   * The size of each chaining value
+   */
+  size_t cvlen;
+  
+  /**
+   * The number of leaves
+   */
+  size_t n;
+  
+  /**
+   * The bitrate
+   */
+  long r;
+  
+  /**
+   * The number of rounds
+   */
+  long nr;
+  
+  /**
+   * The suffix and the first bit of the padding
+   */
+  char pad;
+  
+  char __pad[sizeof(long) - 1];
+  
+} libkeccak_leaves_t;
+
+
+
+/**
+ * Calculate the chaining values of four leaves,
+ * or of the remaining leaves if fewer than four
+ * 
+ * @param  arg  The leaves, `libkeccak_leaves_t*`
+ * @param  i    The index of the group of four leaves
+ */
+static __attribute__((nonnull, nothrow, hot))
+void libkeccak_leaf_group(void* arg, size_t i)
+{
+  const libkeccak_leaves_t* leaves = arg;
+  const char* restrict msgs[4];
+  char* restrict hashsums[4];
+  size_t j, first = i * 4;
+  
+  for (j = 0; (j < 4) && (first + j < leaves->n); j++)
+    {
+      msgs[j] = leaves->leaves + (first + j) * leaves->leaflen;
+      hashsums[j] = leaves->chains + (first + j) * leaves->cvlen;
+    }
+  
+  if (j == 4)
+    libkeccak_oneshot_x4(hashsums, leaves->cvlen, msgs, leaves->leaflen, leaves->r, leaves->nr, leaves->pad);
+  else
+    while (j--)
+      libkeccak_oneshot(hashsums[j], leaves->cvlen, msgs[j], leaves->leaflen, leaves->r, leaves->nr, leaves->pad);
+}
+
+
+/**
+ * Calculate the chaining values of equally long leaves of a tree
+ * hashing mode, across the library's worker threads and four at a
+ * time when possible, each is a Keccak-p[1600, nr] based sponge hash
+ * 
+ * @param  chains   Output parameter for the chaining values, `n * cvlen` bytes
+ * @param  cvlen    The size of each chaining value in bytes, at most `r / 8`
+ * @param  leaves   The leaves, stored contiguously
+ * @param  leaflen  The length of each leaf
+ * @param  n        The number of leaves
+ * @param  r        The bitrate, a multiple of 64
+ * @param  nr       The number of rounds, a positive even number at most 24
+ * @param  pad      The suffix and the first bit of the padding,
+ *                  as the byte they form at the end of the leaves
+ */
+void libkeccak_hash_leaves(char* restrict chains, size_t cvlen, const char* restrict leaves, size_t leaflen,
+			   size_t n, long r, long nr, char pad)
+{
+  libkeccak_leaves_t job;
+  job.chains = chains;
+  job.leaves = leaves;
+  job.leaflen = leaflen;
+  job.cvlen = cvlen;
+  job.n = n;
+  job.r = r;
+  job.nr = nr;
+  job.pad = pad;
+  libkeccak_pool_run((n + 3) / 4, libkeccak_leaf_group, &job);
+}
+
@@ -35,6 +35,9 @@ static int test_hex(void)
   const char hexdata_upper[] = "042F1283FF80A300";
   const char hexdata_lower[] = "042f1283ff80a300";
   char hextest[2 * 8 + 1];
+  char longbin[150], longbintest[150];
+  char longhex[2 * 150 + 1], longtest[2 * 150 + 1];
+  size_t i, bad;
   
   printf("Testing libkeccak_behex_lower: ");
   libkeccak_behex_lower(hextest, (const char*)bindata, 8);
@@ -64,6 +67,59 @@ static int test_hex(void)
   else
     return printf("Fail\n"), -1;
   
+  for (i = 0; i < sizeof(longbin); i++)
+    {
+      longbin[i] = (char)(i * 157 + 13);
+      longhex[2 * i + 0] = "0123456789abcdef"[(i * 157 + 13) >> 4 & 15];
+      longhex[2 * i + 1] = "0123456789abcdef"[(i * 157 + 13) >> 0 & 15];
+    }
+  longhex[sizeof(longhex) - 1] = '\0';
+  
+  printf("Testing libkeccak_behex_lower on long input: ");
+  for (i = 0; i <= sizeof(longbin); i++)
+    {
+      libkeccak_behex_lower(longtest, longbin, i);
+      if (memcmp(longtest, longhex, 2 * i) || longtest[2 * i])
+	return printf("Fail\n"), -1;
+    }
+  printf("OK\n");
+  
+  printf("Testing libkeccak_unhex on long input: ");
+  for (i = sizeof(longbin) + 1; i--;)
+    {
+      longtest[2 * i] = '\0';
+      memcpy(longtest, longhex, 2 * i);
+      libkeccak_unhex(longbintest, longtest);
+      if (memcmp(longbintest, longbin, i))
+	return printf("Fail\n"), -1;
+    }
+  libkeccak_behex_upper(longtest, longbin, sizeof(longbin));
+  libkeccak_unhex(longbintest, longtest);
+  if (memcmp(longbintest, longbin, sizeof(longbin)))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  
+  printf("Testing libkeccak_unhex_checked: ");
+  libkeccak_behex_upper(longtest, longbin, sizeof(longbin));
+  longtest[0] = 'a', longtest[100] = 'F';
+  memcpy(longhex, longtest, sizeof(longtest));
+  if (libkeccak_unhex_checked(longbintest, longtest, 2 * sizeof(longbin), NULL))
+    return printf("Fail\n"), -1;
+  libkeccak_unhex(longbin, longhex);
+  if (memcmp(longbintest, longbin, sizeof(longbin)))
+    return printf("Fail\n"), -1;
+  for (i = 0; i < 2 * sizeof(longbin); i += 7)
+    {
+      longtest[i] = "g/:@G`\x80 "[i % 8];
+      bad = 0;
+      if (!libkeccak_unhex_checked(longbintest, longtest, 2 * sizeof(longbin), &bad) || (bad != i) || (errno != EINVAL))
+	return printf("Fail\n"), -1;
+      longtest[i] = longhex[i];
+    }
+  if (!libkeccak_unhex_checked(longbintest, longtest, 2 * sizeof(longbin) - 1, &bad) || (bad != 2 * sizeof(longbin) - 1))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  
   printf("\n");
   return 0;
 }
@@ -470,6 +526,62 @@ static int test_update(void)
 }
 
 
+/**
+ * Test that `libkeccak_fast_update` and `libkeccak_update` gives the
+ * same result regardless of how the message is split, and that the
+ * message buffer does not grow with the size of the input
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_update_split(void)
+{
+  static const size_t chunks[] = {1, 7, 135, 136, 137, 272, 4096, 100000};
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char expected[256 / 8];
+  char hashsum[256 / 8];
+  char* restrict msg;
+  size_t msglen = 300000, i, j, n;
+  int ok = 1, fast;
+  
+  printf("Testing libkeccak_update with split messages: ");
+  
+  if (msg = malloc(msglen), msg == NULL)
+    return perror("malloc"), -1;
+  for (i = 0; i < msglen; i++)
+    msg[i] = (char)(i * 7 + (i >> 8));
+  
+  libkeccak_spec_sha3(&spec, 256);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_fast_digest(&state, msg, msglen, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_fast_digest"), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  for (fast = 0; fast < 2; fast++)
+    for (i = 0; i < sizeof(chunks) / sizeof(*chunks); i++)
+      {
+	if (libkeccak_state_initialise(&state, &spec))
+	  return perror("libkeccak_state_initialise"), -1;
+	for (j = 0; j < msglen; j += n)
+	  {
+	    n = msglen - j < chunks[i] ? msglen - j : chunks[i];
+	    if ((fast ? libkeccak_fast_update : libkeccak_update)(&state, msg + j, n))
+	      return perror("libkeccak_update"), -1;
+	  }
+	ok &= state.mlen <= (size_t)(spec.bitrate / 4);
+	if (libkeccak_digest(&state, NULL, 0, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+	  return perror("libkeccak_digest"), -1;
+	ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+	libkeccak_state_fast_destroy(&state);
+      }
+  
+  free(msg);
+  printf("%s\n\n", ok ? "OK" : "Fail");
+  return ok - 1;
+}
+
+
 /**
  * Run a test for `libkeccak_*squeeze` functions
  * 
@@ -577,6 +689,1095 @@ static int test_squeeze(void)
 }
 
 
+/**
+ * Run test cases for `libkeccak_squeeze_bytes`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_squeeze_bytes(void)
+{
+  static const size_t pieces[] = { 1, 7, 13, 8, 200, 3, 168, 600 };
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char expected[1000], output[1000], hexsum[32 * 2 + 1];
+  size_t i, j, off;
+  int ok = 1;
+  
+  printf("Testing libkeccak_squeeze_bytes:\n");
+  
+  printf("  SHAKE256(\"\"):                   ");
+  libkeccak_spec_shake(&spec, 256, 256);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_digest_xof(&state, NULL, 0, 0, LIBKECCAK_SHAKE_SUFFIX))
+    return perror("libkeccak_digest_xof"), -1;
+  libkeccak_squeeze_bytes(&state, output, 5);
+  libkeccak_squeeze_bytes(&state, output + 5, 27);
+  libkeccak_state_destroy(&state);
+  libkeccak_behex_lower(hexsum, output, 32);
+  ok = !strcmp(hexsum, "46b9dd2b0ba88d13233b3feb743eeb243fcd52ea62b81b82b50c27646ed5762f");
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  /* The rate of Keccak[1096,504] is not a whole number of lanes. */
+  for (i = 0; i < 3; i++)
+    {
+      printf("  %s", i == 2 ? "Keccak[1096,504], odd pieces:   " :
+		     i == 1 ? "Keccak[480,320], odd pieces:    " : "SHAKE128, odd pieces:           ");
+      if (i == 2)
+	spec.bitrate = 1096, spec.capacity = 504, spec.output = 8000;
+      else if (i)
+	spec.bitrate = 480, spec.capacity = 320, spec.output = 8000;
+      else
+	libkeccak_spec_shake(&spec, 128, 8000);
+      if (libkeccak_state_initialise(&state, &spec))
+	return perror("libkeccak_state_initialise"), -1;
+      if (libkeccak_fast_digest(&state, "xof", 3, 0, i ? "" : LIBKECCAK_SHAKE_SUFFIX, expected))
+	return perror("libkeccak_fast_digest"), -1;
+      libkeccak_state_reset(&state);
+      if (libkeccak_fast_digest_xof(&state, "xof", 3, 0, i ? "" : LIBKECCAK_SHAKE_SUFFIX))
+	return perror("libkeccak_fast_digest_xof"), -1;
+      for (off = j = 0; off < sizeof(output); off += pieces[j++])
+	libkeccak_squeeze_bytes(&state, output + off, pieces[j]);
+      libkeccak_state_fast_destroy(&state);
+      ok = !memcmp(expected, output, sizeof(output));
+      printf("%s\n", ok ? "OK" : "Fail");
+      if (!ok)
+	return -1;
+    }
+  
+  printf("\n");
+  return 0;
+}
+
+
+
+/**
+ * Run a test case for `libkeccak_fast_digest_x4`, comparing
+ * its hashsums against those of `libkeccak_fast_digest`
+ * 
+ * @param   specs   The specifications for the four hashings
+ * @param   suffix  The message suffix (padding prefix)
+ * @param   msgs    The four messages to digest
+ * @return          Zero on success, -1 on error
+ */
+static int test_digest_x4_case(const libkeccak_spec_t* restrict specs, const char* restrict suffix,
+			       const char* restrict const* msgs)
+{
+  libkeccak_state_t states[4];
+  libkeccak_state_t* restrict statep[4];
+  char* restrict hashsums[4];
+  char expected[4000 / 8];
+  size_t msglens[4];
+  int i, ok = 1;
+  
+  for (i = 0; i < 4; i++)
+    {
+      if (libkeccak_state_initialise(states + i, specs + i))
+	return perror("libkeccak_state_initialise"), -1;
+      if (hashsums[i] = malloc((specs[i].output + 7) / 8), hashsums[i] == NULL)
+	return perror("malloc"), -1;
+      statep[i] = states + i;
+      msglens[i] = strlen(msgs[i]);
+    }
+  
+  if (libkeccak_fast_digest_x4(statep, msgs, msglens, suffix, hashsums))
+    return perror("libkeccak_fast_digest_x4"), -1;
+  
+  for (i = 0; i < 4; i++)
+    {
+      libkeccak_state_reset(states + i);
+      if (libkeccak_fast_digest(states + i, msgs[i], msglens[i], 0, suffix, expected))
+	return perror("libkeccak_fast_digest"), -1;
+      if (memcmp(expected, hashsums[i], (size_t)((specs[i].output + 7) / 8)))
+	ok = 0;
+      libkeccak_state_fast_destroy(states + i);
+      free(hashsums[i]);
+    }
+  
+  printf("%s\n", ok ? "OK" : "Fail");
+  return ok - 1;
+}
+
+
+/**
+ * Run test cases for `libkeccak_fast_digest_x4`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_digest_x4(void)
+{
+  static const char* long_msg =
+    "capitol's kvistfri broadly raping, withdrew hypothesis snakebird qmc2, "
+    "intensifierat sturdiness perl-image-exiftool vingla, timjan avogadro "
+    "uppdriven lib32-llvm-amdgpu-snapshot, grilo-plugins auditorium tull";
+  const char* msgs[4] = {"", "faktum desist thundered klen", long_msg, "royalty tt yellowstone deficiencies"};
+  libkeccak_spec_t specs[4];
+  int i;
+  
+  printf("Testing libkeccak_fast_digest_x4:\n");
+  
+  printf("  Keccak-256 with messages of different lengths: ");
+  for (i = 0; i < 4; i++)
+    libkeccak_spec_sha3(specs + i, 256);
+  if (test_digest_x4_case(specs, "", msgs))  return -1;
+  
+  printf("  SHA3-512 with messages of different lengths:   ");
+  for (i = 0; i < 4; i++)
+    libkeccak_spec_sha3(specs + i, 512);
+  if (test_digest_x4_case(specs, LIBKECCAK_SHA3_SUFFIX, msgs))  return -1;
+  
+  printf("  SHAKE-128 with multiblock output:              ");
+  for (i = 0; i < 4; i++)
+    libkeccak_spec_shake(specs + i, 128, 4000);
+  if (test_digest_x4_case(specs, LIBKECCAK_SHAKE_SUFFIX, msgs))  return -1;
+  
+  printf("  Mixed specifications:                          ");
+  libkeccak_spec_sha3(specs + 1, 224);
+  specs[3].bitrate = 256, specs[3].capacity = 800 - 256, specs[3].output = 256;
+  if (test_digest_x4_case(specs, "", msgs))  return -1;
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for `libkeccak_keccak256` and `libkeccak_sha3_256`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_oneshot(void)
+{
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char msg[300];
+  char expected[256 / 8];
+  char hashsum[256 / 8];
+  char hexsum[256 / 8 * 2 + 1];
+  size_t len;
+  int ok;
+  
+  printf("Testing libkeccak_keccak256 and libkeccak_sha3_256:\n");
+  
+  printf("  Empty Keccak-256: ");
+  libkeccak_keccak256(hashsum, NULL, 0);
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok = !strcmp(hexsum, "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Empty SHA3-256:   ");
+  libkeccak_sha3_256(hashsum, NULL, 0);
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok = !strcmp(hexsum, "a7ffc6f8bf1ed76651c14756a061d662f580ff4de43b49fa82d80a4b80f8434a");
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  All lengths up to 300 bytes: ");
+  for (len = 0; len < sizeof(msg); len++)
+    msg[len] = (char)(len * 13 + 1);
+  libkeccak_spec_sha3(&spec, 256);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  for (len = 0; ok && (len <= sizeof(msg)); len++)
+    {
+      libkeccak_state_reset(&state);
+      if (libkeccak_fast_digest(&state, msg, len, 0, "", expected))
+	return perror("libkeccak_fast_digest"), -1;
+      libkeccak_keccak256(hashsum, msg, len);
+      ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+      libkeccak_state_reset(&state);
+      if (libkeccak_fast_digest(&state, msg, len, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+	return perror("libkeccak_fast_digest"), -1;
+      libkeccak_sha3_256(hashsum, msg, len);
+      ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+    }
+  libkeccak_state_fast_destroy(&state);
+  printf("%s\n\n", ok ? "OK" : "Fail");
+  return ok - 1;
+}
+
+
+/**
+ * Run test cases for `libkeccak_embedded_state_t`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_embedded(void)
+{
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  libkeccak_embedded_state_t embedded, snapshot, lanes[4];
+  libkeccak_state_t* statep[4];
+  const char* msgs[4];
+  char* hashsums[4];
+  char hashsum_data[4][512 / 8];
+  char msg[3000], expected[512 / 8], hashsum[512 / 8];
+  size_t i, msglens[4];
+  int ok;
+  
+  printf("Testing libkeccak_embedded_state_t:\n");
+  for (i = 0; i < sizeof(msg); i++)
+    msg[i] = (char)(i % 241);
+  
+  printf("  Split updates and snapshot:      ");
+  libkeccak_spec_sha3(&spec, 512);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_embedded_state_initialise(&embedded, &spec))
+    return perror("libkeccak_embedded_state_initialise"), -1;
+  if (libkeccak_fast_update(&state, msg, 1000) || libkeccak_fast_update(&(embedded.state), msg, 1000))
+    return perror("libkeccak_fast_update"), -1;
+  if (libkeccak_embedded_state_copy(&snapshot, &state))
+    return perror("libkeccak_embedded_state_copy"), -1;
+  if (libkeccak_digest(&state, msg + 1000, 2000, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_digest"), -1;
+  if (libkeccak_digest(&(embedded.state), msg + 1000, 2000, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_digest"), -1;
+  ok = !memcmp(expected, hashsum, sizeof(hashsum));
+  if (libkeccak_fast_digest(&(snapshot.state), msg + 1000, 2000, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_fast_digest"), -1;
+  ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+  ok &= (embedded.state.M == embedded.buffer) && (snapshot.state.M == snapshot.buffer);
+  libkeccak_state_destroy(&(embedded.state));
+  libkeccak_state_fast_destroy(&(snapshot.state));
+  libkeccak_state_fast_destroy(&state);
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Four long messages in lock-step: ");
+  libkeccak_spec_sha3(&spec, 256);
+  for (i = 0; i < 4; i++)
+    {
+      if (libkeccak_embedded_state_initialise(lanes + i, &spec))
+	return perror("libkeccak_embedded_state_initialise"), -1;
+      statep[i] = &(lanes[i].state);
+      msgs[i] = msg + i;
+      msglens[i] = 500 * (i + 1);
+      hashsums[i] = hashsum_data[i];
+    }
+  if (libkeccak_fast_digest_x4(statep, msgs, msglens, LIBKECCAK_SHA3_SUFFIX, hashsums))
+    return perror("libkeccak_fast_digest_x4"), -1;
+  for (ok = 1, i = 0; i < 4; i++)
+    {
+      libkeccak_sha3_256(expected, msgs[i], msglens[i]);
+      ok &= !memcmp(expected, hashsums[i], 256 / 8);
+      ok &= lanes[i].state.M == lanes[i].buffer;
+    }
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Rejects states over 1600 bits:   ");
+  spec.bitrate = 1600, spec.capacity = 1600, spec.output = 256;
+  errno = 0;
+  ok = (libkeccak_embedded_state_initialise(&embedded, &spec) == -1) && (errno == EINVAL);
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for the pool of released states
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_state_pool(void)
+{
+  libkeccak_spec_t spec, other;
+  libkeccak_state_t* state;
+  libkeccak_state_t* first;
+  libkeccak_state_t* dup;
+  libkeccak_hmac_state_t* hmac;
+  libkeccak_hmac_state_t* first_hmac;
+  libkeccak_state_pool_stats_t before, after;
+  char key[32], hashsum[256 / 8], hexsum[256 / 8 * 2 + 1];
+  size_t i;
+  int ok;
+  
+  printf("Testing the pool of released states:\n");
+  libkeccak_state_pool_trim(0);
+  for (i = 0; i < sizeof(key); i++)
+    key[i] = (char)i;
+  
+  printf("  Reuse by libkeccak_state_create:     ");
+  libkeccak_spec_sha3(&spec, 256);
+  libkeccak_spec_sha3(&other, 512);
+  libkeccak_state_pool_stats(&before);
+  if (first = libkeccak_state_create(&spec), first == NULL)
+    return perror("libkeccak_state_create"), -1;
+  if (libkeccak_update(first, "abc", 3))
+    return perror("libkeccak_update"), -1;
+  libkeccak_state_free(first);
+  if (state = libkeccak_state_create(&other), state == NULL)
+    return perror("libkeccak_state_create"), -1;
+  ok = state != first;
+  libkeccak_state_fast_free(state);
+  if (state = libkeccak_state_create(&spec), state == NULL)
+    return perror("libkeccak_state_create"), -1;
+  ok &= state == first;
+  if (libkeccak_digest(state, "abc", 3, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_digest"), -1;
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok &= !strcmp(hexsum, "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532");
+  libkeccak_state_pool_stats(&after);
+  ok &= (after.hits - before.hits == 1) && (after.misses - before.misses == 2);
+  ok &= (after.kept - before.kept == 2) && (after.pooled == 1);
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Reuse by libkeccak_state_duplicate:  ");
+  if (libkeccak_state_reset(state), libkeccak_update(state, "ab", 2))
+    return perror("libkeccak_update"), -1;
+  if (dup = libkeccak_state_duplicate(state), dup == NULL)
+    return perror("libkeccak_state_duplicate"), -1;
+  libkeccak_state_fast_free(state);
+  if (libkeccak_digest(dup, "c", 1, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_digest"), -1;
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok = !strcmp(hexsum, "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532");
+  libkeccak_state_fast_free(dup);
+  libkeccak_state_pool_stats(&after);
+  ok &= after.pooled == 3;
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Reuse by libkeccak_hmac_create:      ");
+  if (first_hmac = libkeccak_hmac_create(&spec, key, 16 * 8), first_hmac == NULL)
+    return perror("libkeccak_hmac_create"), -1;
+  libkeccak_hmac_free(first_hmac);
+  if (hmac = libkeccak_hmac_create(&spec, key, 32 * 8), hmac == NULL)
+    return perror("libkeccak_hmac_create"), -1;
+  ok = hmac == first_hmac;
+  if (libkeccak_hmac_digest(hmac, "Sample message for keylen<blocklen", 34, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_hmac_digest"), -1;
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok &= !strcmp(hexsum, "4fe8e202c4f058e8dddc23d8c34e467343e23555e24fc2f025d598f558f67205");
+  libkeccak_hmac_fast_free(hmac);
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  libkeccak_state_pool_trim:           ");
+  ok = libkeccak_state_pool_trim(1) == 3;
+  libkeccak_state_pool_stats(&after);
+  ok &= after.pooled == 1;
+  ok &= libkeccak_state_pool_trim(0) == 1;
+  libkeccak_state_pool_stats(&after);
+  ok &= after.pooled == 0;
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for checkpoints
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_checkpoint(void)
+{
+  libkeccak_spec_t spec, other;
+  libkeccak_state_t state;
+  libkeccak_embedded_state_t resumed;
+  void (*permute)(libkeccak_state_t* restrict);
+  char checkpoint[LIBKECCAK_CHECKPOINT_SIZE];
+  char msg[3000], expected[512 / 8], hashsum[512 / 8];
+  uint64_t position;
+  size_t i;
+  int ok;
+  
+  printf("Testing checkpoints:\n");
+  for (i = 0; i < sizeof(msg); i++)
+    msg[i] = (char)(i * 7 + 3);
+  
+  printf("  Save and resume:         ");
+  libkeccak_spec_sha3(&spec, 512);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_update(&state, msg, 1000))
+    return perror("libkeccak_update"), -1;
+  if (libkeccak_checkpoint_save(&state, 1000, checkpoint))
+    return perror("libkeccak_checkpoint_save"), -1;
+  if (libkeccak_digest(&state, msg + 1000, sizeof(msg) - 1000, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_digest"), -1;
+  libkeccak_state_destroy(&state);
+  ok = !memcmp(checkpoint, "KECCAKCP\x01\0\0\0\0\0\0\0\x40\x02\0\0\0\x04\0\0\0\x02\0\0\x18\0\0\0\x40\0\0\0", 36);
+  if (libkeccak_checkpoint_verify(checkpoint, sizeof(checkpoint), &other))
+    return perror("libkeccak_checkpoint_verify"), -1;
+  ok &= (other.bitrate == spec.bitrate) && (other.capacity == spec.capacity) && (other.output == spec.output);
+  if (libkeccak_embedded_state_initialise(&resumed, &other))
+    return perror("libkeccak_embedded_state_initialise"), -1;
+  if (libkeccak_checkpoint_resume(&(resumed.state), checkpoint, sizeof(checkpoint), &position))
+    return perror("libkeccak_checkpoint_resume"), -1;
+  ok &= position == 1000;
+  if (libkeccak_digest(&(resumed.state), msg + position, sizeof(msg) - position, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_digest"), -1;
+  ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Rejects bad checkpoints: ");
+  errno = 0;
+  ok = (libkeccak_checkpoint_verify(checkpoint, sizeof(checkpoint) - 1, NULL) == -1) && (errno == EINVAL);
+  checkpoint[100] ^= 1;
+  errno = 0;
+  ok &= (libkeccak_checkpoint_verify(checkpoint, sizeof(checkpoint), NULL) == -1) && (errno == EBADMSG);
+  checkpoint[100] ^= 1;
+  checkpoint[8] = 2;
+  errno = 0;
+  ok &= (libkeccak_checkpoint_verify(checkpoint, sizeof(checkpoint), NULL) == -1) && (errno == ENOTSUP);
+  checkpoint[8] = 1;
+  libkeccak_spec_sha3(&other, 256);
+  if (libkeccak_embedded_state_initialise(&resumed, &other))
+    return perror("libkeccak_embedded_state_initialise"), -1;
+  errno = 0;
+  ok &= (libkeccak_checkpoint_resume(&(resumed.state), checkpoint, sizeof(checkpoint), NULL) == -1) && (errno == EINVAL);
+  /* A state with fewer rounds is left as it is. */
+  if (libkeccak_embedded_state_initialise(&resumed, &spec))
+    return perror("libkeccak_embedded_state_initialise"), -1;
+  resumed.state.nr = 12;
+  if (libkeccak_state_set_kernel(&(resumed.state), LIBKECCAK_KERNEL_GENERIC))
+    return perror("libkeccak_state_set_kernel"), -1;
+  permute = resumed.state.permute;
+  errno = 0;
+  ok &= (libkeccak_checkpoint_resume(&(resumed.state), checkpoint, sizeof(checkpoint), NULL) == -1) && (errno == EINVAL);
+  ok &= (resumed.state.nr == 12) && (resumed.state.permute == permute);
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for KangarooTwelve
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_k12(void)
+{
+  static const struct { size_t msglen, customlen; const char* expected; } vectors[] =
+    {
+      {       0,     0, "1ac2d450fc3b4205d19da7bfca1b37513c0803577ac7167f06fe2ce1f0ef39e5" },
+      {      17,     0, "6bf75fa2239198db4772e36478f8e19b0f371205f6a9a93a273f51df37122888" },
+      {     289,     0, "0c315ebcdedbf61426de7dcf8fb725d1e74675d7f5327a5067f367b108ecb67c" },
+      {    4913,     0, "cb552e2ec77d9910701d578b457ddf772c12e322e4ee7fe417f92c758f0d59d0" },
+      {   83521,     0, "8701045e22205345ff4dda05555cbb5c3af1a771c2b89baef37db43d9998b9fe" },
+      { 1419857,     0, "844d610933b1b9963cbdeb5ae3b6b05cc7cbd67ceedf883eb678a0a8e0371682" },
+      {       0,     1, "fab658db63e94a246188bf7af69a133045f46ee984c56e3c3328caaf1aa1a583" },
+      {       1,    41, "d848c5068ced736f4462159b9867fd4c20b808acc3d5bc48e0b06ba0a3762ec4" },
+      {       3,  1681, "c389e5009ae57120854c2e8c64670ac01358cf4c1baf89447a724234dc7ced74" },
+      {       7, 68921, "75d2f86a2e644566726b4fbcfc5657b9dbcf070c7b0dca06450ab291d7443bcf" },
+    };
+  static const size_t splits[] = { 1, 8190, 3, 100000, 8192, 600000, 16384 };
+  libkeccak_k12_state_t state;
+  char* pattern;
+  char* ff;
+  char* longsum;
+  char hashsum[256 / 8];
+  char hexsum[256 / 8 * 2 + 1];
+  size_t i, off, n;
+  int ok = 1;
+  
+  printf("Testing KangarooTwelve:\n");
+  
+  pattern = malloc(1419857);
+  ff = malloc(7);
+  longsum = malloc(10032);
+  if (!pattern || !ff || !longsum)
+    return perror("malloc"), -1;
+  for (i = 0; i < 1419857; i++)
+    pattern[i] = (char)(i % 251);
+  memset(ff, 0xFF, 7);
+  
+  for (i = 0; i < sizeof(vectors) / sizeof(*vectors); i++)
+    {
+      printf("  M of %zu bytes, C of %zu bytes: ", vectors[i].msglen, vectors[i].customlen);
+      if (libkeccak_k12_initialise(&state))
+	return perror("libkeccak_k12_initialise"), -1;
+      if (libkeccak_k12_digest(&state, vectors[i].customlen ? ff : pattern, vectors[i].msglen,
+			       pattern, vectors[i].customlen, hashsum, sizeof(hashsum)))
+	return perror("libkeccak_k12_digest"), -1;
+      libkeccak_k12_destroy(&state);
+      libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+      ok = !strcmp(hexsum, vectors[i].expected);
+      printf("%s\n", ok ? "OK" : "Fail");
+      if (!ok)
+	return -1;
+    }
+  
+  printf("  Last 32 of 10032 bytes: ");
+  if (libkeccak_k12_initialise(&state))
+    return perror("libkeccak_k12_initialise"), -1;
+  if (libkeccak_k12_digest(&state, NULL, 0, NULL, 0, longsum, 10032))
+    return perror("libkeccak_k12_digest"), -1;
+  libkeccak_k12_destroy(&state);
+  libkeccak_behex_lower(hexsum, longsum + 10000, sizeof(hashsum));
+  ok = !strcmp(hexsum, "e8dc563642f7228c84684c898405d3a834799158c079b12880277a1d28e2ff6d");
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  printf("  Split updates: ");
+  if (libkeccak_k12_initialise(&state))
+    return perror("libkeccak_k12_initialise"), -1;
+  for (off = i = 0; off < 1419857; off += n, i++)
+    {
+      n = splits[i % (sizeof(splits) / sizeof(*splits))];
+      n = n < 1419857 - off ? n : 1419857 - off;
+      if (libkeccak_k12_update(&state, pattern + off, n))
+	return perror("libkeccak_k12_update"), -1;
+    }
+  if (libkeccak_k12_digest(&state, NULL, 0, NULL, 0, hashsum, sizeof(hashsum)))
+    return perror("libkeccak_k12_digest"), -1;
+  libkeccak_k12_destroy(&state);
+  libkeccak_behex_lower(hexsum, hashsum, sizeof(hashsum));
+  ok = !strcmp(hexsum, vectors[5].expected);
+  printf("%s\n\n", ok ? "OK" : "Fail");
+  
+  free(pattern);
+  free(ff);
+  free(longsum);
+  return ok - 1;
+}
+
+
+/**
+ * Run test cases for cSHAKE and ParallelHash
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_parallelhash(void)
+{
+  static const struct { long x; size_t B, msglen; const char* custom; const char* expected; } vectors[] =
+    {
+      { 128,    8,      24, "",              "ba8dc1d1d979331d3f813603c67f72609ab5e44b94a0b8f9af46514454a2b4f5" },
+      { 128,    8,      24, "Parallel Data", "fc484dcb3f84dceedc353438151bee58157d6efed0445a81f165e495795b7206" },
+      { 256,    8,      24, "",              "bc1ef124da34495e948ead207dd9842235da432d2bbc54b4c110e64c45110553"
+					       "1b7f2a3e0ce055c02805e7c2de1fb746af97a1dd01f43b824e31b87612410429" },
+      { 256,    8,      24, "Parallel Data", "cdf15289b54f6212b4bc270528b49526006dd9b54e2b6add1ef6900dda3963bb"
+					       "33a72491f236969ca8afaea29c682d47a393c065b38e29fae651a2091c833110" },
+      { 256, 8192, 1000000, "backup",        "6ebcf0d865f84eee41d3a63ed24aeb50b8625dfe010564e19ccfc51d9ee90756"
+					       "8853c85c6cda568da8b7c7c6ddd8debd7e207dcbc1d6fcd9271f24524893ead8" },
+      { 128, 1000, 1000000, "",              "8c591f71a21adfc52621935809468ab81b350a70d039c94a69a853d1c14326f7" },
+    };
+  static const size_t splits[] = { 1, 8190, 3, 100000, 8192, 600000, 16384 };
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  libkeccak_parallelhash_state_t pstate;
+  char* msg;
+  char hashsum[512 / 8];
+  char hexsum[512 / 8 * 2 + 1];
+  size_t i, j, off, n;
+  int ok;
+  
+  printf("Testing cSHAKE and ParallelHash:\n");
+  
+  msg = malloc(1000000);
+  if (msg == NULL)
+    return perror("malloc"), -1;
+  
+  printf("  cSHAKE256 with customisation string: ");
+  libkeccak_spec_cshake(&spec, 256, 512);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  libkeccak_cshake_initialise(&state, NULL, 0, "Email Signature", 15);
+  if (libkeccak_fast_digest(&state, "\x00\x01\x02\x03", 4, 0, libkeccak_cshake_suffix(0, 15), hashsum))
+    return perror("libkeccak_fast_digest"), -1;
+  libkeccak_state_fast_destroy(&state);
+  libkeccak_behex_lower(hexsum, hashsum, 512 / 8);
+  ok = !strcmp(hexsum, "d008828e2b80ac9d2218ffee1d070c48b8e4c87bff32c9699d5b6896eee0edd1"
+		       "64020e2be0560858d9c00c037e34a96937c561a74c412bb4c746469527281c8c");
+  printf("%s\n", ok ? "OK" : "Fail");
+  if (!ok)
+    return -1;
+  
+  for (i = 0; i < sizeof(vectors) / sizeof(*vectors); i++)
+    {
+      for (j = 0; j < vectors[i].msglen; j++)
+	msg[j] = (char)(vectors[i].msglen == 24 ? (j / 8) * 16 + j % 8 : j % 251);
+      for (j = 0; j < 2; j++)
+	{
+	  printf("  ParallelHash%li, B = %zu, %zu bytes%s: ", vectors[i].x, vectors[i].B,
+		 vectors[i].msglen, j ? ", split updates" : "");
+	  if (libkeccak_parallelhash_initialise(&pstate, vectors[i].x, vectors[i].B,
+						vectors[i].custom, strlen(vectors[i].custom)))
+	    return perror("libkeccak_parallelhash_initialise"), -1;
+	  for (off = n = 0; j && (off < vectors[i].msglen); off += n)
+	    {
+	      n = splits[off % (sizeof(splits) / sizeof(*splits))];
+	      n = n < vectors[i].msglen - off ? n : vectors[i].msglen - off;
+	      if (libkeccak_parallelhash_update(&pstate, msg + off, n))
+		return perror("libkeccak_parallelhash_update"), -1;
+	    }
+	  if (libkeccak_parallelhash_digest(&pstate, msg + off, vectors[i].msglen - off,
+					    hashsum, (size_t)(vectors[i].x / 4)))
+	    return perror("libkeccak_parallelhash_digest"), -1;
+	  libkeccak_parallelhash_destroy(&pstate);
+	  libkeccak_behex_lower(hexsum, hashsum, (size_t)(vectors[i].x / 4));
+	  ok = !strcmp(hexsum, vectors[i].expected);
+	  printf("%s\n", ok ? "OK" : "Fail");
+	  if (!ok)
+	    return -1;
+	}
+    }
+  
+  free(msg);
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for HMAC
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_hmac(void)
+{
+  static const struct { long x; size_t keylen; const char* msg; const char* expected; } vectors[] =
+    {
+      { 224, 28, "Sample message for keylen<blocklen", "332cfd59347fdb8e576e77260be4aba2d6dc53117b3bfb52c6d18c04" },
+      { 256, 32, "Sample message for keylen<blocklen", "4fe8e202c4f058e8dddc23d8c34e467343e23555e24fc2f025d598f558f67205" },
+      { 512, 72, "Sample message for keylen=blocklen", "544e257ea2a3e5ea19a590e6a24b724ce6327757723fe2751b75bf007d80f6b3"
+							 "60744bf1b7a88ea585f9765b47911976d3191cf83c039f5ffab0d29cc9d9b6da" },
+    };
+  static const size_t msglens[] = { 0, 35, 136, 1000 };
+  static const char* midstate_expected[] =
+    {
+      "f06cbd7c18b50293e5bbdc310d87b624f1fbc222f8eb7cf82407d37295f8207b",
+      "b6765955e40e49b21de71f2fd6405becf6888445ab5d7fef2ea2ea7dcaa6e9c0",
+      "36d4429d3852a1570a43f424999855a87d27c5a515ef88dc9a98349722716d42",
+      "ddc336b8d4f01a17345a912ec64429c25d2d3ed2e05d6c3d19aef9da5d71b834",
+    };
+  static const size_t key_lengths[] = { 1088, 1091, 2000 };
+  static const struct { size_t key_length; const char* expected; } shifted[] =
+    {
+      { 1091, "b7d527a6868b940669654a4e626cca8198cd863407c6fb8ecfcbe6fe6236c4a6"
+	      "dd4c174993f7d0d987036ad69c0898ae1fd39d7a3e96e87be16a18a90cfa5f93" },
+      { 1093, "e92911cef0642dcdf6b4a3c48b4181cb8fbae025591e9da0c3832872b61f5fee"
+	      "7793648bab59ce1178eacf5f94e086ad7b50b9a062db53848b5f7da31816d7af" },
+      { 1599, "825b0c492afc46cee5e47106642fd3c278bef015c075dd7f40c2460c96cbac64"
+	      "94e66592662a84435cf4927f6869663dc0f83c7b04e6c2f7baed34e4bdaa9baa" },
+      { 2000, "06706be6c3a78edc06c045bbaf9b872c9ea77ef6fe698fc862e02f417bd38ee2"
+	      "ffcee6aeda1cd41d41bed8b75e5ce3807276f3b521ed12f34048044ccc529358" },
+    };
+  static const size_t splits[] = { 1, 4100, 17, 3, 8, 4032, 15 };
+  libkeccak_spec_t spec;
+  libkeccak_hmac_state_t state, keyed;
+  libkeccak_hmac_midstates_t midstates;
+  char key[2000 / 8], msg[10007];
+  char expected[512 / 8], hashsum[512 / 8];
+  char hexsum[512 / 8 * 2 + 1];
+  size_t i, j, off, n;
+  int ok;
+  
+  printf("Testing HMAC:\n");
+  
+  for (i = 0; i < sizeof(key); i++)
+    key[i] = (char)i;
+  
+  for (i = 0; i < sizeof(vectors) / sizeof(*vectors); i++)
+    {
+      printf("  HMAC-SHA3-%li, %zu-byte key: ", vectors[i].x, vectors[i].keylen);
+      libkeccak_spec_sha3(&spec, vectors[i].x);
+      if (libkeccak_hmac_initialise(&state, &spec, key, vectors[i].keylen * 8))
+	return perror("libkeccak_hmac_initialise"), -1;
+      if (libkeccak_hmac_digest(&state, vectors[i].msg, strlen(vectors[i].msg), 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+	return perror("libkeccak_hmac_digest"), -1;
+      libkeccak_hmac_destroy(&state);
+      libkeccak_behex_lower(hexsum, hashsum, (size_t)vectors[i].x / 8);
+      ok = !strcmp(hexsum, vectors[i].expected);
+      printf("%s\n", ok ? "OK" : "Fail");
+      if (!ok)
+	return -1;
+    }
+  
+  for (i = 0; i < sizeof(key); i++)
+    key[i] = (char)(i * 7 + 1);
+  for (i = 0; i < sizeof(msg); i++)
+    msg[i] = (char)(i % 251);
+  libkeccak_spec_sha3(&spec, 256);
+  
+  for (i = 0; i < sizeof(key_lengths) / sizeof(*key_lengths); i++)
+    {
+      printf("  Saved midstates, %zu-bit key: ", key_lengths[i]);
+      if (libkeccak_hmac_initialise(&keyed, &spec, key, key_lengths[i]))
+	return perror("libkeccak_hmac_initialise"), -1;
+      if (libkeccak_hmac_save_midstates(&keyed, &midstates))
+	return perror("libkeccak_hmac_save_midstates"), -1;
+      for (ok = 1, j = 0; ok && (j < sizeof(msglens) / sizeof(*msglens)); j++)
+	{
+	  if (libkeccak_hmac_initialise(&state, &spec, key, key_lengths[i]))
+	    return perror("libkeccak_hmac_initialise"), -1;
+	  if (libkeccak_hmac_digest(&state, msg, msglens[j], 0, LIBKECCAK_SHA3_SUFFIX, expected))
+	    return perror("libkeccak_hmac_digest"), -1;
+	  libkeccak_hmac_destroy(&state);
+	  if (key_lengths[i] == 1088)
+	    {
+	      libkeccak_behex_lower(hexsum, expected, 256 / 8);
+	      if (strcmp(hexsum, midstate_expected[j]))
+		{
+		  ok = 0;
+		  break;
+		}
+	    }
+	  if (j)
+	    libkeccak_hmac_restore_midstates(&keyed, &midstates);
+	  if (libkeccak_hmac_fast_update(&keyed, msg, msglens[j] / 2))
+	    return perror("libkeccak_hmac_fast_update"), -1;
+	  if (libkeccak_hmac_fast_digest(&keyed, msg + msglens[j] / 2, msglens[j] - msglens[j] / 2,
+					 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+	    return perror("libkeccak_hmac_fast_digest"), -1;
+	  ok = !memcmp(hashsum, expected, 256 / 8);
+	}
+      libkeccak_hmac_destroy(&keyed);
+      printf("%s\n", ok ? "OK" : "Fail");
+      if (!ok)
+	return -1;
+    }
+  
+  libkeccak_spec_sha3(&spec, 512);
+  for (i = 0; i < sizeof(shifted) / sizeof(*shifted); i++)
+    {
+      for (j = 0; j < 2; j++)
+	{
+	  printf("  %zu-bit key, %zu bytes%s: ", shifted[i].key_length, sizeof(msg), j ? ", split updates" : "");
+	  if (libkeccak_hmac_initialise(&state, &spec, key, shifted[i].key_length))
+	    return perror("libkeccak_hmac_initialise"), -1;
+	  for (off = n = 0; j && (off < sizeof(msg)); off += n)
+	    {
+	      n = splits[off % (sizeof(splits) / sizeof(*splits))];
+	      n = n < sizeof(msg) - off ? n : sizeof(msg) - off;
+	      if (libkeccak_hmac_update(&state, msg + off, n))
+		return perror("libkeccak_hmac_update"), -1;
+	    }
+	  if (libkeccak_hmac_fast_digest(&state, msg + off, sizeof(msg) - off, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+	    return perror("libkeccak_hmac_fast_digest"), -1;
+	  libkeccak_hmac_destroy(&state);
+	  libkeccak_behex_lower(hexsum, hashsum, 512 / 8);
+	  ok = !strcmp(hexsum, shifted[i].expected);
+	  printf("%s\n", ok ? "OK" : "Fail");
+	  if (!ok)
+	    return -1;
+	}
+    }
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Check that `libkeccak_hmac_digest_many` produces
+ * the same MACs as `libkeccak_hmac_digest`
+ * 
+ * @param   spec       The specifications for the hashing
+ * @param   keylens    The lengths of the keys, in bits
+ * @param   nkeys      The number of keys
+ * @param   msglens    The lengths of the messages
+ * @param   nmsgs      The number of messages
+ * @param   midstates  Whether the sponges shall be restored from saved midstates
+ * @return             Zero on success, -1 on error
+ */
+static int test_hmac_many_case(const libkeccak_spec_t* restrict spec, const size_t* restrict keylens, size_t nkeys,
+			       const size_t* restrict msglens, size_t nmsgs, int midstates)
+{
+  libkeccak_hmac_state_t states[8];
+  libkeccak_hmac_state_t* keys[8];
+  libkeccak_hmac_midstates_t saved[8];
+  const char* msgs[8];
+  char* hashsums[8];
+  char hashsum_data[8][512 / 8];
+  char expected[512 / 8];
+  char key[2000 / 8 + 8], msg[1000];
+  size_t i, n = nkeys > nmsgs ? nkeys : nmsgs;
+  int ok = 1;
+  
+  for (i = 0; i < sizeof(key); i++)
+    key[i] = (char)(i * 3 + 5);
+  for (i = 0; i < sizeof(msg); i++)
+    msg[i] = (char)(i % 253);
+  
+  for (i = 0; i < nkeys; i++)
+    {
+      if (libkeccak_hmac_initialise(states + i, spec, key + i, keylens[i]))
+	return perror("libkeccak_hmac_initialise"), -1;
+      if (midstates && libkeccak_hmac_save_midstates(states + i, saved + i))
+	return perror("libkeccak_hmac_save_midstates"), -1;
+      if (midstates)
+	libkeccak_hmac_restore_midstates(states + i, saved + i);
+      keys[i] = states + i;
+    }
+  for (i = 0; i < nmsgs; i++)
+    msgs[i] = msglens[i] ? msg + i : NULL;
+  for (i = 0; i < n; i++)
+    hashsums[i] = hashsum_data[i];
+  
+  if (libkeccak_hmac_digest_many((const libkeccak_hmac_state_t* const*)keys, nkeys,
+				 msgs, msglens, nmsgs, LIBKECCAK_SHA3_SUFFIX, hashsums))
+    return perror("libkeccak_hmac_digest_many"), -1;
+  
+  for (i = 0; i < n; i++)
+    {
+      libkeccak_hmac_reset(states + (nkeys == 1 ? 0 : i), NULL, 0);
+      if (libkeccak_hmac_digest(states + (nkeys == 1 ? 0 : i), msgs[nmsgs == 1 ? 0 : i],
+				msglens[nmsgs == 1 ? 0 : i], 0, LIBKECCAK_SHA3_SUFFIX, expected))
+	return perror("libkeccak_hmac_digest"), -1;
+      if (memcmp(expected, hashsums[i], (size_t)((spec->output + 7) / 8)))
+	ok = 0;
+    }
+  for (i = 0; i < nkeys; i++)
+    libkeccak_hmac_destroy(states + i);
+  
+  printf("%s\n", ok ? "OK" : "Fail");
+  return ok - 1;
+}
+
+
+/**
+ * Run test cases for `libkeccak_hmac_digest_many`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_hmac_many(void)
+{
+  static const size_t msglens[] = { 0, 1, 135, 136, 137, 500, 71 };
+  static const size_t keylens[] = { 256, 1088, 1600, 8, 2000, 512, 1096 };
+  static const size_t odd_keylens[] = { 1091, 1600, 1093 };
+  static const size_t odd_keylen[] = { 1091 };
+  static const size_t msglen[] = { 300 };
+  libkeccak_spec_t spec;
+  libkeccak_hmac_state_t state;
+  const libkeccak_hmac_state_t* keys[2];
+  const char* msgs[3];
+  char hashsum[512 / 8];
+  char* hashsums[3];
+  size_t i;
+  
+  printf("Testing libkeccak_hmac_digest_many:\n");
+  libkeccak_spec_sha3(&spec, 256);
+  
+  for (i = 0; i < 3; i++)
+    {
+      printf("  SHA3-256, one %4zu-bit key, many messages:       ", keylens[i]);
+      if (test_hmac_many_case(&spec, keylens + i, 1, msglens, 7, 0))  return -1;
+      printf("  SHA3-256, one %4zu-bit key, saved midstates:     ", keylens[i]);
+      if (test_hmac_many_case(&spec, keylens + i, 1, msglens, 7, 1))  return -1;
+    }
+  
+  printf("  SHA3-256, many keys, one message:                ");
+  if (test_hmac_many_case(&spec, keylens, 7, msglen, 1, 0))  return -1;
+  printf("  SHA3-256, many keys, many messages:              ");
+  if (test_hmac_many_case(&spec, keylens, 7, msglens, 7, 1))  return -1;
+  printf("  SHA3-256, keys of odd bit lengths:               ");
+  if (test_hmac_many_case(&spec, odd_keylens, 3, msglens, 3, 0))  return -1;
+  printf("  SHA3-256, a key of odd bit length, midstates:    ");
+  if (test_hmac_many_case(&spec, odd_keylen, 1, msglens, 7, 1))  return -1;
+  
+  libkeccak_spec_sha3(&spec, 512);
+  printf("  SHA3-512, many keys, many messages:              ");
+  if (test_hmac_many_case(&spec, keylens, 5, msglens, 5, 0))  return -1;
+  
+  printf("  Rejects mismatched array lengths:                ");
+  if (libkeccak_hmac_initialise(&state, &spec, "key", 24))
+    return perror("libkeccak_hmac_initialise"), -1;
+  keys[0] = keys[1] = &state;
+  msgs[0] = msgs[1] = msgs[2] = "";
+  hashsums[0] = hashsums[1] = hashsums[2] = hashsum;
+  i = (size_t)libkeccak_hmac_digest_many(keys, 2, msgs, msglens, 3, LIBKECCAK_SHA3_SUFFIX, hashsums);
+  libkeccak_hmac_destroy(&state);
+  if ((i != (size_t)-1) || (errno != EINVAL))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for KMAC
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_kmac(void)
+{
+  static const struct { long x; size_t msglen; const char* custom; const char* expected; } vectors[] =
+    {
+      { 128,   4, "",                      "e5780b0d3ea6f7d3a429c5706aa43a00fadbd7d49628839e3187243f456ee14e" },
+      { 128,   4, "My Tagged Application", "3b1fba963cd8b0b59e8c1a6d71888b7143651af8ba0a7070c0979e2811324aa5" },
+      { 128, 200, "My Tagged Application", "1f5b4e6cca02209e0dcb5ca635b89a15e271ecc760071dfd805faa38f9729230" },
+      { 256,   4, "My Tagged Application", "20c570c31346f703c9ac36c61c03cb64c3970d0cfc787e9b79599d273a68d2f7"
+					     "f69d4cc3de9d104a351689f27cf6f5951f0103f33f4f24871024d9c27773a8dd" },
+      { 256, 200, "",                      "75358cf39e41494e949707927cee0af20a3ff553904c86b08f21cc414bcfd691"
+					     "589d27cf5e15369cbbff8b9a4c2eb17800855d0235ff635da82533ec6b759b69" },
+      { 256, 200, "My Tagged Application", "b58618f71f92e1d56c1b8c55ddd7cd188b97b4ca4d99831eb2699a837da2e4d9"
+					     "70fbacfde50033aea585f1a2708510c32d07880801bd182898fe476876fc8965" },
+    };
+  static const struct { long x; size_t msglen; const char* custom; const char* expected; } keyless[] =
+    {
+      { 128,   4, NULL,                    "4aafe7fe520bc1785d8aac5bc3e70a0a09824836c247471de98e41f5d05c6602" },
+      { 256, 200, "My Tagged Application", "a88dad2f26a23643571fe698ff325f993ea73476274107f37b3bf6a8b3479ba4"
+					     "b63de5bacb771d3c2efea176e83b49ecdb244525b9acfd74ce7990f67e506c97" },
+    };
+  libkeccak_kmac_state_t state, copy;
+  char key[32], msg[200];
+  char hashsum[512 / 8];
+  char hexsum[512 / 8 * 2 + 1];
+  char* marshalled;
+  size_t i, j;
+  int ok;
+  
+  printf("Testing KMAC:\n");
+  
+  for (i = 0; i < sizeof(key); i++)
+    key[i] = (char)(0x40 + i);
+  for (i = 0; i < sizeof(msg); i++)
+    msg[i] = (char)i;
+  
+  for (i = 0; i < sizeof(vectors) / sizeof(*vectors); i++)
+    {
+      for (j = 0; j < 2; j++)
+	{
+	  printf("  KMAC%li, %zu bytes%s: ", vectors[i].x, vectors[i].msglen, j ? ", marshalled midway" : "");
+	  if (libkeccak_kmac_initialise(&state, vectors[i].x, key, sizeof(key),
+					vectors[i].custom, strlen(vectors[i].custom)))
+	    return perror("libkeccak_kmac_initialise"), -1;
+	  if (j)
+	    {
+	      if (libkeccak_kmac_update(&state, msg, 3))
+		return perror("libkeccak_kmac_update"), -1;
+	      marshalled = malloc(libkeccak_kmac_marshal_size(&state));
+	      if (marshalled == NULL)
+		return perror("malloc"), -1;
+	      libkeccak_kmac_marshal(&state, marshalled);
+	      libkeccak_kmac_destroy(&state);
+	      if (libkeccak_kmac_unmarshal(&copy, marshalled) == 0)
+		return perror("libkeccak_kmac_unmarshal"), -1;
+	      free(marshalled);
+	      if (libkeccak_kmac_copy(&state, &copy))
+		return perror("libkeccak_kmac_copy"), -1;
+	      libkeccak_kmac_destroy(&copy);
+	    }
+	  if (libkeccak_kmac_digest(&state, msg + 3 * j, vectors[i].msglen - 3 * j,
+				    hashsum, (size_t)(vectors[i].x / 4)))
+	    return perror("libkeccak_kmac_digest"), -1;
+	  libkeccak_kmac_destroy(&state);
+	  libkeccak_behex_lower(hexsum, hashsum, (size_t)(vectors[i].x / 4));
+	  ok = !strcmp(hexsum, vectors[i].expected);
+	  printf("%s\n", ok ? "OK" : "Fail");
+	  if (!ok)
+	    return -1;
+	}
+    }
+  
+  /* Without a key, and for the first one without a customisation
+   * string, both of which are then passed as `NULL`. */
+  for (i = 0; i < sizeof(keyless) / sizeof(*keyless); i++)
+    {
+      printf("  KMAC%li, %zu bytes, no key: ", keyless[i].x, keyless[i].msglen);
+      if (libkeccak_kmac_initialise(&state, keyless[i].x, NULL, 0,
+				    keyless[i].custom, keyless[i].custom ? strlen(keyless[i].custom) : 0))
+	return perror("libkeccak_kmac_initialise"), -1;
+      if (libkeccak_kmac_digest(&state, msg, keyless[i].msglen, hashsum, (size_t)(keyless[i].x / 4)))
+	return perror("libkeccak_kmac_digest"), -1;
+      libkeccak_kmac_destroy(&state);
+      libkeccak_behex_lower(hexsum, hashsum, (size_t)(keyless[i].x / 4));
+      ok = !strcmp(hexsum, keyless[i].expected);
+      printf("%s\n", ok ? "OK" : "Fail");
+      if (!ok)
+	return -1;
+    }
+  
+  printf("\n");
+  return 0;
+}
+
+
+/**
+ * Run test cases for `libkeccak_state_set_kernel`
+ * 
+ * @return  Zero on success, -1 on error
+ */
+static int test_kernels(void)
+{
+  static const char* msg =
+    "capitol's kvistfri broadly raping, withdrew hypothesis snakebird qmc2, "
+    "intensifierat sturdiness perl-image-exiftool vingla, timjan avogadro "
+    "uppdriven lib32-llvm-amdgpu-snapshot, grilo-plugins auditorium tull, "
+    "royalty tt yellowstone deficiencies faktum desist thundered klen";
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char expected[512 / 8];
+  char hashsum[512 / 8];
+  int kernel, ok = 1;
+  
+  printf("Testing libkeccak_state_set_kernel:\n");
+  
+  libkeccak_spec_sha3(&spec, 512);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_state_set_kernel(&state, LIBKECCAK_KERNEL_GENERIC))
+    return perror("libkeccak_state_set_kernel"), -1;
+  if (libkeccak_digest(&state, msg, strlen(msg), 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_digest"), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  for (kernel = LIBKECCAK_KERNEL_AUTO; kernel <= LIBKECCAK_KERNEL_MAX; kernel++)
+    {
+      printf("  Kernel %i: ", kernel);
+      if (libkeccak_state_initialise(&state, &spec))
+	return perror("libkeccak_state_initialise"), -1;
+      if (libkeccak_state_set_kernel(&state, kernel))
+	{
+	  libkeccak_state_fast_destroy(&state);
+	  if (errno != ENOTSUP)
+	    return perror("libkeccak_state_set_kernel"), -1;
+	  printf("not supported\n");
+	  continue;
+	}
+      if (libkeccak_digest(&state, msg, strlen(msg), 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+	return perror("libkeccak_digest"), -1;
+      libkeccak_state_fast_destroy(&state);
+      ok &= !memcmp(expected, hashsum, sizeof(hashsum));
+      printf("%s\n", memcmp(expected, hashsum, sizeof(hashsum)) ? "Fail" : "OK");
+    }
+  
+  printf("  Rejects 64-bit kernel for 32-bit words: ");
+  spec.bitrate = 256, spec.capacity = 800 - 256, spec.output = 256;
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  kernel = libkeccak_state_set_kernel(&state, LIBKECCAK_KERNEL_BMI2);
+  if (kernel && (errno != EINVAL) && (errno != ENOTSUP))
+    ok = 0;
+  printf("%s\n", kernel ? "OK" : "Fail");
+  ok &= !!kernel;
+  libkeccak_state_fast_destroy(&state);
+  
+  printf("\n");
+  return ok - 1;
+}
+
 
 /**
  * Run a test for `libkeccak_generalised_sum_fd`
@@ -622,6 +1823,316 @@ static int test_file(const libkeccak_spec_t* restrict spec, const char* restrict
 }
 
 
+/**
+ * Test that `libkeccak_generalised_sum_fd_flags` hashes large regular
+ * files, whether they are read, mapped or read on a separate thread,
+ * from the current position
+ * 
+ * @param   flags  The flags to use
+ * @return         Zero on success, -1 on error
+ */
+static int test_file_large(int flags)
+{
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char hashsum[256 / 8], expected[256 / 8];
+  size_t i, len = (5 << 20) + 13;
+  size_t start = (flags & LIBKECCAK_SUM_FD_DIRECT) ? 8192 : 4097;
+  char* restrict data;
+  FILE* f;
+  
+  printf("Testing libkeccak_generalised_sum_fd_flags on a large file, %s: ",
+	 (flags & LIBKECCAK_SUM_FD_DIRECT) ? "direct" :
+	 (flags & LIBKECCAK_SUM_FD_THREADED) ? "threaded" :
+	 (flags & LIBKECCAK_SUM_FD_MMAP) ? "mapped" : "read");
+  
+  if (data = malloc(len), data == NULL)
+    return perror("malloc"), -1;
+  for (i = 0; i < len; i++)
+    data[i] = (char)(i * 31 + (i >> 9));
+  if (f = tmpfile(), f == NULL)
+    return perror("tmpfile"), free(data), -1;
+  if (fwrite(data, 1, len, f) != len || fflush(f))
+    return perror("fwrite"), fclose(f), free(data), -1;
+  
+  /* Start at an offset that is not page-aligned, except
+   * for direct I/O, which requires aligned positions. */
+  if (lseek(fileno(f), (off_t)start, SEEK_SET) < 0)
+    return perror("lseek"), fclose(f), free(data), -1;
+  
+  libkeccak_spec_sha3(&spec, 256);
+  if (libkeccak_generalised_sum_fd_flags(fileno(f), &state, &spec, LIBKECCAK_SHA3_SUFFIX, hashsum, flags))
+    return perror("libkeccak_generalised_sum_fd_flags"), fclose(f), free(data), -1;
+  libkeccak_state_fast_destroy(&state);
+  if (lseek(fileno(f), 0, SEEK_CUR) != (off_t)len)
+    return printf("Fail\n"), fclose(f), free(data), -1;
+  
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), fclose(f), free(data), -1;
+  if (libkeccak_fast_digest(&state, data + start, len - start, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_fast_digest"), fclose(f), free(data), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  fclose(f);
+  free(data);
+  if (memcmp(hashsum, expected, sizeof(hashsum)))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  return 0;
+}
+
+
+/**
+ * Test that `libkeccak_fast_update_fd` absorbs a file in
+ * parts that together give the same hash as the whole file
+ * 
+ * @param   flags  The flags to use
+ * @return         Zero on success, -1 on error
+ */
+static int test_update_fd(int flags)
+{
+  static const uint64_t limits[] = {(1 << 20) + 7, 1000, (3 << 20) + 1, UINT64_MAX};
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char hashsum[256 / 8], expected[256 / 8];
+  size_t i, len = (5 << 20) + 13, start = 4097;
+  uint64_t absorbed, total = 0;
+  char* restrict data;
+  FILE* f;
+  
+  printf("Testing libkeccak_fast_update_fd, %s: ", (flags & LIBKECCAK_SUM_FD_MMAP) ? "mapped" : "read");
+  
+  if (data = malloc(len), data == NULL)
+    return perror("malloc"), -1;
+  for (i = 0; i < len; i++)
+    data[i] = (char)(i * 7 + (i >> 11));
+  if (f = tmpfile(), f == NULL)
+    return perror("tmpfile"), free(data), -1;
+  if (fwrite(data, 1, len, f) != len || fflush(f))
+    return perror("fwrite"), fclose(f), free(data), -1;
+  if (lseek(fileno(f), (off_t)start, SEEK_SET) < 0)
+    return perror("lseek"), fclose(f), free(data), -1;
+  
+  libkeccak_spec_sha3(&spec, 256);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), fclose(f), free(data), -1;
+  for (i = 0; i < sizeof(limits) / sizeof(*limits); i++)
+    {
+      if (libkeccak_fast_update_fd(&state, fileno(f), limits[i], &absorbed, flags))
+	return perror("libkeccak_fast_update_fd"), fclose(f), free(data), -1;
+      total += absorbed;
+      if ((absorbed != limits[i]) && (total != len - start))
+	return printf("Fail\n"), fclose(f), free(data), -1;
+    }
+  if ((total != len - start) || (lseek(fileno(f), 0, SEEK_CUR) != (off_t)len))
+    return printf("Fail\n"), fclose(f), free(data), -1;
+  if (libkeccak_fast_digest(&state, NULL, 0, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_fast_digest"), fclose(f), free(data), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), fclose(f), free(data), -1;
+  if (libkeccak_fast_digest(&state, data + start, len - start, 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_fast_digest"), fclose(f), free(data), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  fclose(f);
+  free(data);
+  if (memcmp(hashsum, expected, sizeof(hashsum)))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  return 0;
+}
+
+
+/**
+ * Test `libkeccak_generalised_sum_fd_tee`
+ * 
+ * @param   pipes  Whether to use pipes, rather than regular files
+ * @return         Zero on success, -1 on error
+ */
+static int test_file_tee(int pipes)
+{
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  char hashsum[256 / 8], expected[256 / 8];
+  char data[50000], copy[sizeof(data) + 1];
+  int in[2], out[2];
+  size_t i, n;
+  ssize_t got;
+  FILE* f = NULL;
+  FILE* g = NULL;
+  
+  printf("Testing libkeccak_generalised_sum_fd_tee, %s: ", pipes ? "pipes" : "files");
+  
+  for (i = 0; i < sizeof(data); i++)
+    data[i] = (char)(i * 7 + (i >> 8));
+  
+  /* The data fits in a pipe, so nothing blocks. */
+  if (pipes)
+    {
+      if (pipe(in) || pipe(out))
+	return perror("pipe"), -1;
+      if (write(in[1], data, sizeof(data)) != (ssize_t)sizeof(data))
+	return perror("write"), -1;
+      close(in[1]);
+    }
+  else
+    {
+      if (f = tmpfile(), g = tmpfile(), (f == NULL) || (g == NULL))
+	return perror("tmpfile"), -1;
+      if ((fwrite(data, 1, sizeof(data), f) != sizeof(data)) || fflush(f) || (lseek(fileno(f), 0, SEEK_SET) < 0))
+	return perror("fwrite"), -1;
+      in[0] = fileno(f), out[1] = out[0] = fileno(g);
+    }
+  
+  libkeccak_spec_sha3(&spec, 256);
+  if (libkeccak_generalised_sum_fd_tee(in[0], out[1], &state, &spec, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    return perror("libkeccak_generalised_sum_fd_tee"), -1;
+  libkeccak_state_fast_destroy(&state);
+  if (libkeccak_state_initialise(&state, &spec))
+    return perror("libkeccak_state_initialise"), -1;
+  if (libkeccak_fast_digest(&state, data, sizeof(data), 0, LIBKECCAK_SHA3_SUFFIX, expected))
+    return perror("libkeccak_fast_digest"), -1;
+  libkeccak_state_fast_destroy(&state);
+  
+  if (pipes)
+    close(in[0]), close(out[1]);
+  else if (lseek(out[0], 0, SEEK_SET) < 0)
+    return perror("lseek"), -1;
+  for (n = 0; n < sizeof(copy); n += (size_t)got)
+    if (got = read(out[0], copy + n, sizeof(copy) - n), got <= 0)
+      break;
+  if (pipes)
+    close(out[0]);
+  else
+    fclose(f), fclose(g);
+  
+  if ((n != sizeof(data)) || memcmp(copy, data, sizeof(data)) || memcmp(hashsum, expected, sizeof(hashsum)))
+    return printf("Fail\n"), -1;
+  printf("OK\n");
+  return 0;
+}
+
+
+/**
+ * The expectations for `test_sum_files_callback`
+ */
+struct sum_files_test
+{
+  /**
+   * The expected hashsums
+   */
+  char (*expected)[256 / 8];
+  
+  /**
+   * The index of the file that should not exist
+   */
+  size_t missing;
+  
+  /**
+   * The index of the next file
+   */
+  size_t next;
+  
+  /**
+   * Whether a file was wrong
+   */
+  char failed;
+  
+  char __pad[sizeof(size_t) - 1];
+};
+
+
+/**
+ * Check a file hashed by `libkeccak_sum_files`
+ * 
+ * @param   test   The expectations, `struct sum_files_test*`
+ * @param   index  The index of the file
+ * @param   state  The hashing state
+ * @param   error  `errno` if the file could not be hashed, zero otherwise
+ * @return         Zero
+ */
+static int test_sum_files_callback(void* test_, size_t index, libkeccak_state_t* state, int error)
+{
+  struct sum_files_test* test = test_;
+  char hashsum[256 / 8];
+  
+  if (index != test->next++)
+    test->failed = 1;
+  else if (index == test->missing)
+    test->failed |= (char)(error != ENOENT);
+  else if (error)
+    test->failed = 1;
+  else if (libkeccak_fast_digest(state, NULL, 0, 0, LIBKECCAK_SHA3_SUFFIX, hashsum))
+    test->failed = 1;
+  else
+    test->failed |= (char)!!memcmp(hashsum, test->expected[index], sizeof(hashsum));
+  return 0;
+}
+
+
+/**
+ * Test `libkeccak_sum_files`
+ * 
+ * @param   flags  The flags to use
+ * @return         Zero on success, -1 on error
+ */
+static int test_sum_files(int flags)
+{
+#define FILES  45
+  static char names[FILES][sizeof("/tmp/libkeccak-test-XXXXXX")];
+  const char* filenames[FILES];
+  char expected[FILES][256 / 8];
+  struct sum_files_test test;
+  libkeccak_spec_t spec;
+  char* restrict data;
+  size_t i, len = 300000;
+  int fd, r = 0;
+  
+  printf("Testing libkeccak_sum_files, %s: ",
+	 (flags & LIBKECCAK_SUM_FILES_NO_IO_URING) ? "thread pool" : "io_uring if supported");
+  
+  if (data = malloc(len), data == NULL)
+    return perror("malloc"), -1;
+  for (i = 0; i < len; i++)
+    data[i] = (char)(i * 7 + (i >> 11));
+  
+  libkeccak_spec_sha3(&spec, 256);
+  for (i = 0; i < FILES; i++)
+    {
+      strcpy(names[i], "/tmp/libkeccak-test-XXXXXX");
+      if (fd = mkstemp(names[i]), fd < 0)
+	return perror("mkstemp"), -1;
+      /* Sizes from empty to a few reads. */
+      if (write(fd, data, (i * i * 331) % len) != (ssize_t)((i * i * 331) % len))
+	return perror("write"), close(fd), -1;
+      close(fd);
+      libkeccak_sha3_256(expected[i], data, (i * i * 331) % len);
+      filenames[i] = names[i];
+    }
+  
+  test.expected = expected;
+  test.missing = 37;
+  test.next = 0;
+  test.failed = 0;
+  unlink(names[test.missing]);
+  
+  if (libkeccak_sum_files(filenames, FILES, &spec, flags, test_sum_files_callback, &test))
+    r = (perror("libkeccak_sum_files"), -1);
+  else if (test.failed || (test.next != FILES))
+    r = (printf("Fail\n"), -1);
+  else
+    printf("OK\n");
+  
+  for (i = 0; i < FILES; i++)
+    unlink(names[i]);
+  free(data);
+  return r;
+#undef FILES
+}
+
+
 /**
  * Basically, verify the correctness of the library.
  * The current working path must be the root directory
@@ -651,16 +2162,49 @@ int main(void)
   if (gspec.output != 512)                                 return printf("Incorrect information\n"), 1;
   printf("\n");
   
-  if (test_hex())         return 1;
-  if (test_state(&spec))  return 1;
-  if (test_digest())      return 1;
-  if (test_update())      return 1;
-  if (test_squeeze())     return 1;
+  if (test_hex())           return 1;
+  if (test_state(&spec))    return 1;
+  if (test_digest())        return 1;
+  if (test_update())        return 1;
+  if (test_update_split())  return 1;
+  if (test_squeeze())       return 1;
+  if (test_squeeze_bytes()) return 1;
+  if (test_digest_x4())     return 1;
+  if (test_oneshot())       return 1;
+  if (test_embedded())      return 1;
+  if (test_state_pool())    return 1;
+  if (test_checkpoint())    return 1;
+  if (test_k12())           return 1;
+  if (test_parallelhash())  return 1;
+  if (test_hmac())          return 1;
+  if (test_hmac_many())     return 1;
+  if (test_kmac())          return 1;
+  if (test_kernels())       return 1;
   
   if (test_file(&spec, LIBKECCAK_SHA3_SUFFIX, "LICENSE",
 		"68dd720832a594c1986078d2d09ab21d80b9d66d98c52f2679e81699519e2f8a"
 		"3c970bb9c514206b574a944ffaa6466d546eb17f64f47c01ec053ab4ce35575a"))
     return 1;
+  if (test_file_large(0))
+    return 1;
+  if (test_file_large(LIBKECCAK_SUM_FD_MMAP))
+    return 1;
+  if (test_file_large(LIBKECCAK_SUM_FD_THREADED))
+    return 1;
+  if (test_file_large(LIBKECCAK_SUM_FD_DIRECT))
+    return 1;
+  if (test_update_fd(0))
+    return 1;
+  if (test_update_fd(LIBKECCAK_SUM_FD_MMAP))
+    return 1;
+  if (test_file_tee(0))
+    return 1;
+  if (test_file_tee(1))
+    return 1;
+  if (test_sum_files(0))
+    return 1;
+  if (test_sum_files(LIBKECCAK_SUM_FILES_NO_IO_URING))
+    return 1;
   
   return 0;
 }
@@ -23,11 +23,16 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <alloca.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 
 
 #ifndef STDIN_PATH
@@ -37,6 +42,24 @@
 # define STDIN_PATH  DEVDIR "/stdin"
 #endif
 
+#ifndef CHECKPOINT_INTERVAL
+# define CHECKPOINT_INTERVAL  ((uint64_t)1 << 30)
+#endif
+
+/**
+ * The size of the record, stored after the two checkpoints
+ * in a checkpoint file, that identifies the file being hashed
+ */
+#define IDENTITY_SIZE  (8 + 5 * sizeof(uint64_t))
+
+#ifndef HEX_INPUT_SIZE
+# define HEX_INPUT_SIZE  ((size_t)64 << 10)
+#endif
+
+#ifndef OUTPUT_CHUNK_SIZE
+# define OUTPUT_CHUNK_SIZE  ((size_t)64 << 10)
+#endif
+
 
 
 #define USER_ERROR(string) 				\
@@ -76,12 +99,88 @@ static int bad_found = 0;
  */
 static char* execname;
 
+/**
+ * The function that calculates checksums of files, `NULL`
+ * if the algorithm is a single sponge
+ */
+static int (*tree_sum_fd)(int, const libkeccak_spec_t* restrict, char* restrict) = NULL;
+
+/**
+ * The file that checkpoints are saved to, `NULL` if
+ * hashing shall not be resumable
+ */
+static const char* restrict checkpoint_file = NULL;
+
+/**
+ * Flags for `libkeccak_generalised_sum_fd_flags`
+ */
+static int sum_flags = 0;
+
+/**
+ * Whether the input shall be forwarded, unchanged, to
+ * standard output, with the checksums printed to
+ * standard error rather than standard output
+ */
+static int forward = 0;
+
+/**
+ * Where the checksums are printed
+ */
+static FILE* checksum_output = NULL;
+
+
+
+/**
+ * Remove all whitespace, that is, all ASCII whitespace and
+ * control characters, from a buffer; other bytes, including
+ * non-ASCII bytes, are kept, so that they are rejected as not
+ * hexadecimal rather than ignored
+ * 
+ * @param   buf  The buffer
+ * @param   len  The number of bytes in `buf`
+ * @return       The number of bytes left in `buf`
+ */
+__attribute__((nonnull))
+static size_t strip_whitespace(char* restrict buf, size_t len)
+{
+  size_t r = 0, w = 0;
+  unsigned char c;
+#ifdef __SSE2__
+  __m128i space = _mm_set1_epi8(' '), del = _mm_set1_epi8(0x7F), x, skip;
+  int mask;
+  
+  /* Runs of 16 digits are moved, and runs of 16 whitespace
+   * characters are skipped, without looking at each byte.
+   * There is no unsigned comparison, but a byte is at most
+   * ' ' exactly when it is its minimum, unsigned, with ' '. */
+  for (; r + 16 <= len; r += 16)
+    {
+      x = _mm_loadu_si128((const __m128i*)(const void*)(buf + r));
+      skip = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, space), x), _mm_cmpeq_epi8(x, del));
+      mask = ~_mm_movemask_epi8(skip) & 0xFFFF;
+      if (mask == 0xFFFF)
+	_mm_storeu_si128((__m128i*)(void*)(buf + w), x), w += 16;
+      else
+	for (; mask; mask &= mask - 1)
+	  buf[w++] = buf[r + (size_t)__builtin_ctz((unsigned)mask)];
+    }
+#endif
+  for (; r < len; r++)
+    if (c = (unsigned char)(buf[r]), (c > ' ') && (c != 0x7F))
+      buf[w++] = buf[r];
+  return w;
+}
 
 
 /**
  * Calculate a Keccak-family hashsum of a file,
  * the content of the file is assumed non-sensitive
  * 
+ * The file is read in hexadecimal, whitespace is ignored,
+ * and it is an error, with `errno` set to `EINVAL`, if
+ * it contains anything else than an even number of
+ * hexadecimal digits
+ * 
  * @param   fd      The file descriptor of the file to hash
  * @param   state   The hashing state, should not be initialised (memory leak otherwise)
  * @param   spec    Specifications for the hashing algorithm
@@ -97,9 +196,9 @@ static int generalised_sum_fd_hex(int fd, libkeccak_state_t* restrict state,
 {
   ssize_t got;
   struct stat attr;
-  size_t blksize = 4096, r_ptr = 0, w_ptr = 0;
+  size_t blksize = 4096, have = 0;
   char* restrict chunk;
-  char even = 1, buf = 0, c;
+  char* restrict binary;
   
   if (libkeccak_state_initialise(state, spec) < 0)
     return -1;
@@ -108,29 +207,199 @@ static int generalised_sum_fd_hex(int fd, libkeccak_state_t* restrict state,
     if (attr.st_blksize > 0)
       blksize = (size_t)(attr.st_blksize);
   
-  chunk = alloca(blksize);
+  /* Read at least `HEX_INPUT_SIZE` bytes at a time, so that
+   * the decoding and hashing is done in large blocks. */
+  if (blksize < HEX_INPUT_SIZE)
+    blksize = (HEX_INPUT_SIZE + blksize - 1) / blksize * blksize;
+  
+  chunk = alloca(blksize + 1);
+  binary = alloca(blksize / 2 + 1);
   
   for (;;)
     {
-      got = read(fd, chunk, blksize);
-      if (got < 0)   return -1;
-      if (got == 0)  break;
-      while (r_ptr < (size_t)got)
+      /* `have` is 1 if the last digit of the previous
+       * block was left over, and is in `chunk[0]`. */
+      got = read(fd, chunk + have, blksize);
+      if (got < 0)
 	{
-	  if (c = chunk[r_ptr++], c <= ' ')
+	  if (errno == EINTR)
 	    continue;
-	  buf = (buf << 4) | ((c & 15) + (c > '9' ? 9 : 0));
-	  if ((even ^= 1))
-	    chunk[w_ptr++] = buf;
+	  return -1;
 	}
-      if (libkeccak_fast_update(state, chunk, w_ptr) < 0)
+      if (got == 0)
+	break;
+      have += strip_whitespace(chunk + have, (size_t)got);
+      if (libkeccak_unhex_checked(binary, chunk, have & ~(size_t)1, NULL))
+	return -1;
+      if (libkeccak_fast_update(state, binary, have / 2) < 0)
 	return -1;
+      if (have & 1)
+	chunk[0] = chunk[have - 1];
+      have &= 1;
     }
   
+  if (have)
+    return errno = EINVAL, -1;
+  
   return libkeccak_fast_digest(state, NULL, 0, 0, suffix, hash);
 }
 
 
+/**
+ * Describe the file being hashed, so that a checkpoint is never resumed
+ * for another file, or for the same file after it has been modified
+ * 
+ * @param  identity  Output buffer, of `IDENTITY_SIZE` bytes
+ * @param  attr      The attributes of the file being hashed
+ */
+static void make_identity(char* restrict identity, const struct stat* restrict attr)
+{
+  uint64_t fields[5];
+  fields[0] = (uint64_t)(attr->st_dev);
+  fields[1] = (uint64_t)(attr->st_ino);
+  fields[2] = (uint64_t)(attr->st_size);
+  fields[3] = (uint64_t)(attr->st_mtim.tv_sec);
+  fields[4] = (uint64_t)(attr->st_mtim.tv_nsec);
+  memcpy(identity, "sha3sum\0", 8);
+  memcpy(identity + 8, fields, sizeof(fields));
+}
+
+
+/**
+ * Load the newest valid checkpoint from the checkpoint file, it has two
+ * slots, that are written alternately, so that one is always intact,
+ * followed by a record identifying the file the checkpoints are for
+ * 
+ * @param   cpfd      The file descriptor of the checkpoint file
+ * @param   state     The hashing state, initialised with `spec`
+ * @param   spec      Specifications for the hashing algorithm
+ * @param   identity  The identity of the file being hashed, see `make_identity`
+ * @param   position  Output parameter for the number of bytes already hashed,
+ *                    zero if there is no valid checkpoint
+ * @param   slot      Output parameter for the slot the next checkpoint shall be saved in
+ * @return            Zero on success, an appropriate exit value on error
+ */
+static int load_checkpoint(int cpfd, libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec,
+			   const char* restrict identity, uint64_t* restrict position, int* restrict slot)
+{
+  char data[2 * LIBKECCAK_CHECKPOINT_SIZE + IDENTITY_SIZE];
+  size_t have[2] = {0, 0};
+  uint64_t positions[2];
+  int valid[2], i, j, newest;
+  ssize_t got;
+  libkeccak_spec_t cpspec;
+  
+  while (got = pread(cpfd, data, sizeof(data), 0), got < 0)
+    if (errno != EINTR)
+      return perror(execname), 2;
+  
+  if ((size_t)got >= 2 * LIBKECCAK_CHECKPOINT_SIZE)
+    have[0] = have[1] = LIBKECCAK_CHECKPOINT_SIZE;
+  else if ((size_t)got > LIBKECCAK_CHECKPOINT_SIZE)
+    have[0] = LIBKECCAK_CHECKPOINT_SIZE, have[1] = (size_t)got - LIBKECCAK_CHECKPOINT_SIZE;
+  else
+    have[0] = (size_t)got;
+  
+  for (i = 0; i < 2; i++)
+    {
+      valid[i] = !libkeccak_checkpoint_verify(data + i * LIBKECCAK_CHECKPOINT_SIZE, have[i], &cpspec);
+      if (valid[i] && ((cpspec.bitrate != spec->bitrate) || (cpspec.capacity != spec->capacity) ||
+		       (cpspec.output != spec->output)))
+	return USER_ERROR("the checkpoint was saved with other algorithm parameters");
+      /* The position is stored in little-endian at offset 40. */
+      for (positions[i] = 0, j = 8; valid[i] && j--;)
+	positions[i] = (positions[i] << 8) | (unsigned char)(data[i * LIBKECCAK_CHECKPOINT_SIZE + 40 + j]);
+    }
+  
+  *position = 0, *slot = 0;
+  if (!valid[0] && !valid[1])
+    return 0;
+  if (((size_t)got < sizeof(data)) || memcmp(data + 2 * LIBKECCAK_CHECKPOINT_SIZE, identity, IDENTITY_SIZE))
+    return USER_ERROR("the checkpoint is not for this file");
+  newest = !valid[0] || (valid[1] && (positions[1] > positions[0]));
+  /* The checkpoint has been verified, so only the number of rounds can differ. */
+  if (libkeccak_checkpoint_resume(state, data + newest * LIBKECCAK_CHECKPOINT_SIZE, have[newest], position))
+    return USER_ERROR("the checkpoint was saved with other algorithm parameters");
+  *slot = newest ^ 1;
+  return 0;
+}
+
+
+/**
+ * Calculate a Keccak-family hashsum of a file, like `libkeccak_generalised_sum_fd`,
+ * but save checkpoints to `checkpoint_file` regularly, and resume from the
+ * newest checkpoint in it; the file is removed when the file has been hashed,
+ * and a checkpoint is only resumed for the same, unmodified, file
+ * 
+ * @param   fd      The file descriptor of the file to hash
+ * @param   state   The hashing state, should not be initialised (memory leak otherwise)
+ * @param   spec    Specifications for the hashing algorithm
+ * @param   suffix  The data suffix, see `libkeccak_digest`
+ * @param   hash    Output array for the hashsum, have an allocation size of
+ *                  at least `(spec->output / 8) * sizeof(char)`, may be `NULL`
+ * @return          Zero on success, an appropriate exit value on error
+ */
+__attribute__((nonnull(2, 3)))
+static int resumable_sum_fd(int fd, libkeccak_state_t* restrict state, const libkeccak_spec_t* restrict spec,
+			    const char* restrict suffix, char* restrict hash)
+{
+  char checkpoint[LIBKECCAK_CHECKPOINT_SIZE];
+  char identity[IDENTITY_SIZE];
+  struct stat attr;
+  uint64_t position, absorbed;
+  int cpfd, slot, r;
+  
+  if (libkeccak_state_initialise(state, spec) < 0)
+    return perror(execname), 2;
+  
+  if (fstat(fd, &attr))
+    return perror(execname), 2;
+  make_identity(identity, &attr);
+  
+  if (cpfd = open(checkpoint_file, O_RDWR | O_CREAT, 0666), cpfd < 0)
+    return perror(execname), 2;
+  if ((r = load_checkpoint(cpfd, state, spec, identity, &position, &slot)))
+    return close(cpfd), r;
+  
+  if (S_ISREG(attr.st_mode) && (position > (uint64_t)(attr.st_size)))
+    return close(cpfd), USER_ERROR("the checkpoint is not for this file");
+  if (position && (lseek(fd, (off_t)position, SEEK_SET) < 0))
+    goto pfail;
+  if (!position && (pwrite(cpfd, identity, sizeof(identity), 2 * LIBKECCAK_CHECKPOINT_SIZE) != sizeof(identity)))
+    goto pfail;
+  
+  /* The file is read with large buffers, or mapped, between checkpoints. */
+  for (;;)
+    {
+      r = libkeccak_fast_update_fd(state, fd, CHECKPOINT_INTERVAL, &absorbed, sum_flags & LIBKECCAK_SUM_FD_MMAP);
+      position += absorbed;
+      if (r < 0)
+	goto pfail;
+      if (absorbed < CHECKPOINT_INTERVAL)
+	break;
+      if (libkeccak_checkpoint_save(state, position, checkpoint))
+	goto pfail;
+      if (pwrite(cpfd, checkpoint, sizeof(checkpoint), (off_t)slot * LIBKECCAK_CHECKPOINT_SIZE) != sizeof(checkpoint))
+	goto pfail;
+      if (fdatasync(cpfd))
+	goto pfail;
+      slot ^= 1;
+    }
+  
+  if (libkeccak_fast_digest(state, NULL, 0, 0, suffix, hash))
+    goto pfail;
+  close(cpfd);
+  if (unlink(checkpoint_file))
+    return perror(execname), 2;
+  return 0;
+  
+ pfail:
+  perror(execname);
+  close(cpfd);
+  return 2;
+}
+
+
 /**
  * Convert `libkeccak_generalised_spec_t` to `libkeccak_spec_t` and check for errors
  * 
@@ -187,38 +456,87 @@ static int make_spec(libkeccak_generalised_spec_t* restrict gspec, libkeccak_spe
 /**
  * Calculate the checksum of a file and store it in the global variable `hashsum`
  * 
+ * If `xof` is not `NULL`, the checksum is not stored, instead the state is
+ * stored in `*xof`, prepared for `libkeccak_squeeze_bytes`, so that the
+ * checksum can be read in pieces; the caller must destroy the state
+ * 
  * @param   filename        The file to hash
  * @param   spec            Hashing parameters
  * @param   squeezes        The number of squeezes to perform
  * @param   suffix          The message suffix
  * @param   hex             Whether to use hexadecimal input rather than binary
+ * @param   xof             Output parameter for the hashing state, may be `NULL`
  * @return                  Zero on success, an appropriate exit value on error
  */
 static int hash(const char* restrict filename, const libkeccak_spec_t* restrict spec,
-		long squeezes, const char* restrict suffix, int hex)
+		long squeezes, const char* restrict suffix, int hex, libkeccak_state_t* restrict xof)
 {
   libkeccak_state_t state;
+  libkeccak_spec_t xof_spec;
   size_t length;
+  long blocks;
   int r, fd;
   
   length = (size_t)((spec->output + 7) / 8);
   
-  if (hashsum == NULL)
-    if (hashsum = malloc(length * sizeof(char)), hashsum == NULL)
-      return perror(execname), 2;
-  
-  if (hexsum == NULL)
-    if (hexsum = malloc((length * 2 + 1) * sizeof(char)), hexsum == NULL)
-      return perror(execname), 2;
+  if (xof != NULL)
+    {
+      /* Absorb only, the output is squeezed out by the caller. */
+      blocks = (spec->output - 1) / spec->bitrate + 1;
+      xof_spec = *spec;
+      xof_spec.output = 8;
+      spec = &xof_spec;
+    }
+  else
+    {
+      if (hashsum == NULL)
+	if (hashsum = malloc(length * sizeof(char)), hashsum == NULL)
+	  return perror(execname), 2;
+      
+      if (hexsum == NULL)
+	if (hexsum = malloc((length * 2 + 1) * sizeof(char)), hexsum == NULL)
+	  return perror(execname), 2;
+    }
   
   if (fd = open(strcmp(filename, "-") ? filename : STDIN_PATH, O_RDONLY), fd < 0)
     return r = (errno != ENOENT), perror(execname), r + 1;
   
-  if ((hex == 0 ? libkeccak_generalised_sum_fd : generalised_sum_fd_hex)
-      (fd, &state, spec, suffix, squeezes > 1 ? NULL : hashsum))
-    return perror(execname), close(fd), libkeccak_state_fast_destroy(&state), 2;
+  if (tree_sum_fd != NULL)
+    {
+      if (tree_sum_fd(fd, spec, hashsum))
+	return perror(execname), close(fd), 2;
+      close(fd);
+      return 0;
+    }
+  
+  if (checkpoint_file != NULL)
+    {
+      if ((r = resumable_sum_fd(fd, &state, spec, suffix, (squeezes > 1 || xof) ? NULL : hashsum)))
+	return close(fd), libkeccak_state_fast_destroy(&state), r;
+    }
+  else if (hex ? generalised_sum_fd_hex(fd, &state, spec, suffix, (squeezes > 1 || xof) ? NULL : hashsum)
+	   : forward ? libkeccak_generalised_sum_fd_tee(fd, STDOUT_FILENO, &state, spec, suffix,
+							(squeezes > 1 || xof) ? NULL : hashsum)
+	   : libkeccak_generalised_sum_fd_flags(fd, &state, spec, suffix,
+						(squeezes > 1 || xof) ? NULL : hashsum, sum_flags))
+    {
+      if (hex && (errno == EINVAL))
+	fprintf(stderr, "%s: %s: %s.\n", execname, filename, "input is not hexadecimal");
+      else
+	perror(execname);
+      return close(fd), libkeccak_state_fast_destroy(&state), 2;
+    }
   close(fd);
   
+  if (xof != NULL)
+    {
+      for (; squeezes > 1; squeezes--)
+	libkeccak_simple_squeeze(&state, blocks);
+      state.mptr = 0;
+      *xof = state;
+      return 0;
+    }
+  
   if (squeezes > 2)  libkeccak_fast_squeeze(&state, squeezes - 2);
   if (squeezes > 1)  libkeccak_squeeze(&state, hashsum);
   libkeccak_state_fast_destroy(&state);
@@ -252,7 +570,7 @@ static int check(const libkeccak_spec_t* restrict spec, long squeezes, const cha
       return 0;
     }
   
-  if ((r = hash(filename, spec, squeezes, suffix, hex)))
+  if ((r = hash(filename, spec, squeezes, suffix, hex, NULL)))
     return r;
   
   libkeccak_unhex(correct_binary, correct_hash);
@@ -417,7 +735,9 @@ static int check_checksums(const char* restrict filename, const libkeccak_spec_t
 
 
 /**
- * Print the checksum of a file
+ * Print the checksum of a file that is too large to be kept in memory,
+ * the checksum is squeezed out and written in pieces of `OUTPUT_CHUNK_SIZE` bytes;
+ * the rate must be a whole number of lanes
  * 
  * @param   filename        The file to hash
  * @param   spec            Hashing parameters
@@ -428,33 +748,96 @@ static int check_checksums(const char* restrict filename, const libkeccak_spec_t
  * @param   hex             Whether to use hexadecimal input rather than binary
  * @return                  Zero on success, an appropriate exit value on error
  */
-static int print_checksum(const char* restrict filename, const libkeccak_spec_t* restrict spec,
-			  long squeezes, const char* restrict suffix, int representation, int hex)
+static int stream_checksum(const char* restrict filename, const libkeccak_spec_t* restrict spec,
+			   long squeezes, const char* restrict suffix, int representation, int hex)
 {
+  libkeccak_state_t state;
   size_t length = (size_t)((spec->output + 7) / 8);
+  size_t n, ptr;
+  ssize_t wrote;
+  char* restrict chunk;
+  char* restrict hexchunk = NULL;
+  char* restrict out;
   int r;
   
-  if ((r = hash(filename, spec, squeezes, suffix, hex)))
-    return r;
+  if (chunk = malloc(OUTPUT_CHUNK_SIZE * sizeof(char)), chunk == NULL)
+    return perror(execname), 2;
+  if (representation != REPRESENTATION_BINARY)
+    if (hexchunk = malloc(OUTPUT_CHUNK_SIZE * 2 * sizeof(char)), hexchunk == NULL)
+      return perror(execname), free(chunk), 2;
+  
+  if ((r = hash(filename, spec, squeezes, suffix, hex, &state)))
+    return free(chunk), free(hexchunk), r;
+  
+  fflush(checksum_output);
+  for (; length; length -= n)
+    {
+      n = length < OUTPUT_CHUNK_SIZE ? length : OUTPUT_CHUNK_SIZE;
+      libkeccak_squeeze_bytes(&state, chunk, n);
+      if ((n == length) && (spec->output & 7))
+	chunk[n - 1] &= (char)((1 << (spec->output & 7)) - 1);
+      
+      if (representation == REPRESENTATION_UPPER_CASE)
+	libkeccak_behex_upper(out = hexchunk, chunk, n), n *= 2;
+      else if (representation == REPRESENTATION_LOWER_CASE)
+	libkeccak_behex_lower(out = hexchunk, chunk, n), n *= 2;
+      else
+	out = chunk;
+      
+      for (ptr = 0; ptr < n; ptr += (size_t)wrote)
+	if (wrote = write(fileno(checksum_output), out + ptr, n - ptr), wrote <= 0)
+	  goto fail;
+      
+      if (out == hexchunk)
+	n /= 2;
+    }
+  
+  libkeccak_state_fast_destroy(&state);
+  free(chunk);
+  free(hexchunk);
+  if (representation != REPRESENTATION_BINARY)
+    fprintf(checksum_output, "  %s\n", filename);
+  return 0;
+  
+ fail:
+  perror(execname);
+  libkeccak_state_fast_destroy(&state);
+  free(chunk);
+  free(hexchunk);
+  return 2;
+}
+
+
+/**
+ * Print the checksum in the global variable `hashsum`
+ * 
+ * @param   filename        The file that was hashed
+ * @param   length          The size of the checksum
+ * @param   representation  Either of `REPRESENTATION_BINARY`, `REPRESENTATION_UPPER_CASE`
+ *                          and `REPRESENTATION_LOWER_CASE`
+ * @return                  Zero on success, an appropriate exit value on error
+ */
+static int print_hashsum(const char* restrict filename, size_t length, int representation)
+{
+  size_t ptr = 0;
+  ssize_t wrote;
   
   if (representation == REPRESENTATION_UPPER_CASE)
     {
       libkeccak_behex_upper(hexsum, hashsum, length);
-      printf("%s  %s\n", hexsum, filename);
+      fprintf(checksum_output, "%s  %s\n", hexsum, filename);
     }
   else if (representation == REPRESENTATION_LOWER_CASE)
     {
       libkeccak_behex_lower(hexsum, hashsum, length);
-      printf("%s  %s\n", hexsum, filename);
+      fprintf(checksum_output, "%s  %s\n", hexsum, filename);
     }
   else
     {
-      size_t ptr = 0;
-      ssize_t wrote;
-      fflush(stdout);
+      fflush(checksum_output);
       while (length - ptr)
 	{
-	  wrote = write(STDOUT_FILENO, hashsum, length - ptr);
+	  wrote = write(fileno(checksum_output), hashsum + ptr, length - ptr);
 	  if (wrote <= 0)
 	    return perror(execname), 2;
 	  ptr += (size_t)wrote;
@@ -465,6 +848,145 @@ static int print_checksum(const char* restrict filename, const libkeccak_spec_t*
 }
 
 
+/**
+ * Print the checksum of a file
+ * 
+ * @param   filename        The file to hash
+ * @param   spec            Hashing parameters
+ * @param   squeezes        The number of squeezes to perform
+ * @param   suffix          The message suffix
+ * @param   representation  Either of `REPRESENTATION_BINARY`, `REPRESENTATION_UPPER_CASE`
+ *                          and `REPRESENTATION_LOWER_CASE`
+ * @param   hex             Whether to use hexadecimal input rather than binary
+ * @return                  Zero on success, an appropriate exit value on error
+ */
+static int print_checksum(const char* restrict filename, const libkeccak_spec_t* restrict spec,
+			  long squeezes, const char* restrict suffix, int representation, int hex)
+{
+  size_t length = (size_t)((spec->output + 7) / 8);
+  long lane = (spec->bitrate + spec->capacity) / 25 / 8;
+  int r;
+  
+  /* If the rate is not a whole number of lanes, the squeeze functions
+   * advance the sponge by the rate rather than by the bytes output from
+   * each block, so the output can only be streamed in the other case. */
+  if ((tree_sum_fd == NULL) && (length > OUTPUT_CHUNK_SIZE) && !((spec->bitrate / 8) % lane))
+    return stream_checksum(filename, spec, squeezes, suffix, representation, hex);
+  
+  if ((r = hash(filename, spec, squeezes, suffix, hex, NULL)))
+    return r;
+  
+  return print_hashsum(filename, length, representation);
+}
+
+
+/**
+ * The parameters `print_checksums` passes to `print_batched_checksum`
+ */
+struct batch
+{
+  /**
+   * The files as given by the user
+   */
+  char** filenames;
+  
+  /**
+   * The message suffix
+   */
+  const char* suffix;
+  
+  /**
+   * The number of squeezes to perform
+   */
+  long squeezes;
+  
+  /**
+   * The size of the checksums
+   */
+  size_t length;
+  
+  /**
+   * Either of `REPRESENTATION_BINARY`, `REPRESENTATION_UPPER_CASE`
+   * and `REPRESENTATION_LOWER_CASE`
+   */
+  int representation;
+  
+  char __pad[sizeof(long) - sizeof(int)];
+};
+
+
+/**
+ * Finish and print the checksum of a file hashed by `libkeccak_sum_files`
+ * 
+ * @param   batch_  The parameters, `struct batch*`
+ * @param   index   The index of the file
+ * @param   state   The hashing state, the file has been absorbed
+ * @param   error   `errno` if the file could not be hashed, zero otherwise
+ * @return          Zero on success, an appropriate exit value on error
+ */
+static int print_batched_checksum(void* batch_, size_t index, libkeccak_state_t* state, int error)
+{
+  struct batch* restrict batch = batch_;
+  
+  if (error)
+    return errno = error, perror(execname), (error != ENOENT) + 1;
+  
+  if (libkeccak_fast_digest(state, NULL, 0, 0, batch->suffix, batch->squeezes > 1 ? NULL : hashsum))
+    return perror(execname), 2;
+  if (batch->squeezes > 2)  libkeccak_fast_squeeze(state, batch->squeezes - 2);
+  if (batch->squeezes > 1)  libkeccak_squeeze(state, hashsum);
+  
+  return print_hashsum(batch->filenames[index], batch->length, batch->representation);
+}
+
+
+/**
+ * Print the checksums of many files, with many files being read at
+ * the same time, rather than opening, reading and closing one at a time
+ * 
+ * @param   filenames       The files to hash
+ * @param   n               The number of files
+ * @param   spec            Hashing parameters
+ * @param   squeezes        The number of squeezes to perform
+ * @param   suffix          The message suffix
+ * @param   representation  Either of `REPRESENTATION_BINARY`, `REPRESENTATION_UPPER_CASE`
+ *                          and `REPRESENTATION_LOWER_CASE`
+ * @return                  Zero on success, an appropriate exit value on error
+ */
+static int print_checksums(char** filenames, size_t n, const libkeccak_spec_t* restrict spec,
+			   long squeezes, const char* restrict suffix, int representation)
+{
+  struct batch batch;
+  const char** paths;
+  size_t i;
+  int r;
+  
+  batch.filenames = filenames;
+  batch.suffix = suffix;
+  batch.squeezes = squeezes;
+  batch.length = (size_t)((spec->output + 7) / 8);
+  batch.representation = representation;
+  
+  if (hashsum == NULL)
+    if (hashsum = malloc(batch.length * sizeof(char)), hashsum == NULL)
+      return perror(execname), 2;
+  if (hexsum == NULL)
+    if (hexsum = malloc((batch.length * 2 + 1) * sizeof(char)), hexsum == NULL)
+      return perror(execname), 2;
+  
+  if (paths = malloc(n * sizeof(*paths)), paths == NULL)
+    return perror(execname), 2;
+  for (i = 0; i < n; i++)
+    paths[i] = strcmp(filenames[i], "-") ? filenames[i] : STDIN_PATH;
+  
+  r = libkeccak_sum_files(paths, n, spec, 0, print_batched_checksum, &batch);
+  if (r < 0)
+    r = (perror(execname), 2);
+  free(paths);
+  return r;
+}
+
+
 /**
  * Cleanup allocations
  */
@@ -508,6 +1030,11 @@ int run(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec, co
   ADD(NULL,       "Use hexadecimal input",  "-x", "--hex", "--hex-input");
   ADD(NULL,       "Check checksums",        "-c", "--check");
   ADD(NULL,       "Be verbose",             "-v", "--verbose");
+  ADD("FILE",     "Resume from and save checkpoints", "-k", "--checkpoint");
+  ADD(NULL,       "Read files on a separate thread", "-T", "--threaded");
+  ADD(NULL,       "Read files with direct I/O", "-D", "--direct");
+  ADD(NULL,       "Map files into memory", "-M", "--mmap");
+  ADD(NULL,       "Forward input to stdout, print checksums to stderr", "-t", "--tee");
   /* --check has been added because the sha1sum, sha256sum &c have it,
    * but I ignore the other crap, mostly because not all implemention
    * have them and binary vs text mode is stupid. */
@@ -527,12 +1054,54 @@ int run(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec, co
   if (args_opts_used("-x"))  hex               = 1;
   if (args_opts_used("-c"))  check             = 1;
   if (args_opts_used("-v"))  verbose           = 1;
+  if (args_opts_used("-k"))  checkpoint_file   = LAST("-k");
+  if (args_opts_used("-T"))  sum_flags        |= LIBKECCAK_SUM_FD_THREADED;
+  if (args_opts_used("-D"))  sum_flags        |= LIBKECCAK_SUM_FD_DIRECT;
+  if (args_opts_used("-M"))  sum_flags        |= LIBKECCAK_SUM_FD_MMAP;
+  if (args_opts_used("-t"))  forward           = 1;
+  
+  checksum_output = forward ? stderr : stdout;
   
   fun = check ? check_checksums : print_checksum;
   
   if ((r = make_spec(gspec, &spec)))
       goto done;
   
+  if ((tree_sum_fd != NULL) && (args_opts_used("-R") || args_opts_used("-C") || args_opts_used("-S") ||
+				args_opts_used("-W") || args_opts_used("-Z") || hex))
+    {
+      r = USER_ERROR("only the output size can be changed for this algorithm, "
+		     "and hexadecimal input is not supported");
+      goto done;
+    }
+  
+  if ((checkpoint_file != NULL) && ((tree_sum_fd != NULL) || hex || check || (args_files_count > 1)))
+    {
+      r = USER_ERROR("checkpoints can only be used when hashing one file, "
+		     "without hexadecimal input, with a single sponge algorithm");
+      goto done;
+    }
+  
+  if (sum_flags && ((tree_sum_fd != NULL) || hex))
+    {
+      r = USER_ERROR("threaded, direct and mapped reading can only be used with a single sponge algorithm, "
+		     "without hexadecimal input");
+      goto done;
+    }
+  
+  if ((sum_flags & ~LIBKECCAK_SUM_FD_MMAP) && (checkpoint_file != NULL))
+    {
+      r = USER_ERROR("threaded and direct reading cannot be used with checkpoints");
+      goto done;
+    }
+  
+  if (forward && ((tree_sum_fd != NULL) || hex || check || (checkpoint_file != NULL) || sum_flags))
+    {
+      r = USER_ERROR("forwarding the input can only be used with a single sponge algorithm, without "
+		     "hexadecimal input, checking, checkpoints, and threaded, direct and mapped reading");
+      goto done;
+    }
+  
   if (squeezes <= 0)
     {
       r = USER_ERROR("the squeeze count most be positive");
@@ -552,6 +1121,9 @@ int run(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec, co
   
   if (args_files_count == 0)
     r = fun("-", &spec, squeezes, suffix, presentation, hex);
+  else if ((args_files_count > 1) && !check && !hex && !sum_flags && !forward && (tree_sum_fd == NULL) &&
+	   ((size_t)((spec.output + 7) / 8) <= OUTPUT_CHUNK_SIZE))
+    r = print_checksums(args_files, (size_t)args_files_count, &spec, squeezes, suffix, presentation);
   else
     for (i = 0; i < (size_t)args_files_count; i++)
       if ((r = fun(args_files[i], &spec, squeezes, suffix, presentation, hex)))
@@ -563,3 +1135,22 @@ int run(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec, co
   return r ? r : bad_found;
 }
 
+
+/**
+ * Parse the command line and calculate the hashes of the selected files,
+ * for algorithms that are not a single sponge, such as tree hashing modes,
+ * only the output size of the algorithm can be changed
+ * 
+ * @param   argc    The first argument from `main`
+ * @param   argv    The second argument from `main`
+ * @param   gspec   The default algorithm parameters
+ * @param   sum_fd  Function that calculates the checksum of a file
+ * @return          An appropriate exit value
+ */
+int run_tree(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec,
+	     int (*sum_fd)(int, const libkeccak_spec_t* restrict, char* restrict))
+{
+  tree_sum_fd = sum_fd;
+  return run(argc, argv, gspec, NULL);
+}
+
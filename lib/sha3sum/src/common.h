@@ -43,6 +43,20 @@
    run(argc, argv, &spec, suffix))
 
 
+/**
+ * Wrapper for `run_tree` that also initialises the command line parser
+ * 
+ * @param  algo    The name of the hashing algorithm, must be a string literal
+ * @param  prog    The name of program, must be a string literal
+ * @param  sum_fd  Function that calculates the checksum of a file
+ */
+#define RUN_TREE(algo, prog, sum_fd)				\
+  (args_init(algo " checksum calculator",			\
+	     prog " [options...] [--] [files...]", NULL,	\
+	     NULL, 1, 0, args_standard_abbreviations),		\
+   run_tree(argc, argv, &spec, sum_fd))
+
+
 
 /**
  * Print the checksum in binary
@@ -72,6 +86,22 @@
  */
 int run(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec, const char* restrict suffix);
 
+/**
+ * Parse the command line and calculate the hashes of the selected files,
+ * for algorithms that are not a single sponge, such as tree hashing modes,
+ * only the output size of the algorithm can be changed
+ * 
+ * @param   argc    The first argument from `main`
+ * @param   argv    The second argument from `main`
+ * @param   gspec   The default algorithm parameters
+ * @param   sum_fd  Function that calculates the checksum of a file, its parameters
+ *                  are a file descriptor, the algorithm parameters, and the output
+ *                  buffer, it returns zero on success and -1 on error
+ * @return          An appropriate exit value
+ */
+int run_tree(int argc, char* argv[], libkeccak_generalised_spec_t* restrict gspec,
+	     int (*sum_fd)(int, const libkeccak_spec_t* restrict, char* restrict));
+
 
 #endif
 
@@ -0,0 +1,52 @@
+/**
+ * sha3sum – SHA-3 (Keccak) checksum calculator
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common.h"
+
+
+
+/**
+ * Calculate the KangarooTwelve checksum of a file
+ * 
+ * @param   fd       The file descriptor of the file to hash
+ * @param   spec     The algorithm parameters, only the output size is used
+ * @param   hashsum  Output parameter for the checksum
+ * @return           Zero on success, -1 on error
+ */
+static int k12sum_fd(int fd, const libkeccak_spec_t* restrict spec, char* restrict hashsum)
+{
+  libkeccak_k12_state_t state;
+  size_t length = (size_t)((spec->output + 7) / 8);
+  int r;
+  
+  r = libkeccak_k12sum_fd(fd, &state, NULL, 0, hashsum, length);
+  libkeccak_k12_destroy(&state);
+  if ((r == 0) && (spec->output & 7))
+    hashsum[length - 1] &= (char)((1 << (spec->output & 7)) - 1);
+  return r;
+}
+
+
+int main(int argc, char* argv[])
+{
+  libkeccak_generalised_spec_t spec;
+  libkeccak_generalised_spec_initialise(&spec);
+  libkeccak_spec_shake((libkeccak_spec_t*)&spec, 128, 256);
+  return RUN_TREE("KangarooTwelve", "k12sum", k12sum_fd);
+}
+